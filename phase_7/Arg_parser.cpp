@@ -19,6 +19,13 @@ Arg_parser::Arg_parser(int argc, char *argv[])
     _parse_args();
     _check_file_path();
     _check_midi_endpoint();
+    _check_native_synth();
+    _check_stream_read();
+    _check_probe();
+    _check_render_only();
+    _check_replay_log();
+    _check_loop();
+    _check_query_notes();
 }
 
 void Arg_parser::_set_args(int argc, char **argv)
@@ -37,21 +44,63 @@ void Arg_parser::_parse_args()
             wait_at_end = true;
         } else if (args[i] == "-d") {
             disk_stream = true;
+        } else if (args[i] == "-r") {
+            stream_read = true;
+        } else if (args[i] == "-k") {
+            write_cache = true;
+        } else if (args[i] == "-m") {
+            probe = true;
+        } else if (args[i] == "-a") {
+            native_synth = true;
         } else if (args[i] == "-b") {
             should_set_bank = true;
             if (++i == argc) {
                 _malformed_input();
             }
             bank_path = args[i];
+        } else if (args[i] == "-g") {
+            if (++i == argc) {
+                _malformed_input();
+            }
+            record_log_path = args[i];
+        } else if (args[i] == "-y") {
+            if (++i == argc) {
+                _malformed_input();
+            }
+            replay_log_path = args[i];
         } else if (args[i] == "-n") {
             should_print = false;
         } else if ((file_path == "") && (args[i][0] == '/' || args[i][0] == '~')) {
             file_path = args[i];
+        } else if (args[i][0] == '/' || args[i][0] == '~') {
+            more_file_paths.push_back(args[i]);
         } else if (args[i] == "-s") {
             if (++i == argc) {
                 _malformed_input();
             }
             start_time = lexical_cast<decltype(start_time), decltype(args[i])>(args[i]);
+        } else if (args[i] == "-l") {
+            if (i + 3 >= argc) {
+                _malformed_input();
+            }
+            ++i;
+            loop_start = lexical_cast<decltype(loop_start), decltype(args[i])>(args[i]);
+            ++i;
+            loop_end = lexical_cast<decltype(loop_end), decltype(args[i])>(args[i]);
+            ++i;
+            loop_repeats = lexical_cast<decltype(loop_repeats), decltype(args[i])>(args[i]);
+            if (loop_repeats == 0) {
+                _malformed_input();
+            }
+        } else if (args[i] == "-q") {
+            if (i + 2 >= argc) {
+                _malformed_input();
+            }
+            query_notes = true;
+            ++i;
+            query_start = lexical_cast<decltype(query_start), decltype(args[i])>(args[i]);
+            ++i;
+            query_end = lexical_cast<decltype(query_end), decltype(args[i])>(args[i]);
         } else if (args[i] == "-t") {
             if (++i == argc) {
                 _malformed_input();
@@ -67,6 +116,17 @@ void Arg_parser::_parse_args()
                 _malformed_input();
             }
             num_frames = lexical_cast<decltype(num_frames), decltype(args[i])>(args[i]);
+        } else if (args[i] == "-v") {
+            if (++i == argc) {
+                _malformed_input();
+            }
+            voice_budget = lexical_cast<decltype(voice_budget), decltype(args[i])>(args[i]);
+        } else if (args[i] == "-x") {
+            render_only = true;
+            if (++i == argc) {
+                _malformed_input();
+            }
+            srate = lexical_cast<decltype(srate), decltype(args[i])>(args[i]);
         } else if (args[i] == "-f") {
             if (i + 3 >= argc) {
                 _malformed_input();
@@ -89,7 +149,8 @@ void Arg_parser::_malformed_input()
 
 void Arg_parser::_check_file_path()
 {
-    if (file_path == "") {
+    // a replay log stands in for the MIDI file
+    if (file_path == "" && !replays_log()) {
         fprintf(stderr, "You have to specify a MIDI file to print or play\n");
         fprintf(stderr, "%s\n", globals::usage_string.c_str());
         exit(1);
@@ -98,8 +159,91 @@ void Arg_parser::_check_file_path()
 
 void Arg_parser::_check_midi_endpoint()
 {
-    if (should_use_midi_endpoint && output_file_path != "") {
-        printf("can't write a file when you try to play out to a MIDI Endpoint\n");
+    if (should_use_midi_endpoint && renders_offline()) {
+        printf("can't render offline (-f or -x) when you try to play out to a MIDI Endpoint\n");
+        exit(1);
+    }
+}
+
+void Arg_parser::_check_native_synth()
+{
+    if (native_synth && should_use_midi_endpoint) {
+        printf("can't use the built-in synth (-a) when you play out to a MIDI Endpoint (-e)\n");
+        exit(1);
+    }
+    if (native_synth && voice_budget == 0) {
+        printf("the built-in synth (-a) needs at least one voice (-v)\n");
+        exit(1);
+    }
+}
+
+void Arg_parser::_check_stream_read()
+{
+    // a streamed file is pulled by the offline render loop, and -t indexes the tracks as they are in the file
+    if (stream_read && (!renders_offline() || (load_flags & kMusicSequenceLoadSMF_ChannelsToTracks))) {
+        printf("can only stream the MIDI file when rendering offline (-f or -x) without -c\n");
         exit(1);
     }
-}
\ No newline at end of file
+    if (stream_read && write_cache) {
+        printf("can't write a sequence cache (-k) while streaming the MIDI file (-r)\n");
+        exit(1);
+    }
+}
+
+void Arg_parser::_check_probe()
+{
+    if (!more_file_paths.empty() && !probe) {
+        printf("can only take more than one MIDI file when probing (-m)\n");
+        exit(1);
+    }
+    if (probe && (should_play || write_cache)) {
+        printf("can't play (-p) or write a cache (-k) when probing (-m)\n");
+        exit(1);
+    }
+}
+
+void Arg_parser::_check_render_only()
+{
+    if (render_only && output_file_path != "") {
+        printf("can't write a file (-f) when only measuring the render (-x)\n");
+        exit(1);
+    }
+}
+
+void Arg_parser::_check_replay_log()
+{
+    if ((record_log_path != "" || replays_log()) && !renders_offline()) {
+        printf("can only record (-g) or replay (-y) a replay log when rendering offline (-f or -x)\n");
+        exit(1);
+    }
+    if (replays_log() && (record_log_path != "" || stream_read || write_cache || probe || file_path != "")) {
+        printf("a replay log (-y) is rendered on its own, without a MIDI file, -g, -r, -k or -m\n");
+        exit(1);
+    }
+}
+
+void Arg_parser::_check_loop()
+{
+    if (!loops()) { return; }
+    // the repeats are mixed from cached audio, which a replay log or a streamed file can't stand in for
+    if (!renders_offline() || stream_read || replays_log() || record_log_path != "") {
+        printf("can only loop (-l) when rendering a loaded MIDI file offline (-f or -x), without -r, -g or -y\n");
+        exit(1);
+    }
+    if (loop_end <= loop_start || start_time > loop_start) {
+        printf("the loop (-l) has to end after it starts, and can't start before -s\n");
+        exit(1);
+    }
+}
+
+void Arg_parser::_check_query_notes()
+{
+    if (query_notes && (stream_read || replays_log() || probe)) {
+        printf("can only list notes (-q) from a loaded MIDI file, without -r, -y or -m\n");
+        exit(1);
+    }
+    if (query_notes && query_end <= query_start) {
+        printf("the note range (-q) has to end after it starts\n");
+        exit(1);
+    }
+}
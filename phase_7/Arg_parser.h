@@ -9,6 +9,8 @@ class Arg_parser {
 public:
     std::vector<std::string> args;
     std::string file_path = std::string{};
+    // any further MIDI files, only -m takes more than one
+    std::vector<std::string> more_file_paths = std::vector<std::string>{};
     int argc;
     bool should_play = false;
     bool should_set_bank = false;
@@ -16,13 +18,34 @@ public:
     bool should_print = true;
     bool wait_at_end = false;
     bool disk_stream = false;
+    bool stream_read = false;
+    bool write_cache = false;
+    bool probe = false;
+    // -a renders with the built-in Wavetable_synth instead of the graph's music device
+    bool native_synth = false;
+    // render offline without writing a file, only to measure throughput
+    bool render_only = false;
     OSType data_format = OSType{0};
     Float64 srate = Float64{0};
     std::string output_file_path = std::string{};
     MusicSequenceLoadFlags load_flags = kMusicSequenceLoadSMF_PreserveTracks;
     std::string bank_path = std::string{};
+    // -g records what an offline render sends the synth, -y renders such a log instead of a MIDI file
+    std::string record_log_path = std::string{};
+    std::string replay_log_path = std::string{};
     Float32 start_time = Float32{0};
+    // -l renders the region between the two beats this many times over
+    Float32 loop_start = Float32{0};
+    Float32 loop_end = Float32{0};
+    UInt32 loop_repeats = UInt32{0};
+    // -q lists the notes sounding between the two beats
+    bool query_notes = false;
+    Float32 query_start = Float32{0};
+    Float32 query_end = Float32{0};
     UInt32 num_frames = UInt32{512};
+    // voices the synth can sound at once, sections of the file that need more are flagged before rendering
+    // and the built-in synth's voice pool is this size
+    UInt32 voice_budget = UInt32{64};
     std::set<int> track_set = std::set<int>{};
 
     Arg_parser(int argc, char *argv[]);
@@ -31,6 +54,12 @@ public:
 
     bool should_print_tracks() const { return should_print && !track_set.empty(); }
 
+    bool renders_offline() const { return output_file_path != "" || render_only; }
+
+    bool replays_log() const { return replay_log_path != ""; }
+
+    bool loops() const { return loop_repeats > 0; }
+
     bool has_track_num(UInt32 track_num) { return !track_set.empty() && (track_set.find(track_num) == track_set.end()); }
 
 private:
@@ -40,9 +69,23 @@ private:
 
     static void _malformed_input();
 
-    static void _check_file_path();
+    void _check_file_path();
 
     void _check_midi_endpoint();
+
+    void _check_native_synth();
+
+    void _check_stream_read();
+
+    void _check_probe();
+
+    void _check_render_only();
+
+    void _check_replay_log();
+
+    void _check_loop();
+
+    void _check_query_notes();
 };
 
 #endif //CORE_MIDI_GEN2_ARG_PARSER_H
@@ -0,0 +1,36 @@
+#ifndef CORE_MIDI_GEN2_ARRAY_VIEW_H
+#define CORE_MIDI_GEN2_ARRAY_VIEW_H
+
+#include <cstddef>
+#include <vector>
+
+// non-owning view of a contiguous array (no std::span in C++14)
+template<typename T>
+class Array_view {
+private:
+    const T *_data = nullptr;
+    std::size_t _size = 0;
+
+public:
+    Array_view() = default;
+
+    Array_view(const T *data, std::size_t size) : _data{data}, _size{size} {}
+
+    Array_view(const std::vector<T> &vec) : _data{vec.data()}, _size{vec.size()} {}
+
+    const T *data() const { return _data; }
+
+    std::size_t size() const { return _size; }
+
+    bool empty() const { return _size == 0; }
+
+    const T *begin() const { return _data; }
+
+    const T *end() const { return _data + _size; }
+
+    const T &operator[](std::size_t i) const { return _data[i]; }
+
+    const T &back() const { return _data[_size - 1]; }
+};
+
+#endif //CORE_MIDI_GEN2_ARRAY_VIEW_H
@@ -1,5 +1,3 @@
-#include <CAHostTimeBase.h>
-
 #include "Au_graph_manager.h"
 
 #include "globals.h"
@@ -9,9 +7,17 @@ void Au_graph_manager::init()
 {
     _set_up_graph();
 
+    // the rate is the device's by now when playing live
+    if (_native_output) {
+        _native_output->install(_graph, _arg_parser.srate);
+    }
+
     if (_arg_parser.should_print) {
         printf("Sample Rate: %.1f \n", _arg_parser.srate);
         printf("Disk Streaming is enabled: %c\n", (_arg_parser.disk_stream ? 'T' : 'F'));
+        if (_native_output) {
+            printf("Built-in synth with %u voices\n", static_cast<unsigned>(_native_output->synth().max_voices()));
+        }
     }
 
     auto result = AUGraphInitialize(_graph);
@@ -31,6 +37,44 @@ void Au_graph_manager::init_sequence(MusicSequence &sequence, AudioUnit &synth)
     check_error(result, "AUGraphOpen");
 
     _get_synth_from_au_graph(synth);
+
+    // the tempo map and the polyphony profile are built before init, at the device's rate
+    // an endpoint renders no audio and keeps its own clock
+    if (!_arg_parser.renders_offline() && !_arg_parser.should_use_midi_endpoint) {
+        _read_device_srate();
+    }
+}
+
+void Au_graph_manager::_read_device_srate()
+{
+    auto node_count = UInt32{};
+    auto result = AUGraphGetNodeCount(_graph, &node_count);
+    check_error(result, "AUGraphGetNodeCount");
+
+    for (auto i = static_cast<UInt32>(0); i < node_count; ++i) {
+        auto node = AUNode{};
+        result = AUGraphGetIndNode(_graph, i, &node);
+        check_error(result, "AUGraphGetIndNode");
+
+        auto desc = AudioComponentDescription{};
+        auto unit = static_cast<AudioUnit>(nullptr);
+        result = AUGraphNodeInfo(_graph, node, &desc, &unit);
+        check_error(result, "AUGraphNodeInfo");
+
+        if (desc.componentType == kAudioUnitType_Output) {
+            auto size = static_cast<UInt32>(sizeof(_arg_parser.srate));
+            result = AudioUnitGetProperty(
+                    unit,
+                    kAudioUnitProperty_SampleRate,
+                    kAudioUnitScope_Output,
+                    0,
+                    &_arg_parser.srate,
+                    &size
+            );
+            check_error(result, "AudioUnitGetProperty: kAudioUnitProperty_SampleRate");
+            return;
+        }
+    }
 }
 
 int Au_graph_manager::_setup_output_unit(
@@ -48,7 +92,7 @@ int Au_graph_manager::_setup_output_unit(
         auto result = AUGraphNodeInfo(_graph, node, 0, &output_unit);
         check_error(result, "AUGraphNodeInfo");
 
-        if (_arg_parser.output_file_path == "") {
+        if (!_arg_parser.renders_offline()) {
             _set_properties_to_render_to_device(output_unit);
         } else {
             _set_properties_to_render_offline(output_unit, current_unit, desc, node, output_node);
@@ -69,7 +113,7 @@ void Au_graph_manager::_reconnect_output_if_offline(
 {
     if (output_unit) {
         // reconnect up to the output unit if we're offline
-        if (_arg_parser.output_file_path != "" && desc.componentType != kAudioUnitType_MusicDevice) {
+        if (_arg_parser.renders_offline() && desc.componentType != kAudioUnitType_MusicDevice) {
             auto result = AUGraphConnectNodeInput(_graph, node, 0, output_node, 0);
             check_error(result, "AUGraphConnectNodeInput");
         }
@@ -149,20 +193,19 @@ void Au_graph_manager::_set_properties_to_render_to_device(AudioUnit output_unit
     // not part of public API
     // changed from private top-level to lambda
     auto overload_listener_proc = [](
-            void */* inRefCon */,
+            void *in_ref_con,
             AudioUnit /* ci */,
             AudioUnitPropertyID /* inID */,
             AudioUnitScope /* inScope */,
             AudioUnitElement /* inElement */
     ) {
-        ++globals::did_overload;
-        globals::overload_time = CAHostTimeBase::GetTheCurrentTime();
+        static_cast<Playback_status *>(in_ref_con)->publish_overload(static_cast<std::uint64_t>(Drift_clock::now_ns()));
     };
 
     result = AudioUnitAddPropertyListener(
             output_unit,
             kAudioDeviceProcessorOverload,
-            overload_listener_proc, 0
+            overload_listener_proc, &_status
     );
     check_error(result, "AudioUnitAddPropertyListener: kAudioDeviceProcessorOverload");
 
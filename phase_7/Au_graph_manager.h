@@ -4,19 +4,28 @@
 #include <AudioToolbox/AudioToolbox.h>
 
 #include "Arg_parser.h"
+#include "Native_synth_output.h"
+#include "Playback_status.h"
 
 class Au_graph_manager {
 private:
     AUGraph _graph = nullptr; // non-owning -> need to handle
     Arg_parser &_arg_parser;
+    // where the device overload listener reports
+    Playback_status &_status;
+    // -a, fed to the output unit in place of the music device
+    Native_synth_output *_native_output = nullptr;
 
 public:
-    Au_graph_manager(Arg_parser &arg_parser) : _arg_parser(arg_parser) {}
+    Au_graph_manager(Arg_parser &arg_parser, Playback_status &status) : _arg_parser(arg_parser), _status(status) {}
 
     ~Au_graph_manager() = default;
 
     AUGraph &get_graph() { return _graph; }
 
+    // before init, which installs it once the sample rate is known
+    void set_native_output(Native_synth_output *output) { _native_output = output; }
+
     void init();
 
     void init_sequence(MusicSequence &sequence, AudioUnit &synth);
@@ -43,6 +52,9 @@ private:
 
     void _set_up_graph();
 
+    // live playback, the output unit's rate into the srate argument
+    void _read_device_srate();
+
     void _set_properties_to_render_to_device(AudioUnit output_unit);
 
     void _set_properties_to_render_offline(
@@ -1,19 +1,39 @@
 #include <AUOutputBL.h>
+#include <algorithm>
+#include <array>
+#include <limits>
 #include <thread>
 
 #include "Core_midi_gen.h"
+#include "Smf_parser.h"
 
 Core_midi_gen::Core_midi_gen(Arg_parser &arg_parser)
         : _arg_parser(arg_parser),
-          _graph_manager{_arg_parser},
+          _graph_manager{_arg_parser, _status},
           _track_set{_arg_parser.track_set} {}
 
 void Core_midi_gen::run()
 {
+    // a probe never builds a sequence or a graph
+    if (_arg_parser.probe) {
+        _probe_files();
+        return;
+    }
+
+    // nor does a replay, the log stands in for the file and the sequencer
+    if (_arg_parser.replays_log()) {
+        _play_replay();
+        return;
+    }
+
     _load_midi_file_to_sequence();
 
     if (_arg_parser.should_print) {
-        CAShow(_sequence);
+        _print_sequence();
+    }
+
+    if (_arg_parser.query_notes) {
+        _print_notes();
     }
 
     // moved clean-up to dtor
@@ -29,31 +49,242 @@ void Core_midi_gen::run()
 Core_midi_gen::~Core_midi_gen()
 {
     // resource disposal
-    if (_arg_parser.should_play) {
-        auto result = DisposeMusicPlayer(_player);
-        check_error(result, "DisposeMusicPlayer");
+    if (_midi_client) {
+        auto result = MIDIClientDispose(_midi_client);
+        check_error(result, "MIDIClientDispose");
+    }
+    if (_sequence) {
+        auto result = DisposeMusicSequence(_sequence);
+        check_error(result, "DisposeMusicSequence");
     }
-    auto result = DisposeMusicSequence(_sequence);
-    check_error(result, "DisposeMusicSequence");
     // don't own the graph so don't dispose it (the seq owns it as we never set it ourselves, we just got it....)
 }
 
+void Core_midi_gen::_probe_files()
+{
+    auto paths = std::vector<std::string>{_arg_parser.file_path};
+    paths.insert(paths.end(), _arg_parser.more_file_paths.begin(), _arg_parser.more_file_paths.end());
+
+    // a bad file gets an error line and the rest are still probed
+    auto probe = Smf_probe{};
+    auto did_fail = false;
+    for (const auto &path : paths) {
+        try {
+            Smf_probe::write_json(probe.probe(path), stdout);
+        } catch (const std::exception &e) {
+            Smf_probe::write_json_error(path, e.what(), stdout);
+            did_fail = true;
+        }
+    }
+
+    if (did_fail) {
+        exit(1);
+    }
+}
+
+Event_sink &Core_midi_gen::_synth_events()
+{
+    if (_native_output) {
+        return _native_output->synth();
+    }
+    return _synth_sink;
+}
+
+Event_sink &Core_midi_gen::_offline_sink()
+{
+    if (_replay_log.is_open()) {
+        return _replay_log;
+    }
+    return _synth_events();
+}
+
+void Core_midi_gen::_open_replay_log()
+{
+    try {
+        _replay_log.open(
+                _arg_parser.record_log_path,
+                static_cast<std::uint32_t>(_arg_parser.srate),
+                _arg_parser.num_frames,
+                _synth_events()
+        );
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: Replay_log_writer::open (%s)", e.what());
+        exit(1);
+    }
+}
+
+void Core_midi_gen::_close_replay_log()
+{
+    try {
+        _replay_log.close();
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: Replay_log_writer::close (%s)", e.what());
+        exit(1);
+    }
+
+    if (_arg_parser.should_print) {
+        printf("Recorded %llu events in %llu blocks to %s\n",
+               static_cast<unsigned long long>(_replay_log.event_count()),
+               static_cast<unsigned long long>(_replay_log.block_count()),
+               _arg_parser.record_log_path.c_str());
+    }
+}
+
 void Core_midi_gen::_load_midi_file_to_sequence()
 {
+    if (_arg_parser.stream_read) {
+        // the events are pulled while rendering, the empty sequence only provides the AUGraph
+        auto result = NewMusicSequence(&_sequence);
+        check_error(result, "NewMusicSequence");
+        return;
+    }
+
+    auto mode = (_arg_parser.load_flags & kMusicSequenceLoadSMF_ChannelsToTracks) ?
+                Smf_track_mode::channels_to_tracks :
+                Smf_track_mode::preserve_tracks;
+    // a fresh cache skips parsing altogether, the sequence points straight into its mapping
+    Sequence_cache cache{_arg_parser.file_path, mode};
+    auto is_cached = cache.is_fresh();
+    if (is_cached) {
+        _midi_sequence = cache.sequence();
+        auto changes = cache.tempo_changes();
+        _tempo_changes.assign(changes.begin(), changes.end());
+    } else {
+        try {
+            _midi_sequence = Smf_parser{mode}.load(_arg_parser.file_path);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "Error: Smf_parser::load (%s)", e.what());
+            exit(1);
+        }
+        _tempo_changes = Tempo_map::tempo_changes(_midi_sequence);
+    }
+
+    auto enabled = Track_merger::enabled_tracks(_midi_sequence.tracks.size(), _track_set);
+    auto has_timeline = is_cached && cache.has_timeline(enabled);
+    if (has_timeline) {
+        _timeline = cache.timeline();
+    } else {
+        _timeline = Track_merger::merge_timeline(_midi_sequence, enabled);
+    }
+
+    if (_arg_parser.write_cache && !has_timeline) {
+        _write_sequence_cache(cache, enabled);
+    }
+
+    // only a -s start or a loop needs to seek
+    if (_arg_parser.start_time > 0 || _arg_parser.loops()) {
+        _seek_index = Seek_index{_midi_sequence, _timeline};
+    }
+
+    // the sequence only provides the AUGraph, every playback path is sequenced from the timeline
     auto result = NewMusicSequence(&_sequence);
     check_error(result, "NewMusicSequence");
+}
 
-    auto url = CFURLCreateFromFileSystemRepresentation(
-            kCFAllocatorDefault,
-            reinterpret_cast<const UInt8 *>(_arg_parser.file_path.c_str()), // unsafe
-            _arg_parser.file_path.size(),
-            false
-    );
-    result = MusicSequenceFileLoad(_sequence, url, kMusicSequenceFile_AnyType, _arg_parser.load_flags);
-    check_error(result, "MusicSequenceFileLoad");
+void Core_midi_gen::_write_sequence_cache(const Sequence_cache &cache, const std::vector<bool> &enabled)
+{
+    // the timeline is stored for the current -t selection
+    try {
+        cache.write(_midi_sequence, _timeline, enabled);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: Sequence_cache::write (%s)", e.what());
+        exit(1);
+    }
 
-    if (url) {
-        CFRelease(url);
+    if (_arg_parser.should_print) {
+        printf("Wrote sequence cache: %s\n", Sequence_cache::path_for(_arg_parser.file_path).c_str());
+    }
+}
+
+void Core_midi_gen::_print_sequence()
+{
+    // what CAShow printed of the MusicSequence, the tempo track and then each track
+    printf("Sequence: format %u, %s %u, %lu tracks, %.2f beats\n",
+           static_cast<unsigned>(_midi_sequence.format),
+           _midi_sequence.is_smpte() ? "SMPTE division" : "ticks per quarter",
+           static_cast<unsigned>(_midi_sequence.is_smpte() ? _midi_sequence.division & 0xFF : _midi_sequence.division),
+           static_cast<unsigned long>(_midi_sequence.tracks.size()),
+           _midi_sequence.beats_for_tick(_midi_sequence.end_tick()));
+
+    auto print_track = [this](const char *name, const Midi_track &track) {
+        auto channel_events = std::size_t{0};
+        for (auto i = std::size_t{0}; i < track.size(); ++i) {
+            if (midi::is_channel_status(track.status[i])) { ++channel_events; }
+        }
+        printf("\t%s: %lu events (%lu channel, %lu sysex/meta), length %.2f beats\n",
+               name,
+               static_cast<unsigned long>(track.size()),
+               static_cast<unsigned long>(channel_events),
+               static_cast<unsigned long>(track.size() - channel_events),
+               _midi_sequence.beats_for_tick(track.end_tick));
+    };
+
+    print_track("tempo track", _midi_sequence.tempo_track);
+    for (auto i = std::size_t{0}; i < _midi_sequence.tracks.size(); ++i) {
+        auto name = "track " + std::to_string(i + 1);
+        print_track(name.c_str(), _midi_sequence.tracks[i]);
+    }
+}
+
+void Core_midi_gen::_print_notes()
+{
+    // one pass to pair the notes, then the range is a tree walk rather than a rescan from the start
+    auto index = Note_index{_midi_sequence, _timeline};
+    auto first_tick = static_cast<std::uint32_t>(_arg_parser.query_start * _midi_sequence.ticks_per_quarter());
+    auto end_tick = static_cast<std::uint32_t>(_arg_parser.query_end * _midi_sequence.ticks_per_quarter());
+
+    auto positions = std::vector<std::uint32_t>{};
+    index.find(first_tick, end_tick, positions);
+    // in start order, as a piano roll reads
+    std::sort(positions.begin(), positions.end());
+
+    printf("%lu of %lu notes sound between beats %.2f and %.2f:\n",
+           static_cast<unsigned long>(positions.size()),
+           static_cast<unsigned long>(index.size()),
+           _arg_parser.query_start,
+           _arg_parser.query_end);
+    for (auto position : positions) {
+        const auto &note = index.notes()[position];
+        auto track = (note.track == Note::tempo_track) ? 0 : note.track + 1;
+        printf("\t%8.2f %8.2f  track %3d  channel %2u  key %3u  velocity %3u\n",
+               _midi_sequence.beats_for_tick(note.start),
+               _midi_sequence.beats_for_tick(note.end),
+               track,
+               static_cast<unsigned>(note.channel + 1),
+               static_cast<unsigned>(note.key),
+               static_cast<unsigned>(note.velocity));
+    }
+}
+
+void Core_midi_gen::_profile_polyphony()
+{
+    _polyphony = Polyphony_profile{_timeline, _tempo_map, _arg_parser.num_frames};
+    if (!_arg_parser.should_print) { return; }
+
+    printf("Polyphony: at most %u notes at once, by channel:", static_cast<unsigned>(_polyphony.peak()));
+    for (auto channel = std::size_t{0}; channel < 16; ++channel) {
+        if (_polyphony.channel_peak(channel)) {
+            printf(" %lu:%u", static_cast<unsigned long>(channel + 1), static_cast<unsigned>(_polyphony.channel_peak(channel)));
+        }
+    }
+    printf("\n");
+
+    // flagged now rather than found as voice stealing halfway through the render
+    auto budget = static_cast<std::uint16_t>(std::min(_arg_parser.voice_budget, UInt32{0xFFFF}));
+    auto sections = _polyphony.sections_over(budget);
+    if (sections.empty()) { return; }
+
+    printf("\t%lu sections need more than the %u voice budget (-v):\n",
+           static_cast<unsigned long>(sections.size()),
+           static_cast<unsigned>(budget));
+    auto block_beats = [this](std::size_t block) {
+        return _tempo_map.beats_for_tick(_tempo_map.tick_for_sample(static_cast<std::int64_t>(block) * _polyphony.block_frames()));
+    };
+    for (const auto &section : sections) {
+        printf("\t\tbeats %.2f - %.2f, %u notes\n",
+               block_beats(section.first_block),
+               block_beats(section.end_block),
+               static_cast<unsigned>(section.peak));
     }
 }
 
@@ -154,20 +385,87 @@ AudioUnit Core_midi_gen::_prepare_output_au_for_writing()
     return output_unit;
 }
 
-void Core_midi_gen::_write_buffer_to_outfile(
+Render_stats Core_midi_gen::_write_buffer_to_outfile(
         MusicTimeStamp sequence_length,
         const CAStreamBasicDescription &client_format,
         const ExtAudioFileRef outfile,
         AudioUnit output_unit
 )
 {
-    auto current_time = MusicTimeStamp{};
     AUOutputBL output_buffer{client_format, _arg_parser.num_frames};
     auto timestamp = AudioTimeStamp{0, 0, 0, 0, 0, kAudioTimeStampSampleTimeValid, 0};
 
+    // each block's events are scheduled at their exact sample offsets before it is rendered,
+    // so event timing doesn't depend on -i and nothing has to ask a player where it is
+    auto sequencer = Sequencer{_midi_sequence, _timeline, _tempo_map};
+    sequencer.seek(_tempo_map.tick_for_beats(_arg_parser.start_time));
+    auto cursor = Tempo_map::Cursor{_tempo_map};
+    auto end_sample = _tempo_map.sample_for_tick(_tempo_map.tick_for_beats(sequence_length));
+
+    // nothing here waits on a clock, the loop runs as fast as the synth renders
+    auto stats = Render_stats{_arg_parser.srate};
+    stats.start();
+
     auto i = 0;
     auto num_times_for_10_secs = static_cast<int>(10. / (_arg_parser.num_frames / _arg_parser.srate));
     do {
+        sequencer.render_block(_arg_parser.num_frames, _offline_sink());
+        stats.end_stage(Render_stats::Stage::sequence);
+
+        output_buffer.Prepare();
+        auto action_flags = AudioUnitRenderActionFlags{0};
+
+        auto result = AudioUnitRender(
+                output_unit,
+                &action_flags,
+                &timestamp,
+                0,
+                _arg_parser.num_frames,
+                output_buffer.ABL()
+        );
+        check_error(result, "AudioUnitRender");
+
+        timestamp.mSampleTime += _arg_parser.num_frames;
+        stats.end_stage(Render_stats::Stage::render);
+
+        if (outfile) {
+            result = ExtAudioFileWrite(outfile, _arg_parser.num_frames, output_buffer.ABL());
+            check_error(result, "ExtAudioFileWrite");
+            stats.end_stage(Render_stats::Stage::write);
+        }
+        stats.end_block(_arg_parser.num_frames);
+        _replay_log.end_block();
+
+        if (_arg_parser.should_print && (++i % num_times_for_10_secs == 0)) {
+            printf("current time: %6.2f beats, %.1fx realtime\n",
+                   _tempo_map.beats_for_tick(cursor.tick_for_sample(sequencer.block_start())),
+                   stats.audio_seconds() / stats.elapsed_seconds());
+        }
+    } while (sequencer.block_start() < end_sample);
+
+    stats.finish();
+    return stats;
+}
+
+Render_stats Core_midi_gen::_write_replay_to_outfile(
+        const CAStreamBasicDescription &client_format,
+        const ExtAudioFileRef outfile,
+        AudioUnit output_unit
+)
+{
+    AUOutputBL output_buffer{client_format, _arg_parser.num_frames};
+    auto timestamp = AudioTimeStamp{0, 0, 0, 0, 0, kAudioTimeStampSampleTimeValid, 0};
+
+    // the sequence stage is only decoding the log, so nearly all of the time is the synth's
+    auto stats = Render_stats{_arg_parser.srate};
+    stats.start();
+
+    auto i = 0;
+    auto num_times_for_10_secs = static_cast<int>(10. / (_arg_parser.num_frames / _arg_parser.srate));
+    while (!_replay_reader->is_finished()) {
+        _replay_reader->deliver_block(_synth_events());
+        stats.end_stage(Render_stats::Stage::sequence);
+
         output_buffer.Prepare();
         auto action_flags = AudioUnitRenderActionFlags{0};
 
@@ -182,22 +480,304 @@ void Core_midi_gen::_write_buffer_to_outfile(
         check_error(result, "AudioUnitRender");
 
         timestamp.mSampleTime += _arg_parser.num_frames;
+        stats.end_stage(Render_stats::Stage::render);
+
+        if (outfile) {
+            result = ExtAudioFileWrite(outfile, _arg_parser.num_frames, output_buffer.ABL());
+            check_error(result, "ExtAudioFileWrite");
+            stats.end_stage(Render_stats::Stage::write);
+        }
+        stats.end_block(_arg_parser.num_frames);
+
+        if (_arg_parser.should_print && (++i % num_times_for_10_secs == 0)) {
+            printf("current time: %6.2f seconds, %.1fx realtime\n",
+                   stats.audio_seconds(),
+                   stats.audio_seconds() / stats.elapsed_seconds());
+        }
+    }
+
+    stats.finish();
+    return stats;
+}
+
+std::vector<bool> Core_midi_gen::_stream_enabled_tracks(const Smf_stream_reader &reader)
+{
+    auto enabled = std::vector<bool>(reader.track_count(), true);
+    // in a format 1 file the first chunk is the tempo track, so -t indices start at the second one
+    auto first_track = (reader.format() == 1) ? std::size_t{1} : std::size_t{0};
+    for (auto i = first_track; i < enabled.size(); ++i) {
+        enabled[i] = !_arg_parser.has_track_num(static_cast<UInt32>(i - first_track));
+    }
+    return enabled;
+}
+
+void Core_midi_gen::_send_stream_event(const Stream_event &event, UInt32 offset)
+{
+    if (midi::is_channel_status(event.status)) {
+        _offline_sink().channel_event(event.status, event.data_1, event.data_2, offset);
+    } else if (event.status == midi::sysex || event.status == midi::sysex_escape) {
+        _offline_sink().sysex(event.status, event.payload, event.payload_length, offset);
+    }
+    // meta events only matter to the clock
+}
+
+void Core_midi_gen::_chase_to(Float32 beats, Event_sink &sink)
+{
+    // Sequencer::seek doesn't chase, so put the synth into the state the file has built up by then
+    auto state = _seek_index.state_at(_tempo_map.tick_for_beats(beats));
+
+    const auto &events = _timeline.events;
+    auto sysex = _seek_index.sysex_before(state);
+    for (auto position : sysex) {
+        sink.sysex(events.status[position], _midi_sequence.payload(events, position), _midi_sequence.payload_length(events, position), 0);
+    }
 
-        result = ExtAudioFileWrite(outfile, _arg_parser.num_frames, output_buffer.ABL());
-        check_error(result, "ExtAudioFileWrite");
+    auto messages = Seek_index::messages(state);
+    for (const auto &message : messages) {
+        sink.channel_event(message.status, message.data_1, message.data_2, 0);
+    }
+
+    if (_arg_parser.should_print) {
+        printf("Chased %lu messages and %lu sysex to beat %.2f (%.2f bpm)\n",
+               static_cast<unsigned long>(messages.size()),
+               static_cast<unsigned long>(sysex.size()),
+               beats,
+               60000000. / state.usec_per_quarter
+        );
+    }
+}
 
-        result = MusicPlayerGetTime(_player, &current_time);
-        check_error(result, "MusicPlayerGetTime");
+Render_stats Core_midi_gen::_write_loop_to_outfile(
+        const CAStreamBasicDescription &client_format,
+        const ExtAudioFileRef outfile,
+        AudioUnit output_unit
+)
+{
+    // the repeats are summed from cached samples
+    if (!(client_format.mFormatFlags & kAudioFormatFlagIsFloat) || client_format.mBitsPerChannel != 32) {
+        fprintf(stderr, "can only loop (-l) when the synth renders 32 bit float samples\n");
+        exit(1);
+    }
+
+    AUOutputBL output_buffer{client_format, _arg_parser.num_frames};
+    auto timestamp = AudioTimeStamp{0, 0, 0, 0, 0, kAudioTimeStampSampleTimeValid, 0};
+    auto buffers = std::vector<float *>(output_buffer.ABL()->mNumberBuffers);
+    auto widths = std::vector<std::uint32_t>{};
+    for (auto b = UInt32{0}; b < output_buffer.ABL()->mNumberBuffers; ++b) {
+        widths.push_back(output_buffer.ABL()->mBuffers[b].mNumberChannels);
+    }
+
+    auto loop_start_tick = _tempo_map.tick_for_beats(_arg_parser.loop_start);
+    auto loop_end_tick = _tempo_map.tick_for_beats(_arg_parser.loop_end);
+    auto loop_start = _tempo_map.sample_for_tick(loop_start_tick);
+    auto loop_end = _tempo_map.sample_for_tick(loop_end_tick);
+    // add 8 beats after a release for the reverb/long releases to tail off
+    auto tail_frames = [this](std::uint32_t tick) {
+        return _tempo_map.sample_for_tick(tick + _tempo_map.tick_for_beats(8)) - _tempo_map.sample_for_tick(tick);
+    };
+
+    Loop_cache cache{widths, loop_end - loop_start, _arg_parser.loop_repeats};
+    Held_note_sink held{_offline_sink()};
+    auto sequencer = Sequencer{_midi_sequence, _timeline, _tempo_map};
+    sequencer.seek(_tempo_map.tick_for_beats(_arg_parser.start_time));
+
+    auto stats = Render_stats{_arg_parser.srate};
+    stats.start();
+
+    // renders the next frames in blocks, sequencing the events that land in them when asked to,
+    // and hands each block's buffers to take
+    auto render_blocks = [&](std::int64_t frames, bool is_sequenced, auto &&take) {
+        while (frames > 0) {
+            auto block_frames = static_cast<UInt32>(std::min(frames, static_cast<std::int64_t>(_arg_parser.num_frames)));
+            if (is_sequenced) {
+                sequencer.render_block(block_frames, held);
+                stats.end_stage(Render_stats::Stage::sequence);
+            }
+
+            output_buffer.Prepare(block_frames);
+            auto action_flags = AudioUnitRenderActionFlags{0};
+
+            auto result = AudioUnitRender(
+                    output_unit,
+                    &action_flags,
+                    &timestamp,
+                    0,
+                    block_frames,
+                    output_buffer.ABL()
+            );
+            check_error(result, "AudioUnitRender");
+
+            timestamp.mSampleTime += block_frames;
+            stats.end_stage(Render_stats::Stage::render);
+
+            for (auto b = std::size_t{0}; b < buffers.size(); ++b) {
+                buffers[b] = static_cast<float *>(output_buffer.ABL()->mBuffers[b].mData);
+            }
+            take(block_frames);
+            frames -= block_frames;
+        }
+    };
+
+    auto i = 0;
+    auto num_times_for_10_secs = static_cast<int>(10. / (_arg_parser.num_frames / _arg_parser.srate));
+    auto write_block = [&](UInt32 frames) {
+        if (outfile) {
+            auto result = ExtAudioFileWrite(outfile, frames, output_buffer.ABL());
+            check_error(result, "ExtAudioFileWrite");
+        }
+        stats.end_stage(Render_stats::Stage::write);
+        stats.end_block(frames);
 
         if (_arg_parser.should_print && (++i % num_times_for_10_secs == 0)) {
-            printf("current time: %6.2f beats\n", current_time);
+            printf("current time: %6.2f seconds, %.1fx realtime\n",
+                   stats.audio_seconds(),
+                   stats.audio_seconds() / stats.elapsed_seconds());
+        }
+    };
+    auto cache_part = [&](Loop_cache::Part part) {
+        return [&, part](UInt32 frames) { cache.append(part, buffers.data(), frames); };
+    };
+
+    // the intro goes straight to the file, what it still sounds at the loop start is kept for the first repeat
+    auto intro_frames = loop_start - sequencer.block_start();
+    if (intro_frames > 0) {
+        render_blocks(intro_frames, true, write_block);
+        held.release_all(0);
+        render_blocks(tail_frames(loop_start_tick), false, cache_part(Loop_cache::Part::intro_tail));
+
+        // the body is rendered from the loop start state alone, so every repeat can reuse it
+        if (_native_output) {
+            _native_output->synth().reset();
+        } else {
+            auto result = AudioUnitReset(_synth, kAudioUnitScope_Global, 0);
+            check_error(result, "AudioUnitReset");
         }
-    } while (current_time < sequence_length);
+        _chase_to(_arg_parser.loop_start, _offline_sink());
+    }
+
+    // the only part of the loop the synth renders, once whatever the repeat count
+    render_blocks(loop_end - loop_start, true, cache_part(Loop_cache::Part::body));
+    held.release_all(0);
+    render_blocks(tail_frames(loop_end_tick), false, cache_part(Loop_cache::Part::tail));
+
+    if (_arg_parser.should_print) {
+        printf("Rendered the %.2f second loop body once for %u repeats\n",
+               static_cast<double>(loop_end - loop_start) / _tempo_map.srate(),
+               static_cast<unsigned>(_arg_parser.loop_repeats));
+    }
+
+    // the repeats are only summed, the time shows up as write
+    auto total = cache.total_frames();
+    for (auto position = std::int64_t{0}; position < total; position += _arg_parser.num_frames) {
+        auto frames = static_cast<UInt32>(std::min(total - position, static_cast<std::int64_t>(_arg_parser.num_frames)));
+        output_buffer.Prepare(frames);
+        for (auto b = std::size_t{0}; b < buffers.size(); ++b) {
+            buffers[b] = static_cast<float *>(output_buffer.ABL()->mBuffers[b].mData);
+        }
+        cache.mix(position, frames, buffers.data());
+        write_block(frames);
+    }
+
+    stats.finish();
+    return stats;
+}
+
+Render_stats Core_midi_gen::_write_stream_to_outfile(
+        const CAStreamBasicDescription &client_format,
+        const ExtAudioFileRef outfile,
+        AudioUnit output_unit
+)
+{
+    Smf_stream_reader reader{_arg_parser.file_path};
+    Smf_stream_merger merger{reader, _stream_enabled_tracks(reader)};
+    auto clock = Stream_clock{reader.division(), _arg_parser.srate};
+
+    auto event = Stream_event{};
+    auto has_event = merger.next(event);
+
+    // chase controllers, programs and sysex before the start time, but don't sound its notes
+    auto start_tick = static_cast<std::uint32_t>(_arg_parser.start_time * clock.ticks_per_quarter());
+    while (has_event && event.tick < start_tick) {
+        auto kind = event.status & 0xF0;
+        if (kind != 0x80 && kind != 0x90) {
+            _send_stream_event(event, 0);
+        }
+        clock.apply(event);
+        has_event = merger.next(event);
+    }
+    auto origin = clock.sample_for_tick(start_tick);
+
+    AUOutputBL output_buffer{client_format, _arg_parser.num_frames};
+    auto timestamp = AudioTimeStamp{0, 0, 0, 0, 0, kAudioTimeStampSampleTimeValid, 0};
+    auto block_start = 0.;
+    auto tail_end = -1.;
+    auto last_tick = start_tick;
+
+    auto stats = Render_stats{_arg_parser.srate};
+    stats.start();
+
+    auto i = 0;
+    auto num_times_for_10_secs = static_cast<int>(10. / (_arg_parser.num_frames / _arg_parser.srate));
+    do {
+        auto block_end = block_start + _arg_parser.num_frames;
+
+        // pull just the events that land in this block, the rest of the file is still unread
+        while (has_event) {
+            auto sample = clock.sample_for_tick(event.tick) - origin;
+            if (sample >= block_end) { break; }
+
+            _send_stream_event(event, static_cast<UInt32>(std::max(sample - block_start, 0.)));
+            clock.apply(event);
+            last_tick = event.tick;
+            has_event = merger.next(event);
+        }
+        stats.end_stage(Render_stats::Stage::sequence);
+
+        output_buffer.Prepare();
+        auto action_flags = AudioUnitRenderActionFlags{0};
+
+        auto result = AudioUnitRender(
+                output_unit,
+                &action_flags,
+                &timestamp,
+                0,
+                _arg_parser.num_frames,
+                output_buffer.ABL()
+        );
+        check_error(result, "AudioUnitRender");
+
+        timestamp.mSampleTime += _arg_parser.num_frames;
+        block_start = block_end;
+        stats.end_stage(Render_stats::Stage::render);
+
+        if (outfile) {
+            result = ExtAudioFileWrite(outfile, _arg_parser.num_frames, output_buffer.ABL());
+            check_error(result, "ExtAudioFileWrite");
+            stats.end_stage(Render_stats::Stage::write);
+        }
+        stats.end_block(_arg_parser.num_frames);
+        _replay_log.end_block();
+
+        if (_arg_parser.should_print && (++i % num_times_for_10_secs == 0)) {
+            printf("current time: %6.2f beats, %.1fx realtime\n",
+                   last_tick / clock.ticks_per_quarter(),
+                   stats.audio_seconds() / stats.elapsed_seconds());
+        }
+
+        if (!has_event && tail_end < 0) {
+            // add 8 beats on the end for the reverb/long releases to tail off
+            auto tail_ticks = static_cast<std::uint32_t>(8 * clock.ticks_per_quarter());
+            tail_end = clock.sample_for_tick(last_tick + tail_ticks) - origin;
+        }
+    } while (has_event || block_start < tail_end);
+
+    stats.finish();
+    return stats;
 }
 
 void Core_midi_gen::_write_output_file(MusicTimeStamp sequence_length)
 {
-    auto outfile = _prepare_outfile_for_writing();
+    auto outfile = _arg_parser.render_only ? nullptr : _prepare_outfile_for_writing();
     auto output_unit = _prepare_output_au_for_writing();
 
     {
@@ -213,72 +793,222 @@ void Core_midi_gen::_write_output_file(MusicTimeStamp sequence_length)
         );
         check_error(result, "AudioUnitGetProperty: kAudioUnitProperty_StreamFormat");
 
-        size = sizeof(client_format);
-        result = ExtAudioFileSetProperty(outfile, kExtAudioFileProperty_ClientDataFormat, size, &client_format);
-        check_error(result, "ExtAudioFileSetProperty: kExtAudioFileProperty_ClientDataFormat");
+        if (outfile) {
+            size = sizeof(client_format);
+            result = ExtAudioFileSetProperty(outfile, kExtAudioFileProperty_ClientDataFormat, size, &client_format);
+            check_error(result, "ExtAudioFileSetProperty: kExtAudioFileProperty_ClientDataFormat");
+        }
+
+        auto stats = Render_stats{_arg_parser.srate};
+        if (_replay_reader) {
+            stats = _write_replay_to_outfile(client_format, outfile, output_unit);
+        } else if (_arg_parser.loops()) {
+            stats = _write_loop_to_outfile(client_format, outfile, output_unit);
+        } else if (_arg_parser.stream_read) {
+            stats = _write_stream_to_outfile(client_format, outfile, output_unit);
+        } else {
+            stats = _write_buffer_to_outfile(sequence_length, client_format, outfile, output_unit);
+        }
+
+        if (_replay_log.is_open()) {
+            _close_replay_log();
+        }
 
-        _write_buffer_to_outfile(sequence_length, client_format, outfile, output_unit);
+        // -x is only run for these numbers, so they are printed even with -n
+        if (_arg_parser.should_print || _arg_parser.render_only) {
+            stats.print(stdout);
+        }
     }
 
-    ExtAudioFileDispose(outfile);
+    if (outfile) {
+        ExtAudioFileDispose(outfile);
+    }
 }
 
 void Core_midi_gen::_print_overloads()
 {
-    // TODO: may be able to replace with standard library
-    printf("* * * * * %lu Overloads detected on device playing audio\n",
-           static_cast<unsigned long>(globals::did_overload));
-    globals::overload_time = CAHostTimeBase::ConvertToNanos(
-            globals::overload_time - globals::start_running_time
-    );
-    printf("\tSeconds after start = %lf\n", globals::overload_time / 1000000000.);
-    globals::did_overload = 0;
+    auto overload_ns = UInt64{};
+    auto overloads = _status.take_overloads(overload_ns);
+    printf("* * * * * %lu Overloads detected on device playing audio\n", static_cast<unsigned long>(overloads));
+    auto overload_time = overload_ns - globals::start_running_time;
+    printf("\tSeconds after start = %lf\n", overload_time / 1000000000.);
 }
 
 void Core_midi_gen::_print_load(const MusicTimeStamp& time)
 {
-    printf("current time: %6.2f beats", time);
     if (_graph_manager.get_graph()) {
         auto load = Float32{};
         auto result = AUGraphGetCPULoad(_graph_manager.get_graph(), &load);
         check_error(result, "AUGraphGetCPULoad");
-        printf(", CPU load = %.2f%%\n", (load * 100.));
+        _print_load(time, load);
     } else {
-        printf("\n");
+        printf("current time: %6.2f beats\n", time);
     } //no cpu load on AU_graph - its not running - if just playing out to MIDI
 }
 
-// initialize static variable
+void Core_midi_gen::_print_load(const MusicTimeStamp &time, Float32 load)
+{
+    printf("current time: %6.2f beats, CPU load = %.2f%%\n", time, (load * 100.));
+}
+
+// initialize static variables
 const std::chrono::seconds Core_midi_gen::_loop_sleep_dur = std::chrono::seconds{2};
+const std::chrono::milliseconds Core_midi_gen::_max_wake_latency = std::chrono::milliseconds{100};
 
-void Core_midi_gen::_print_info_while_playing(MusicTimeStamp sequence_length)
+void Core_midi_gen::_play_live(MusicTimeStamp sequence_length)
 {
+    auto output_unit = _prepare_output_au_for_writing();
+    auto sequencer = Sequencer{_midi_sequence, _timeline, _tempo_map};
+    sequencer.seek(_tempo_map.tick_for_beats(_arg_parser.start_time));
+    auto cursor = Tempo_map::Cursor{_tempo_map};
+    auto end_sample = _tempo_map.sample_for_tick(_tempo_map.tick_for_beats(sequence_length));
+    // half a second of events queued ahead of what the device has played, topped up when half of it is left
+    auto lookahead = static_cast<std::int64_t>(_tempo_map.srate() / 2);
+
+    _status.reset(sequencer.block_start());
+    auto native_synth = _native_output ? &_native_output->synth() : nullptr;
+    // the device's deadline is real here, unlike offline
+    if (native_synth) {
+        native_synth->limit_voices(globals::max_cpu_load, globals::min_cpu_load);
+    }
+    Live_renderer renderer{
+            _synth, native_synth, output_unit, _status, sequencer.block_start(), end_sample, lookahead / 2, static_cast<Float64>(_tempo_map.srate())
+    };
+    Live_event_sink sink{renderer};
+
+    auto result = AUGraphStart(_graph_manager.get_graph());
+    check_error(result, "AUGraphStart");
+
+    auto next_report = Playback_status::Clock::now() + _loop_sleep_dur;
     auto wait_counter = 0;
-    while (true) {
-        // prefer standard library over Posix usleep
-        std::this_thread::sleep_for(_loop_sleep_dur);
+    while (!_status.is_finished()) {
+        // only this thread sequences, the render thread just takes what is due from the ring
+        // the device's clock is followed against the wall clock, so the top-ups keep pace with the samples it
+        // actually consumes however long the session runs, and between blocks rather than once per block
+        auto clock = _status.clock();
+        auto played_sample = clock.is_valid() ? clock.sample_at(Drift_clock::now_ns()) : _status.position();
+        while (sink.flush() && !sequencer.is_finished() && sequencer.block_start() < played_sample + lookahead) {
+            sink.set_block_start(sequencer.block_start());
+            sequencer.render_block(_arg_parser.num_frames, sink);
+        }
+        if (sink.has_pending()) {
+            renderer.set_queued_until(sink.pending_from());
+        } else if (sequencer.is_finished()) {
+            renderer.set_queued_until(std::numeric_limits<std::int64_t>::max());
+        } else {
+            renderer.set_queued_until(sequencer.block_start());
+        }
 
-        if (globals::did_overload) {
+        if (_status.has_overloads()) {
             _print_overloads();
         }
 
-        if (_arg_parser.wait_at_end && ++wait_counter > 10) { break; }
+        if (Playback_status::Clock::now() >= next_report) {
+            next_report += _loop_sleep_dur;
+            if (_arg_parser.wait_at_end && ++wait_counter > 10) { break; }
+            if (_arg_parser.should_print) {
+                _print_load(_tempo_map.beats_for_tick(cursor.tick_for_sample(played_sample)), _status.cpu_load());
+                if (native_synth && native_synth->voice_limiter()->ceiling() < native_synth->max_voices()) {
+                    printf("\tvoices limited to %u of %u\n",
+                           static_cast<unsigned>(native_synth->voice_limiter()->ceiling()),
+                           static_cast<unsigned>(native_synth->max_voices()));
+                }
+            }
+        }
 
-        auto time = MusicTimeStamp{};
-        auto result = MusicPlayerGetTime(_player, &time);
-        check_error(result, "MusicPlayerGetTime");
+        // woken when the ring runs low or the sequence ends
+        _status.wait_until(std::min(next_report, Playback_status::Clock::now() + _max_wake_latency));
+    }
 
-        if (_arg_parser.should_print) {
-            _print_load(time);
+    result = AUGraphStop(_graph_manager.get_graph());
+    check_error(result, "AUGraphStop");
+
+    if (_status.late_events() && _arg_parser.should_print) {
+        printf("%lu events reached the render thread late\n", static_cast<unsigned long>(_status.late_events()));
+    }
+    if (_arg_parser.should_print) {
+        printf("device clock ran at %.2f Hz, %+.1f ppm from nominal\n", renderer.clock().average_srate(), renderer.clock().drift_ppm());
+    }
+    if (native_synth) {
+        _print_voice_limiter(*native_synth->voice_limiter());
+    }
+}
+
+void Core_midi_gen::_print_voice_limiter(const Voice_limiter &limiter)
+{
+    // shed voices are audible, so they are reported whatever -n says
+    if (!_arg_parser.should_print && !limiter.lowered()) { return; }
+
+    printf("Voice limiter: peak block load %.0f%%, ceiling lowered %u times (to as few as %u of %u voices), raised %u times, %lu voices shed\n",
+           limiter.peak_load() * 100.,
+           static_cast<unsigned>(limiter.lowered()),
+           static_cast<unsigned>(limiter.lowest_ceiling()),
+           static_cast<unsigned>(limiter.max_voices()),
+           static_cast<unsigned>(limiter.raised()),
+           static_cast<unsigned long>(limiter.shed_voices()));
+}
+
+void Core_midi_gen::_play_to_endpoint(MusicTimeStamp sequence_length)
+{
+    auto sequencer = Sequencer{_midi_sequence, _timeline, _tempo_map};
+    sequencer.seek(_tempo_map.tick_for_beats(_arg_parser.start_time));
+    auto cursor = Tempo_map::Cursor{_tempo_map};
+    auto end_sample = _tempo_map.sample_for_tick(_tempo_map.tick_for_beats(sequence_length));
+    // half a second on the wheel ahead of the clock, topped up when half of it is left
+    auto lookahead = static_cast<std::int64_t>(_tempo_map.srate() / 2);
+    auto top_up_interval = std::int64_t{250000000}; // ns
+
+    auto start = Endpoint_dispatcher::now_ns();
+    Endpoint_dispatcher dispatcher{
+            _midi_port, _midi_destination, static_cast<Float64>(_tempo_map.srate()), sequencer.block_start(), start
+    };
+    // the device gets the state the file has built up by -s at the start deadline, ahead of the first block's events
+    if (_arg_parser.start_time > 0) {
+        _chase_to(_arg_parser.start_time, dispatcher);
+    }
+    auto next_top_up = start;
+    auto next_report = start + std::chrono::duration_cast<std::chrono::nanoseconds>(_loop_sleep_dur).count();
+
+    auto wait_counter = 0;
+    while (true) {
+        auto now = Endpoint_dispatcher::now_ns();
+        auto played_sample = dispatcher.sample_at(now);
+        if (now >= next_top_up) {
+            while (dispatcher.has_room() && !sequencer.is_finished() &&
+                   sequencer.block_start() < played_sample + lookahead) {
+                dispatcher.set_block_start(sequencer.block_start());
+                sequencer.render_block(_arg_parser.num_frames, dispatcher);
+            }
+            next_top_up = now + top_up_interval;
+        }
+
+        auto next_expiry = dispatcher.dispatch(now);
+        if (played_sample >= end_sample && dispatcher.is_idle()) { break; }
+
+        if (now >= next_report) {
+            next_report += std::chrono::duration_cast<std::chrono::nanoseconds>(_loop_sleep_dur).count();
+            if (_arg_parser.wait_at_end && ++wait_counter > 10) { break; }
+            if (_arg_parser.should_print) {
+                _print_load(_tempo_map.beats_for_tick(cursor.tick_for_sample(played_sample)));
+            }
         }
 
-        if (time >= sequence_length) { break; }
+        // wakes for the next batch, so a dense passage goes out tick by tick instead of in bursts
+        auto wake = std::min(std::min(next_expiry, next_top_up), next_report);
+        std::this_thread::sleep_for(std::chrono::nanoseconds{std::max(wake - Endpoint_dispatcher::now_ns(), std::int64_t{0})});
+    }
+
+    if (_arg_parser.should_print) {
+        printf("%llu events sent, latest %.3f ms after its deadline\n",
+               static_cast<unsigned long long>(dispatcher.sent()),
+               dispatcher.max_error_ns() / 1000000.);
     }
 }
 
 void Core_midi_gen::_init_sequence()
 {
     _graph_manager.init_sequence(_sequence, _synth);
+    _synth_sink = Synth_event_sink{_synth};
 
     auto result = AudioUnitSetProperty(
             _synth,
@@ -289,46 +1019,161 @@ void Core_midi_gen::_init_sequence()
             sizeof(globals::max_cpu_load)
     );
     check_error(result, "AudioUnitSetProperty: kAudioUnitProperty_CPULoad");
+}
 
+void Core_midi_gen::_init_outputs()
+{
     if (_arg_parser.should_use_midi_endpoint) {
         _setup_midi_endpoint();
     } else {
+        if (_arg_parser.native_synth) {
+            _sample_bank = _load_sample_bank();
+            // the generated set has nothing on disk
+            if (_arg_parser.disk_stream && _arg_parser.should_set_bank) {
+                _streamer = _open_streamer();
+            }
+            _native_output = std::make_unique<Native_synth_output>(*_sample_bank, _native_voices(), _streamer.get());
+            _graph_manager.set_native_output(_native_output.get());
+        }
         _setup_alternate_output();
     }
+}
 
-    result = NewMusicPlayer(&_player);
-    check_error(result, "NewMusicPlayer");
+std::unique_ptr<Sample_bank> Core_midi_gen::_load_sample_bank()
+{
+    if (!_arg_parser.should_set_bank) {
+        return std::make_unique<Gm_wavetable_bank>();
+    }
 
-    result = MusicPlayerSetSequence(_player, _sequence);
-    check_error(result, "MusicPlayerSetSequence");
+    try {
+        auto start_ns = Drift_clock::now_ns();
+        // mapped once, the form in its RIFF header picks the reader
+        auto file = std::make_shared<const Mapped_file>(_arg_parser.bank_path);
+        if (riff::is_form(file->data(), file->size(), "DLS ")) {
+            auto bank = std::make_unique<Dls_bank>(std::move(file));
+            if (_arg_parser.should_print) {
+                printf("Mapped Sound Bank:%s, %lu instruments, %lu regions, %lu waves in %.1f ms, decoded as they are played\n",
+                       _arg_parser.bank_path.c_str(),
+                       static_cast<unsigned long>(bank->preset_count()),
+                       static_cast<unsigned long>(bank->region_count()),
+                       static_cast<unsigned long>(bank->wave_count()),
+                       (Drift_clock::now_ns() - start_ns) / 1000000.);
+            }
+            return std::move(bank);
+        }
+
+        auto bank = std::make_unique<Sf2_bank>(std::move(file));
+        if (_arg_parser.should_print) {
+            printf("Mapped Sound Bank:%s, %lu presets, %lu regions in %.1f ms, %.1f MB of samples left on disk\n",
+                   _arg_parser.bank_path.c_str(),
+                   static_cast<unsigned long>(bank->preset_count()),
+                   static_cast<unsigned long>(bank->region_count()),
+                   (Drift_clock::now_ns() - start_ns) / 1000000.,
+                   bank->sample_bytes() / 1048576.);
+        }
+        return std::move(bank);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: Sample_bank (%s)", e.what());
+        exit(1);
+    }
 }
 
-void Core_midi_gen::_init_single_track(UInt32 track_num, MusicTimeStamp &sequence_length, bool should_print_tracks)
+UInt32 Core_midi_gen::_native_voices() const
 {
-    auto track = static_cast<MusicTrack>(nullptr);
-    auto track_length = MusicTimeStamp{};
-    auto prop_size = static_cast<UInt32>(sizeof(MusicTimeStamp));
+    // -r and -y have no timeline to profile, the budget is all there is to go on
+    if (!_polyphony.block_frames()) {
+        return _arg_parser.voice_budget;
+    }
+    auto voices = std::max(static_cast<UInt32>(_polyphony.peak()), globals::min_native_voices);
+    return std::min(voices, _arg_parser.voice_budget);
+}
 
-    auto result = MusicSequenceGetIndTrack(_sequence, track_num, &track);
-    check_error(result, "MusicSequenceGetIndTrack");
+std::unique_ptr<Disk_streamer> Core_midi_gen::_open_streamer()
+{
+    auto mode = _arg_parser.renders_offline() ? Disk_streamer::Mode::in_line : Disk_streamer::Mode::background;
+    try {
+        return std::make_unique<Disk_streamer>(_arg_parser.bank_path, _native_voices(), mode);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: Disk_streamer (%s)", e.what());
+        exit(1);
+    }
+}
 
-    result = MusicTrackGetProperty(
-            track,
-            kSequenceTrackProperty_TrackLength,
-            &track_length,
-            &prop_size
-    );
-    check_error(result, "MusicTrackGetProperty: kSequenceTrackProperty_TrackLength");
+void Core_midi_gen::_preload_presets()
+{
+    // a bank may decode on a preset's first lookup, so every program the sequence selects is looked up here,
+    // before the render thread can, following the bank select MSB of each channel as the synth does
+    auto bank_msb = std::array<std::uint8_t, 16>{};
+    auto preload = [this, &bank_msb](std::size_t channel, std::uint8_t program) {
+        auto bank = std::uint16_t{bank_msb[channel]};
+        if (channel == Wavetable_synth::drum_channel) {
+            bank = Sample_bank::percussion_bank;
+        }
+        auto preset = _sample_bank->find_preset(bank, program);
+        if (preset && _streamer) {
+            _streamer->preload(*preset);
+        }
+    };
+    // what the synth's system reset does at the start and on GM system on, reset all controllers (CC 121) keeps the bank
+    auto system_reset = [&bank_msb, &preload]() {
+        bank_msb.fill(0);
+        for (auto channel = std::size_t{0}; channel < 16; ++channel) {
+            preload(channel, 0);
+        }
+    };
+    system_reset();
+
+    const auto &events = _timeline.events;
+    for (auto i = std::size_t{0}; i < events.size(); ++i) {
+        auto status = events.status[i];
+        auto channel = static_cast<std::size_t>(status & 0x0F);
+        if (status == midi::sysex) {
+            if (Wavetable_synth::is_system_on(status, _midi_sequence.payload(events, i), _midi_sequence.payload_length(events, i))) {
+                system_reset();
+            }
+            continue;
+        }
+        switch (status & 0xF0) {
+            case 0xB0:
+                if (events.data_1[i] == 0) { bank_msb[channel] = events.data_2[i]; }
+                break;
+            case 0xC0:
+                preload(channel, events.data_1[i]);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void Core_midi_gen::_print_streaming()
+{
+    auto underruns = _native_output->synth().stream_underruns();
+    // underruns are worth knowing about whatever -n says
+    if (!_arg_parser.should_print && !underruns && !_streamer->read_errors()) { return; }
+
+    printf("Disk streaming: %lu samples, %.1f MB of attacks and %.1f MB of voice rings in memory, "
+           "%lu reads of %.1f MB, %lu underruns, %lu read errors\n",
+           static_cast<unsigned long>(_streamer->source_count()),
+           _streamer->attack_bytes() / 1048576.,
+           _streamer->ring_bytes() / 1048576.,
+           static_cast<unsigned long>(_streamer->reads()),
+           _streamer->bytes_read() / 1048576.,
+           static_cast<unsigned long>(underruns),
+           static_cast<unsigned long>(_streamer->read_errors()));
+}
+
+void Core_midi_gen::_init_single_track(UInt32 track_num, MusicTimeStamp &sequence_length, bool should_print_tracks)
+{
+    // the end tick is cached per track at load time, no need to ask the MusicTrack for its length
+    auto track_length = MusicTimeStamp{_midi_sequence.beats_for_tick(_midi_sequence.tracks[track_num].end_tick)};
 
     if (track_length > sequence_length) {
         sequence_length = track_length;
     }
 
-    if (_arg_parser.has_track_num(track_num)) {
-        auto mute = Boolean{true};
-        result = MusicTrackSetProperty(track, kSequenceTrackProperty_MuteStatus, &mute, sizeof(mute));
-        check_error(result, "MusicTrackSetProperty: kSequenceTrackProperty_MuteStatus");
-    } else if (should_print_tracks) {
+    // the timeline already leaves the muted tracks out
+    if (!_arg_parser.has_track_num(track_num) && should_print_tracks) {
         printf("%d, ", static_cast<int>(track_num + 1));
     }
 }
@@ -336,10 +1181,7 @@ void Core_midi_gen::_init_single_track(UInt32 track_num, MusicTimeStamp &sequenc
 void Core_midi_gen::_init_tracks(MusicTimeStamp &sequence_length)
 {
     // figure out sequence length
-    auto num_tracks = UInt32{};
-
-    auto result = MusicSequenceGetTrackCount(_sequence, &num_tracks);
-    check_error(result, "MusicSequenceGetTrackCount");
+    auto num_tracks = static_cast<UInt32>(_midi_sequence.tracks.size());
 
     auto should_print_tracks = _arg_parser.should_print_tracks();
     if (should_print_tracks) {
@@ -357,48 +1199,155 @@ void Core_midi_gen::_init_tracks(MusicTimeStamp &sequence_length)
 
 void Core_midi_gen::_play_sequence()
 {
+    // opens the graph, live playback gets the device's sample rate for the tempo map here
     _init_sequence();
 
+    if (_arg_parser.stream_read) {
+        _init_outputs();
+        _play_stream();
+        return;
+    }
+
+    // MIDI endpoint playback renders no audio, microsecond resolution is plenty for reporting
+    _tempo_map = Tempo_map{
+            _midi_sequence.division,
+            _tempo_changes,
+            _arg_parser.should_use_midi_endpoint ? 1000000. : _arg_parser.srate
+    };
+
+    // an endpoint's own synth has its own voices,
+    // ours is built after this so it only gets the voices the sequence can use
+    if (!_arg_parser.should_use_midi_endpoint) {
+        _profile_polyphony();
+    }
+    _init_outputs();
+    if (_native_output) {
+        try {
+            _preload_presets();
+        } catch (const std::exception &e) {
+            fprintf(stderr, "Error: Disk_streamer (%s)", e.what());
+            exit(1);
+        }
+    }
+
     auto sequence_length = MusicTimeStamp{0.};
     _init_tracks(sequence_length);
     // add 8 beats on the end for the reverb/long releases to tail off
     sequence_length += 8;
 
-    auto result = MusicPlayerSetTime(_player, _arg_parser.start_time);
-    check_error(result, "MusicPlayerSetTime");
+    // opened before the chase so a replay starts from the same synth state
+    if (_arg_parser.record_log_path != "") {
+        _open_replay_log();
+    }
 
-    result = MusicPlayerPreroll(_player);
-    check_error(result, "MusicPlayerPreroll");
+    // an endpoint is chased through its dispatcher, once playback has a clock
+    if (_arg_parser.start_time > 0 && !_arg_parser.should_use_midi_endpoint) {
+        _chase_to(_arg_parser.start_time, _offline_sink());
+    }
 
     if (_arg_parser.should_print) {
-        printf("Ready to play: %s, %.2f beats long\n\t<Enter> to continue: ", _arg_parser.file_path.c_str(),
-               sequence_length
+        printf("Ready to play: %s, %.2f beats (%.2f seconds) long\n\t<Enter> to continue: ",
+               _arg_parser.file_path.c_str(),
+               sequence_length,
+               _tempo_map.seconds_for_tick(_tempo_map.tick_for_beats(sequence_length))
         );
         getc(stdin);
     }
 
-    globals::start_running_time = CAHostTimeBase::GetTheCurrentTime();
-
-    result = MusicPlayerStart(_player);
-    check_error(result, "MusicPlayerStart");
+    globals::start_running_time = static_cast<UInt64>(Drift_clock::now_ns());
 
-    if (_arg_parser.output_file_path != "") {
+    if (_arg_parser.should_use_midi_endpoint) {
+        _play_to_endpoint(sequence_length);
+    } else if (_arg_parser.renders_offline()) {
         _write_output_file(sequence_length);
     } else {
-        _print_info_while_playing(sequence_length);
+        _play_live(sequence_length);
+    }
+    if (_streamer) {
+        _print_streaming();
     }
-
-    result = MusicPlayerStop(_player);
-    check_error(result, "MusicPlayerStop");
     if (_arg_parser.should_print) { printf("finished playing\n"); }
 
     // moved clean-up to dtor
 }
 
+void Core_midi_gen::_play_stream()
+{
+    // no timeline here, the render loop feeds the synth straight from the file
+    if (_arg_parser.should_print) {
+        printf("Ready to stream: %s\n\t<Enter> to continue: ", _arg_parser.file_path.c_str());
+        getc(stdin);
+    }
+
+    if (_arg_parser.record_log_path != "") {
+        _open_replay_log();
+    }
+
+    globals::start_running_time = static_cast<UInt64>(Drift_clock::now_ns());
+
+    try {
+        _write_output_file(MusicTimeStamp{0.});
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: Smf_stream_reader (%s)", e.what());
+        exit(1);
+    }
+
+    if (_arg_parser.should_print) { printf("finished playing\n"); }
+}
+
+void Core_midi_gen::_play_replay()
+{
+    try {
+        _replay_reader = std::make_unique<Replay_log_reader>(_arg_parser.replay_log_path);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: Replay_log_reader (%s)", e.what());
+        exit(1);
+    }
+
+    // the synth only renders the same samples at the rate and block size the log was recorded with
+    if (_replay_reader->srate() != static_cast<UInt32>(_arg_parser.srate) ||
+        _replay_reader->block_frames() != _arg_parser.num_frames) {
+        fprintf(stderr, "%s was recorded at %u Hz in blocks of %u frames, replay it with the same srate and -i\n",
+                _arg_parser.replay_log_path.c_str(),
+                static_cast<unsigned>(_replay_reader->srate()),
+                static_cast<unsigned>(_replay_reader->block_frames()));
+        exit(1);
+    }
+
+    if (_arg_parser.should_print) {
+        printf("Replay log: %s, %llu events in %llu blocks\n",
+               _arg_parser.replay_log_path.c_str(),
+               static_cast<unsigned long long>(_replay_reader->event_count()),
+               static_cast<unsigned long long>(_replay_reader->block_count()));
+    }
+    if (!_arg_parser.should_play) { return; }
+
+    // the sequence only provides the AUGraph
+    auto result = NewMusicSequence(&_sequence);
+    check_error(result, "NewMusicSequence");
+    _init_sequence();
+    _init_outputs();
+
+    if (_arg_parser.should_print) {
+        printf("Ready to replay\n\t<Enter> to continue: ");
+        getc(stdin);
+    }
+
+    globals::start_running_time = static_cast<UInt64>(Drift_clock::now_ns());
+
+    try {
+        _write_output_file(MusicTimeStamp{0.});
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: Replay_log_reader (%s)", e.what());
+        exit(1);
+    }
+
+    if (_arg_parser.should_print) { printf("finished playing\n"); }
+}
+
 void Core_midi_gen::_setup_midi_endpoint()
 {
-    auto midi_client = MIDIClientRef{};
-    auto result = MIDIClientCreate(CFSTR("Play Sequence"), nullptr, nullptr, &midi_client);
+    auto result = MIDIClientCreate(CFSTR("Play Sequence"), nullptr, nullptr, &_midi_client);
     check_error(result, "MIDIClientCreate");
 
     auto dest_count = MIDIGetNumberOfDestinations();
@@ -407,13 +1356,15 @@ void Core_midi_gen::_setup_midi_endpoint()
         exit(1);
     }
 
-    result = MusicSequenceSetMIDIEndpoint(_sequence, MIDIGetDestination(0));
-    check_error(result, "MusicSequenceSetMIDIEndpoint");
+    result = MIDIOutputPortCreate(_midi_client, CFSTR("Play Sequence Output"), &_midi_port);
+    check_error(result, "MIDIOutputPortCreate");
+    _midi_destination = MIDIGetDestination(0);
 }
 
 void Core_midi_gen::_setup_alternate_output()
 {
-    if (_arg_parser.should_set_bank) {
+    // the built-in synth has mapped the bank already
+    if (_arg_parser.should_set_bank && !_native_output) {
         auto sound_bank_url = CFURLCreateFromFileSystemRepresentation(
                 kCFAllocatorDefault,
                 reinterpret_cast<const UInt8 *>(_arg_parser.bank_path.c_str()), // unsafe
@@ -437,7 +1388,8 @@ void Core_midi_gen::_setup_alternate_output()
         check_error(result, "AudioUnitSetProperty: kMusicDeviceProperty_SoundBankURL");
     }
 
-    if (_arg_parser.disk_stream) {
+    // the built-in synth streams with a Disk_streamer
+    if (_arg_parser.disk_stream && !_native_output) {
         auto value = static_cast<UInt32>(_arg_parser.disk_stream);
         auto result = AudioUnitSetProperty(
                 _synth,
@@ -450,7 +1402,7 @@ void Core_midi_gen::_setup_alternate_output()
         check_error(result, "AudioUnitSetProperty: kMusicDeviceProperty_StreamFromDisk");
     }
 
-    if (_arg_parser.output_file_path != "") {
+    if (_arg_parser.renders_offline()) {
         // need to tell synth that is going to render a file.
         auto value = UInt32{1};
         auto result = AudioUnitSetProperty(
@@ -6,8 +6,8 @@
 #include <CoreAudio/CoreAudioTypes.h>
 
 #include <CAAudioFileFormats.h>
-#include <CAHostTimeBase.h>
 
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -17,6 +17,29 @@
 #include "globals.h"
 #include "util.h"
 #include "Au_graph_manager.h"
+#include "Disk_streamer.h"
+#include "Dls_bank.h"
+#include "Drift_clock.h"
+#include "Endpoint_dispatcher.h"
+#include "Gm_wavetable_bank.h"
+#include "Live_renderer.h"
+#include "Loop_cache.h"
+#include "Midi_sequence.h"
+#include "Native_synth_output.h"
+#include "Note_index.h"
+#include "Playback_status.h"
+#include "Polyphony_profile.h"
+#include "Render_stats.h"
+#include "Replay_log.h"
+#include "Seek_index.h"
+#include "Sequence_cache.h"
+#include "Sequencer.h"
+#include "Sf2_bank.h"
+#include "Smf_probe.h"
+#include "Smf_stream.h"
+#include "Synth_event_sink.h"
+#include "Tempo_map.h"
+#include "Track_merger.h"
 
 // At this point, the anti-pattern is that this class has become a monolithic class
 // TODO: should convert all possible in-out args to returning tuples
@@ -25,14 +48,40 @@ class Core_midi_gen {
 private:
     // added to remove magic number in _play_loop
     static const std::chrono::seconds _loop_sleep_dur;
+    // longest the control thread sleeps past a wake it missed, see Playback_status
+    static const std::chrono::milliseconds _max_wake_latency;
     // CoreAudio and CoreMIDI are C-based APIs so they have manual functions for clean-up
     // for safety, can wrap pointer-based structures in unique_ptr with custom deleter
     Arg_parser &_arg_parser;
+    // published by the render thread and the overload listener while playing
+    Playback_status _status;
     Au_graph_manager _graph_manager;
+    Midi_sequence _midi_sequence;
+    // kept from load time so the tempo map can be built without scanning the tempo track
+    std::vector<Tempo_change> _tempo_changes;
+    Tempo_map _tempo_map;
+    // only merged when something walks it (offline render, -k, -s)
+    Merged_timeline _timeline;
+    Seek_index _seek_index;
+    // simultaneous notes per block on the render clock, what the synth's voices are sized against
+    Polyphony_profile _polyphony;
     MusicSequence _sequence = nullptr;
     AudioUnit _synth = nullptr;
-    MusicPlayer _player = nullptr;
+    // only set up for -e
+    MIDIClientRef _midi_client = 0;
+    MIDIPortRef _midi_port = 0;
+    MIDIEndpointRef _midi_destination = 0;
     std::set<int> &_track_set;
+    Synth_event_sink _synth_sink;
+    // -g, sits in front of _synth_sink while open
+    Replay_log_writer _replay_log;
+    // -y
+    std::unique_ptr<Replay_log_reader> _replay_reader;
+    // -a, the built-in synth and its instruments, rendered by the output unit in place of _synth
+    std::unique_ptr<Sample_bank> _sample_bank;
+    // -d with -a and a bank file
+    std::unique_ptr<Disk_streamer> _streamer;
+    std::unique_ptr<Native_synth_output> _native_output;
 
 public:
     Core_midi_gen(Arg_parser &arg_parser);
@@ -42,37 +91,114 @@ public:
     void run();
 
 private:
+    void _probe_files();
+
+    // the built-in synth with -a, otherwise the music device
+    Event_sink &_synth_events();
+
+    // where an offline render sends its events, through the replay log when recording one
+    Event_sink &_offline_sink();
+
+    void _open_replay_log();
+
+    void _close_replay_log();
+
     void _load_midi_file_to_sequence();
 
+    void _write_sequence_cache(const Sequence_cache &cache, const std::vector<bool> &enabled);
+
+    // the loaded sequence and its tracks, in place of CAShow on the MusicSequence
+    void _print_sequence();
+
+    // -q
+    void _print_notes();
+
+    // needs the tempo map at the render rate
+    void _profile_polyphony();
+
     CAStreamBasicDescription _gen_basic_description(AudioFileTypeID &dest_file_type);
 
     ExtAudioFileRef _prepare_outfile_for_writing();
 
     AudioUnit _prepare_output_au_for_writing();
 
-    void _write_buffer_to_outfile(
+    Render_stats _write_buffer_to_outfile(
             MusicTimeStamp sequence_length,
             const CAStreamBasicDescription &client_format,
             const ExtAudioFileRef outfile,
             AudioUnit output_unit
     );
 
+    Render_stats _write_stream_to_outfile(
+            const CAStreamBasicDescription &client_format,
+            const ExtAudioFileRef outfile,
+            AudioUnit output_unit
+    );
+
+    Render_stats _write_replay_to_outfile(
+            const CAStreamBasicDescription &client_format,
+            const ExtAudioFileRef outfile,
+            AudioUnit output_unit
+    );
+
+    std::vector<bool> _stream_enabled_tracks(const Smf_stream_reader &reader);
+
+    void _send_stream_event(const Stream_event &event, UInt32 offset);
+
+    // the synth state the file has built up by the beat, sent to the sink ahead of the next block
+    void _chase_to(Float32 beats, Event_sink &sink);
+
+    // -l, the loop body and tails are rendered once and the repeats mixed from them
+    Render_stats _write_loop_to_outfile(
+            const CAStreamBasicDescription &client_format,
+            const ExtAudioFileRef outfile,
+            AudioUnit output_unit
+    );
+
+    // also the -x render, which has no outfile and only reports the stats
     void _write_output_file(MusicTimeStamp sequence_length);
 
-    static void _print_overloads();
+    void _print_overloads();
 
     void _print_load(const MusicTimeStamp &time);
 
-    void _print_info_while_playing(MusicTimeStamp sequence_length);
+    void _print_load(const MusicTimeStamp &time, Float32 load);
+
+    void _print_voice_limiter(const Voice_limiter &limiter);
+
+    void _play_live(MusicTimeStamp sequence_length);
+
+    void _play_to_endpoint(MusicTimeStamp sequence_length);
 
     void _init_sequence();
 
+    // the native synth, an endpoint or an alternate output, after the graph is up
+    void _init_outputs();
+
+    // -a, the -b bank mapped in place or the generated GM set without one
+    std::unique_ptr<Sample_bank> _load_sample_bank();
+
+    // the sequence's peak polyphony within the -v budget, once it is profiled
+    UInt32 _native_voices() const;
+
+    // a thread of its own live, reads in line offline
+    std::unique_ptr<Disk_streamer> _open_streamer();
+
+    // every preset the timeline selects, so the render thread never decodes
+    void _preload_presets();
+
+    void _print_streaming();
+
     void _init_single_track(UInt32 track_num, MusicTimeStamp &sequence_length, bool should_print_tracks);
 
     void _init_tracks(MusicTimeStamp &sequence_length);
 
     void _play_sequence();
 
+    void _play_stream();
+
+    void _play_replay();
+
     void _setup_midi_endpoint();
 
     void _setup_alternate_output();
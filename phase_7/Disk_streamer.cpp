@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Disk_streamer.h"
+
+// initialize static variables
+const std::uint32_t Disk_streamer::attack_frames;
+const std::uint32_t Disk_streamer::ring_frames;
+const std::uint32_t Disk_streamer::refill_ms;
+const std::uint32_t Disk_streamer::Stream::idle;
+
+namespace {
+    std::uint64_t tagged(std::uint32_t generation, std::uint32_t value)
+    {
+        return static_cast<std::uint64_t>(generation) << 32 | value;
+    }
+
+    std::uint32_t generation_of(std::uint64_t tagged_value)
+    {
+        return static_cast<std::uint32_t>(tagged_value >> 32);
+    }
+
+    std::uint32_t value_of(std::uint64_t tagged_value)
+    {
+        return static_cast<std::uint32_t>(tagged_value);
+    }
+}
+
+Disk_streamer::Disk_streamer(const std::string &path, std::uint32_t voices, Mode mode)
+        : _mode{mode},
+          _path{path}
+{
+    static_assert((ring_frames & (ring_frames - 1)) == 0, "Disk_streamer ring must be a power of two");
+
+    _fd = open(path.c_str(), O_RDONLY);
+    if (_fd < 0) {
+        throw std::system_error{errno, std::generic_category(), "open: " + path};
+    }
+    for (auto v = std::uint32_t{0}; v < voices; ++v) {
+        _streams.emplace_back();
+    }
+
+    if (_mode == Mode::background) {
+        _thread = std::thread{&Disk_streamer::_run, this};
+    }
+}
+
+Disk_streamer::~Disk_streamer()
+{
+    if (_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _stopping.store(true, std::memory_order_release);
+        }
+        _condition.notify_one();
+        _thread.join();
+    }
+    close(_fd);
+}
+
+void Disk_streamer::preload(const Bank_preset &preset)
+{
+    for (const auto &region : preset.regions) {
+        if (region.file_offset < 0 || !region.length || _source_index.count(&region)) { continue; }
+
+        auto source = Source{};
+        source.id = static_cast<std::uint32_t>(_sources.size());
+        source.file_offset = region.file_offset;
+        source.length = region.length;
+        source.loops = region.loops && region.loop_start < region.loop_end && region.loop_end <= region.length;
+        if (source.loops) {
+            source.loop_start = region.loop_start;
+            source.loop_end = region.loop_end;
+        }
+
+        // a loop that ends within the attack never plays what comes after it, so the sample stays in memory whole
+        auto resident_frames = source.loops ? source.loop_end : source.length;
+        source.is_streamed = resident_frames > attack_frames;
+        source.attack.resize(std::min(resident_frames, attack_frames));
+        if (!_read(source.attack.data(), source.attack.size() * sizeof(std::int16_t), source.file_offset)) {
+            throw std::system_error{errno, std::generic_category(), "pread: " + _path};
+        }
+        _attack_bytes += source.attack.size() * sizeof(std::int16_t);
+
+        _source_index.emplace(&region, source.id);
+        _sources.push_back(std::move(source));
+    }
+}
+
+Disk_streamer::Stream &Disk_streamer::start(std::uint32_t voice, const Source &source)
+{
+    auto &stream = _streams[voice];
+    stream._source = &source;
+    ++stream._generation;
+    stream._filled.store(tagged(stream._generation, 0), std::memory_order_relaxed);
+    stream._consumed.store(tagged(stream._generation, 0), std::memory_order_relaxed);
+    // published last, the I/O thread reads the other two once it sees it
+    stream._request.store(tagged(stream._generation, source.id), std::memory_order_release);
+    if (_mode == Mode::background) {
+        // without the mutex, a missed wake is covered by the refill interval (see Playback_status)
+        _condition.notify_one();
+    }
+    return stream;
+}
+
+void Disk_streamer::stop(std::uint32_t voice)
+{
+    auto &stream = _streams[voice];
+    stream._source = nullptr;
+    stream._request.store(tagged(stream._generation, Stream::idle), std::memory_order_release);
+}
+
+void Disk_streamer::service()
+{
+    if (_mode != Mode::in_line) { return; }
+    for (auto &stream : _streams) {
+        _refill(stream);
+    }
+}
+
+void Disk_streamer::_run()
+{
+    while (!_stopping.load(std::memory_order_acquire)) {
+        auto has_read = false;
+        for (auto &stream : _streams) {
+            has_read = _refill(stream) || has_read;
+        }
+        // straight round again while there is anything to read, the streams are served in turn
+        if (has_read) { continue; }
+
+        std::unique_lock<std::mutex> lock{_mutex};
+        _condition.wait_for(lock, std::chrono::milliseconds{refill_ms}, [this] {
+            return _stopping.load(std::memory_order_acquire);
+        });
+    }
+}
+
+bool Disk_streamer::_refill(Stream &stream)
+{
+    auto request = stream._request.load(std::memory_order_acquire);
+    auto generation = generation_of(request);
+    if (value_of(request) == Stream::idle) { return false; }
+
+    auto filled = stream._filled.load(std::memory_order_acquire);
+    auto consumed = stream._consumed.load(std::memory_order_acquire);
+    // the voice has started over since the request was read, its next one is picked up on the next pass
+    if (generation_of(filled) != generation || generation_of(consumed) != generation) { return false; }
+
+    const auto &source = _sources[value_of(request)];
+    if (!source.is_streamed) { return false; }
+
+    // a voice that ran past the reads carries on from where it is, the frames it missed are gone
+    auto written = std::max(value_of(filled), value_of(consumed));
+    // everything the voice hasn't played yet stays in the ring
+    auto limit = value_of(consumed) + ring_frames;
+    if (!source.loops) {
+        limit = std::min(limit, source.length);
+    }
+    // a read waits for a quarter of the ring, apart from the first one a note needs and the last of a sample
+    auto is_first = value_of(filled) < source.attack.size();
+    auto is_last = !source.loops && limit == source.length;
+    if (written >= limit || (!is_first && !is_last && limit - written < ring_frames / 4)) { return false; }
+
+    auto has_read = false;
+    while (written < limit) {
+        auto frame = source.sample_frame(written);
+        auto segment_end = source.loops ? source.loop_end : source.length;
+        // the frames that stay contiguous both in the file and in the ring
+        auto count = std::min({limit - written, segment_end - frame, ring_frames - (written & (ring_frames - 1))});
+        if (frame < source.attack.size()) {
+            // played from the attack
+            count = std::min<std::uint32_t>(count, static_cast<std::uint32_t>(source.attack.size()) - frame);
+        } else {
+            auto bytes = count * sizeof(std::int16_t);
+            if (!_read(&stream._ring[written & (ring_frames - 1)], bytes, source.file_offset + frame * std::int64_t{sizeof(std::int16_t)})) {
+                _read_errors.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            _reads.fetch_add(1, std::memory_order_relaxed);
+            _bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+            has_read = true;
+        }
+        written += count;
+    }
+
+    // fails when the voice started over during the reads, what they wrote is never read as the new note's
+    stream._filled.compare_exchange_strong(filled, tagged(generation, written), std::memory_order_release, std::memory_order_relaxed);
+    return has_read;
+}
+
+bool Disk_streamer::_read(void *buffer, std::size_t bytes, std::int64_t offset)
+{
+    auto p = static_cast<std::uint8_t *>(buffer);
+    while (bytes > 0) {
+        auto result = pread(_fd, p, bytes, static_cast<off_t>(offset));
+        if (result < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        if (result == 0) {
+            // a truncated file plays silence
+            std::memset(p, 0, bytes);
+            return true;
+        }
+        p += result;
+        bytes -= static_cast<std::size_t>(result);
+        offset += result;
+    }
+    return true;
+}
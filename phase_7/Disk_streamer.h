@@ -0,0 +1,178 @@
+#ifndef CORE_MIDI_GEN2_DISK_STREAMER_H
+#define CORE_MIDI_GEN2_DISK_STREAMER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Sample_bank.h"
+
+// -d with -a, plays a bank's samples from disk so only their attacks are held in memory
+// the attack of every region a preset plays is read at preload, a note starts on it at once and the rest of the sample
+// follows through a ring per voice, which an I/O thread keeps filled ahead of the playhead with large sequential preads
+// (a read is only issued once a quarter of the ring is free), so memory is the attacks plus one ring per voice whatever the bank's size
+// the ring holds the sample in the order it plays, with its loop unrolled, and a voice that catches up with the reads
+// plays silence for the missing frames and counts an underrun rather than wait, the render thread never blocks on the disk
+// in line mode (offline rendering) there is no thread and the streams are refilled before each block, which can block, but never underruns
+class Disk_streamer {
+public:
+    // frames of each sample held in memory, a note has this long before it needs the ring
+    static const std::uint32_t attack_frames = 16384;
+    // frames per voice, a power of two
+    static const std::uint32_t ring_frames = 65536;
+    // the I/O thread looks for free ring space this often when nothing wakes it
+    static const std::uint32_t refill_ms = 5;
+
+    enum class Mode {
+        background,
+        in_line
+    };
+
+    // a region as the streams read it, only built at preload and never changed after
+    struct Source {
+        std::uint32_t id = 0;
+        std::int64_t file_offset = 0;
+        std::uint32_t length = 0;
+        bool loops = false;
+        std::uint32_t loop_start = 0;
+        std::uint32_t loop_end = 0;
+        // the first attack_frames, or the whole of a sample that fits (its loop included)
+        std::vector<std::int16_t> attack;
+        bool is_streamed = false;
+
+        // the sample frame of a frame in play order, past the loop's end it goes round the loop
+        std::uint32_t sample_frame(std::uint32_t frame) const
+        {
+            if (!loops || frame < loop_end) { return frame; }
+            return loop_start + (frame - loop_end) % (loop_end - loop_start);
+        }
+    };
+
+    // what one voice plays from the disk, started and read by the render thread and filled by the I/O thread
+    // positions are frames in play order, tagged with the generation of the start they belong to,
+    // so a fill for a note the voice has since moved on from is never taken for the new one
+    class Stream {
+    private:
+        friend class Disk_streamer;
+
+        static const std::uint32_t idle = 0xFFFFFFFF;
+
+        std::vector<std::int16_t> _ring;
+        // generation << 32 | source id, or idle
+        std::atomic<std::uint64_t> _request{idle};
+        // generation << 32 | the frame the I/O thread has filled up to
+        std::atomic<std::uint64_t> _filled{0};
+        // generation << 32 | the frame the voice has played up to, anything before it may be overwritten
+        std::atomic<std::uint64_t> _consumed{0};
+        // render thread only
+        std::uint32_t _generation = 0;
+        const Source *_source = nullptr;
+
+    public:
+        Stream() : _ring(ring_frames) {}
+
+        // render thread, what is readable this block
+        std::uint32_t available() const
+        {
+            auto filled = _filled.load(std::memory_order_acquire);
+            return (filled >> 32 == _generation) ? static_cast<std::uint32_t>(filled) : 0;
+        }
+
+        // render thread, the frame in play order, 0 and underrun set when it hasn't been read yet
+        float frame(std::uint32_t frame, std::uint32_t available, bool &underrun) const
+        {
+            auto sample_frame = _source->sample_frame(frame);
+            if (sample_frame >= _source->length) { return 0.f; }
+            if (sample_frame < _source->attack.size()) { return _source->attack[sample_frame]; }
+            if (frame < available) { return _ring[frame & (ring_frames - 1)]; }
+            underrun = true;
+            return 0.f;
+        }
+
+        // render thread, once per block
+        void consume(std::uint32_t frame)
+        {
+            _consumed.store(static_cast<std::uint64_t>(_generation) << 32 | frame, std::memory_order_release);
+        }
+    };
+
+private:
+    Mode _mode;
+    int _fd = -1;
+    std::string _path;
+    std::deque<Source> _sources;
+    std::unordered_map<const Sample_region *, std::uint32_t> _source_index;
+    std::deque<Stream> _streams;
+    std::size_t _attack_bytes = 0;
+    std::atomic<std::uint64_t> _reads{0};
+    std::atomic<std::uint64_t> _bytes_read{0};
+    // on the I/O thread, the voice plays on and underruns
+    std::atomic<std::uint64_t> _read_errors{0};
+    std::atomic<bool> _stopping{false};
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::thread _thread;
+
+public:
+    // a stream for each voice, the thread is started at once in the background mode
+    // throws std::system_error
+    Disk_streamer(const std::string &path, std::uint32_t voices, Mode mode);
+
+    ~Disk_streamer();
+
+    Disk_streamer(const Disk_streamer &) = delete;
+
+    Disk_streamer &operator=(const Disk_streamer &) = delete;
+
+    // control thread, before rendering, reads the attack of every region of the preset that has its samples in the file
+    // throws std::system_error
+    void preload(const Bank_preset &preset);
+
+    // render thread, nullptr for a region that wasn't preloaded
+    const Source *find(const Sample_region &region) const
+    {
+        auto found = _source_index.find(&region);
+        return (found != _source_index.end()) ? &_sources[found->second] : nullptr;
+    }
+
+    std::uint32_t stream_count() const { return static_cast<std::uint32_t>(_streams.size()); }
+
+    // render thread, the voice's stream starts over on a streamed source
+    Stream &start(std::uint32_t voice, const Source &source);
+
+    // render thread, the voice no longer needs its stream
+    void stop(std::uint32_t voice);
+
+    // render thread, before each block, refills every stream in line mode and does nothing in the background
+    void service();
+
+    std::size_t source_count() const { return _sources.size(); }
+
+    std::size_t attack_bytes() const { return _attack_bytes; }
+
+    std::size_t ring_bytes() const { return _streams.size() * ring_frames * sizeof(std::int16_t); }
+
+    std::uint64_t reads() const { return _reads.load(std::memory_order_relaxed); }
+
+    std::uint64_t bytes_read() const { return _bytes_read.load(std::memory_order_relaxed); }
+
+    std::uint64_t read_errors() const { return _read_errors.load(std::memory_order_relaxed); }
+
+private:
+    void _run();
+
+    // true when it read anything
+    bool _refill(Stream &stream);
+
+    // the whole of a read, zeros past the end of the file, false with errno set when it fails
+    bool _read(void *buffer, std::size_t bytes, std::int64_t offset);
+};
+
+#endif //CORE_MIDI_GEN2_DISK_STREAMER_H
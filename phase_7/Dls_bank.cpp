@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include "Dls_bank.h"
+
+namespace {
+    const std::uint32_t drum_instrument = 0x80000000;
+    const std::uint16_t format_pcm = 1;
+    const std::uint16_t format_float = 3;
+
+    // connection blocks of art1 and art2, only the unmodulated ones are read
+    const std::uint16_t source_none = 0x0000;
+    const std::uint16_t destination_gain = 0x0001;
+    const std::uint16_t destination_pitch = 0x0003;
+    const std::uint16_t destination_pan = 0x0004;
+    const std::uint16_t destination_attack = 0x0206;
+    const std::uint16_t destination_decay = 0x0207;
+    const std::uint16_t destination_release = 0x0209;
+    const std::uint16_t destination_sustain = 0x020A;
+    const std::uint16_t destination_delay = 0x020B;
+    const std::uint16_t destination_hold = 0x020C;
+    const std::int32_t no_time = std::numeric_limits<std::int32_t>::min();
+
+    // scales are 16.16 fixed point, gain counts 1/10 dB in its integer part
+    float fixed(std::int32_t scale)
+    {
+        return scale / 65536.f;
+    }
+
+    float seconds(std::int32_t timecents)
+    {
+        if (timecents == no_time) { return 0.f; }
+        return std::exp2(std::min(fixed(timecents), 8000.f) / 1200.f);
+    }
+
+    // an envelope, pan, pitch and gain given by the art1 or art2 chunks of a lart or lar2 list
+    void read_articulation(const riff::Chunk &list, Sample_region &region)
+    {
+        for (const auto &art : riff::children(list)) {
+            if ((!art.is("art1") && !art.is("art2")) || art.size < 8) { continue; }
+            auto header_size = riff::read_u32(art.data);
+            auto count = riff::read_u32(art.data + 4);
+            if (header_size > art.size || count > (art.size - header_size) / 12) {
+                throw bad_sound_bank{"bad articulation chunk"};
+            }
+
+            for (auto block = art.data + header_size, end = block + count * 12; block < end; block += 12) {
+                auto source = riff::read_u16(block);
+                auto control = riff::read_u16(block + 2);
+                if (source != source_none || control != source_none) { continue; }
+                auto scale = static_cast<std::int32_t>(riff::read_u32(block + 8));
+
+                switch (riff::read_u16(block + 4)) {
+                    case destination_gain:
+                        region.attenuation_db = std::max(-fixed(scale) / 10.f, 0.f);
+                        break;
+                    case destination_pitch:
+                        region.tune_cents = fixed(scale);
+                        break;
+                    case destination_pan:
+                        region.pan = std::min(std::max(fixed(scale) / 500.f, -1.f), 1.f);
+                        break;
+                    case destination_delay:
+                        region.envelope.delay = seconds(scale);
+                        break;
+                    case destination_attack:
+                        region.envelope.attack = seconds(scale);
+                        break;
+                    case destination_hold:
+                        region.envelope.hold = seconds(scale);
+                        break;
+                    case destination_decay:
+                        region.envelope.decay = seconds(scale);
+                        break;
+                    case destination_sustain:
+                        // in tenths of a percent
+                        region.envelope.sustain = std::min(std::max(fixed(scale) / 1000.f, 0.f), 1.f);
+                        break;
+                    case destination_release:
+                        region.envelope.release = seconds(scale);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    // the root key, fine tune, attenuation and loop of a wsmp chunk, tune and attenuation add onto the articulation's
+    void read_sample_info(const riff::Chunk &wsmp, Sample_region &region)
+    {
+        if (wsmp.size < 20) {
+            throw bad_sound_bank{"bad wsmp chunk"};
+        }
+        auto header_size = riff::read_u32(wsmp.data);
+        region.root_key = static_cast<std::uint8_t>(std::min<std::uint16_t>(riff::read_u16(wsmp.data + 4), 127));
+        region.tune_cents += static_cast<std::int16_t>(riff::read_u16(wsmp.data + 6));
+        // relative gain, 1/655360 dB, negative to attenuate
+        region.attenuation_db += std::max(-static_cast<std::int32_t>(riff::read_u32(wsmp.data + 8)) / 655360.f, 0.f);
+
+        auto loop_count = riff::read_u32(wsmp.data + 16);
+        region.loops = loop_count > 0 && header_size <= wsmp.size && wsmp.size - header_size >= 16;
+        if (region.loops) {
+            auto loop = wsmp.data + header_size;
+            region.loop_start = riff::read_u32(loop + 8);
+            region.loop_end = region.loop_start + riff::read_u32(loop + 12);
+        }
+    }
+}
+
+Dls_bank::Dls_bank(std::shared_ptr<const Mapped_file> file)
+        : _file{std::move(file)}
+{
+    try {
+        if (!riff::is_form(_file->data(), _file->size(), "DLS ")) {
+            throw bad_sound_bank{"not a DLS bank"};
+        }
+        auto top = riff::chunks(_file->begin(), _file->end());
+        if (top.empty() || !top[0].is_list("DLS ")) {
+            throw bad_sound_bank{"bad RIFF header"};
+        }
+        auto dls = riff::children(top[0]);
+        auto lins = riff::find_list(dls, "lins");
+        auto wvpl = riff::find_list(dls, "wvpl");
+        if (!lins || !wvpl) {
+            throw bad_sound_bank{"missing lins or wvpl list"};
+        }
+
+        // the pool first, as regions name their waves by its table
+        auto pool_table = _read_wave_pool(*wvpl, riff::find(dls, "ptbl"));
+        for (const auto &ins : riff::children(*lins)) {
+            if (ins.is_list("ins ")) {
+                _read_instrument(ins, pool_table);
+            }
+        }
+    } catch (const bad_sound_bank &e) {
+        throw bad_sound_bank{std::string{e.what()} + ": " + _file->path()};
+    }
+}
+
+const Bank_preset *Dls_bank::preset(std::uint16_t bank, std::uint8_t program) const
+{
+    auto found = _instruments.find(static_cast<std::uint32_t>(bank << 8 | program));
+    if (found == _instruments.end()) { return nullptr; }
+
+    auto &instrument = found->second;
+    if (!instrument.is_decoded) {
+        for (auto i = std::size_t{0}; i < instrument.waves.size(); ++i) {
+            auto &wave = _waves[instrument.waves[i]];
+            _decode(wave);
+
+            // a region without samples is skipped by the synth
+            auto &region = instrument.preset.regions[i];
+            region.samples = wave.samples;
+            region.length = wave.frames;
+            region.sample_rate = wave.sample_rate;
+            if (wave.decoded.empty()) {
+                region.file_offset = wave.data - _file->data();
+            }
+            region.loops = region.loops && region.loop_start < region.loop_end && region.loop_end <= wave.frames;
+        }
+        instrument.is_decoded = true;
+    }
+    return &instrument.preset;
+}
+
+std::vector<std::uint32_t> Dls_bank::_read_wave_pool(const riff::Chunk &wvpl, const riff::Chunk *ptbl)
+{
+    // cues are offsets from the start of the pool's chunks, the wave starting at each is looked up below
+    auto pool_begin = wvpl.data + 4;
+    auto wave_at = std::unordered_map<std::uint32_t, std::uint32_t>{};
+
+    for (const auto &list : riff::children(wvpl)) {
+        if (!list.is_list("wave")) { continue; }
+        auto chunks = riff::children(list);
+        auto fmt = riff::find(chunks, "fmt ");
+        auto data = riff::find(chunks, "data");
+        if (!fmt || !data || fmt->size < 16) {
+            throw bad_sound_bank{"wave without fmt or data"};
+        }
+
+        auto wave = Wave{};
+        wave.data = data->data;
+        wave.format = riff::read_u16(fmt->data);
+        wave.channels = std::max<std::uint16_t>(riff::read_u16(fmt->data + 2), 1);
+        wave.sample_rate = riff::read_u32(fmt->data + 4);
+        wave.bits = riff::read_u16(fmt->data + 14);
+        auto is_supported = (wave.format == format_pcm && (wave.bits == 8 || wave.bits == 16 || wave.bits == 24 || wave.bits == 32)) ||
+                            (wave.format == format_float && wave.bits == 32);
+        // anything else stays silent rather than failing the whole bank
+        if (is_supported) {
+            wave.frames = data->size / (wave.channels * (wave.bits / 8u));
+        }
+        if (auto wsmp = riff::find(chunks, "wsmp")) {
+            read_sample_info(*wsmp, wave.sample_info);
+            wave.has_sample_info = true;
+        }
+
+        wave_at.emplace(static_cast<std::uint32_t>(list.id - pool_begin), static_cast<std::uint32_t>(_waves.size()));
+        _waves.push_back(std::move(wave));
+    }
+
+    // without a table, or with offsets that don't land on a wave, cue n is the nth wave
+    auto table = std::vector<std::uint32_t>{};
+    if (ptbl && ptbl->size >= 8) {
+        auto header_size = riff::read_u32(ptbl->data);
+        auto cues = riff::read_u32(ptbl->data + 4);
+        if (header_size > ptbl->size || cues > (ptbl->size - header_size) / 4) {
+            throw bad_sound_bank{"bad ptbl chunk"};
+        }
+        for (auto c = std::uint32_t{0}; c < cues; ++c) {
+            auto found = wave_at.find(riff::read_u32(ptbl->data + header_size + c * 4));
+            table.push_back((found != wave_at.end()) ? found->second : c);
+        }
+    } else {
+        for (auto w = std::uint32_t{0}; w < _waves.size(); ++w) {
+            table.push_back(w);
+        }
+    }
+    return table;
+}
+
+void Dls_bank::_read_instrument(const riff::Chunk &ins, const std::vector<std::uint32_t> &pool_table)
+{
+    auto chunks = riff::children(ins);
+    auto insh = riff::find(chunks, "insh");
+    auto lrgn = riff::find_list(chunks, "lrgn");
+    if (!insh || insh->size < 12 || !lrgn) {
+        throw bad_sound_bank{"instrument without insh or lrgn"};
+    }
+    auto locale_bank = riff::read_u32(insh->data + 4);
+    auto program = riff::read_u32(insh->data + 8) & 0x7F;
+    // the bank select MSB is bits 8 - 14, the LSB (bits 0 - 6) isn't followed by the synth
+    auto bank = (locale_bank & drum_instrument) ? std::uint32_t{percussion_bank} : (locale_bank >> 8) & 0x7F;
+
+    // the first of two instruments with the same number wins
+    auto inserted = _instruments.emplace(bank << 8 | program, Instrument{});
+    if (!inserted.second) { return; }
+    auto &instrument = inserted.first->second;
+
+    // the instrument's articulation applies to every region that has none of its own
+    auto base = Sample_region{};
+    for (auto type : {"lart", "lar2"}) {
+        if (auto lart = riff::find_list(chunks, type)) {
+            read_articulation(*lart, base);
+        }
+    }
+
+    for (const auto &rgn : riff::children(*lrgn)) {
+        if (!rgn.is_list("rgn ") && !rgn.is_list("rgn2")) { continue; }
+        auto region_chunks = riff::children(rgn);
+        auto rgnh = riff::find(region_chunks, "rgnh");
+        auto wlnk = riff::find(region_chunks, "wlnk");
+        if (!rgnh || rgnh->size < 12 || !wlnk || wlnk->size < 12) {
+            throw bad_sound_bank{"region without rgnh or wlnk"};
+        }
+        auto table_index = riff::read_u32(wlnk->data + 8);
+        if (table_index >= pool_table.size()) { continue; }
+        auto wave = pool_table[table_index];
+
+        auto region = base;
+        auto has_articulation = false;
+        for (auto type : {"lart", "lar2"}) {
+            if (auto lart = riff::find_list(region_chunks, type)) {
+                if (!has_articulation) {
+                    region = Sample_region{};
+                    has_articulation = true;
+                }
+                read_articulation(*lart, region);
+            }
+        }
+
+        region.key_low = static_cast<std::uint8_t>(std::min<std::uint16_t>(riff::read_u16(rgnh->data), 127));
+        region.key_high = static_cast<std::uint8_t>(std::min<std::uint16_t>(riff::read_u16(rgnh->data + 2), 127));
+        region.velocity_low = static_cast<std::uint8_t>(std::min<std::uint16_t>(riff::read_u16(rgnh->data + 4), 127));
+        region.velocity_high = static_cast<std::uint8_t>(std::min<std::uint16_t>(riff::read_u16(rgnh->data + 6), 127));
+        // level 1 banks leave the velocity range as zeros, it isn't part of DLS 1
+        if (region.velocity_high == 0) {
+            region.velocity_low = 0;
+            region.velocity_high = 127;
+        }
+        region.exclusive_class = riff::read_u16(rgnh->data + 10);
+
+        if (auto wsmp = riff::find(region_chunks, "wsmp")) {
+            read_sample_info(*wsmp, region);
+        } else if (_waves[wave].has_sample_info) {
+            const auto &info = _waves[wave].sample_info;
+            region.root_key = info.root_key;
+            region.tune_cents += info.tune_cents;
+            region.attenuation_db += info.attenuation_db;
+            region.loops = info.loops;
+            region.loop_start = info.loop_start;
+            region.loop_end = info.loop_end;
+        }
+
+        instrument.preset.regions.push_back(region);
+        instrument.waves.push_back(wave);
+    }
+    _region_count += instrument.preset.regions.size();
+}
+
+void Dls_bank::_decode(Wave &wave) const
+{
+    if (wave.samples || !wave.frames) { return; }
+
+    // mono 16 bit PCM is already what the synth plays
+    auto is_aligned = reinterpret_cast<std::uintptr_t>(wave.data) % alignof(std::int16_t) == 0;
+    if (wave.format == format_pcm && wave.bits == 16 && wave.channels == 1 && is_aligned) {
+        wave.samples = reinterpret_cast<const std::int16_t *>(wave.data);
+        ++_decoded_waves;
+        return;
+    }
+
+    // anything else is converted, keeping the first channel
+    auto bytes = wave.bits / 8u;
+    auto stride = wave.channels * bytes;
+    wave.decoded.resize(wave.frames);
+    for (auto frame = std::uint32_t{0}; frame < wave.frames; ++frame) {
+        auto p = wave.data + frame * stride;
+        auto value = std::int16_t{0};
+        if (wave.format == format_float) {
+            auto sample = 0.f;
+            auto bits = riff::read_u32(p);
+            std::memcpy(&sample, &bits, sizeof(sample));
+            value = static_cast<std::int16_t>(std::lround(std::min(std::max(sample, -1.f), 1.f) * 32767.f));
+        } else if (bytes == 1) {
+            // 8 bit PCM is unsigned
+            value = static_cast<std::int16_t>((p[0] - 128) * 256);
+        } else {
+            // the top two bytes of a wider sample
+            value = static_cast<std::int16_t>(riff::read_u16(p + bytes - 2));
+        }
+        wave.decoded[frame] = value;
+    }
+    wave.samples = wave.decoded.data();
+    ++_decoded_waves;
+}
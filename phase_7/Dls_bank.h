@@ -0,0 +1,84 @@
+#ifndef CORE_MIDI_GEN2_DLS_BANK_H
+#define CORE_MIDI_GEN2_DLS_BANK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Mapped_file.h"
+#include "Riff.h"
+#include "Sample_bank.h"
+
+// a DLS level 1 or 2 bank read from a mapping of the file
+// the instrument list (lins) is walked once at load into a table of flat Sample_regions per bank and program,
+// with the wave sample (wsmp) and articulation (art1/art2) of each region folded in, so a program change is
+// a hash lookup and a note only matches the regions of its preset, nothing walks the RIFF after load
+// the wave pool (wvpl) is only indexed at load, a wave is decoded to 16 bit mono the first time a preset that plays it
+// is looked up and kept in a cache the instruments share, 16 bit PCM is used in place from the mapping when it can be
+// looking a preset up can decode, so do it for every preset a sequence selects before the render thread starts,
+// after that the bank isn't touched from any other thread
+class Dls_bank : public Sample_bank {
+private:
+    struct Wave {
+        const std::uint8_t *data = nullptr;
+        std::uint32_t frames = 0;
+        std::uint16_t format = 0;
+        std::uint16_t channels = 1;
+        std::uint16_t bits = 16;
+        std::uint32_t sample_rate = 44100;
+        // the wave's own wsmp, a region's takes its place
+        bool has_sample_info = false;
+        Sample_region sample_info;
+        // once decoded, into the mapping or into decoded
+        const std::int16_t *samples = nullptr;
+        std::vector<std::int16_t> decoded;
+    };
+
+    struct Instrument {
+        Bank_preset preset;
+        // the wave each region plays, its samples are filled in when the instrument is first looked up
+        std::vector<std::uint32_t> waves;
+        bool is_decoded = false;
+    };
+
+    std::shared_ptr<const Mapped_file> _file;
+    mutable std::vector<Wave> _waves;
+    // keyed by bank << 8 | program, with the percussion instruments in bank 128
+    mutable std::unordered_map<std::uint32_t, Instrument> _instruments;
+    std::size_t _region_count = 0;
+    mutable std::size_t _decoded_waves = 0;
+
+public:
+    // throws bad_sound_bank
+    explicit Dls_bank(std::shared_ptr<const Mapped_file> file);
+
+    ~Dls_bank() override = default;
+
+    Dls_bank(const Dls_bank &) = delete;
+
+    Dls_bank &operator=(const Dls_bank &) = delete;
+
+    // decodes the preset's waves the first time it is asked for
+    const Bank_preset *preset(std::uint16_t bank, std::uint8_t program) const override;
+
+    std::size_t preset_count() const { return _instruments.size(); }
+
+    std::size_t region_count() const { return _region_count; }
+
+    std::size_t wave_count() const { return _waves.size(); }
+
+    std::size_t decoded_waves() const { return _decoded_waves; }
+
+private:
+    // returns the wave of each pool table cue
+    std::vector<std::uint32_t> _read_wave_pool(const riff::Chunk &wvpl, const riff::Chunk *ptbl);
+
+    void _read_instrument(const riff::Chunk &ins, const std::vector<std::uint32_t> &pool_table);
+
+    // decodes once, shared by every region that plays the wave
+    void _decode(Wave &wave) const;
+};
+
+#endif //CORE_MIDI_GEN2_DLS_BANK_H
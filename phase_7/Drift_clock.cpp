@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cmath>
+#include <time.h>
+
+#include "Drift_clock.h"
+
+// initialize static variables
+const double Drift_clock::default_bandwidth_hz = 0.2;
+
+namespace {
+    const double pi = 3.14159265358979323846;
+    // the loop gets unstable once an update covers a large part of its period
+    const double max_omega = 0.5;
+}
+
+std::int64_t Drift_clock::Estimate::sample_at(std::int64_t at_ns) const
+{
+    if (!is_valid()) { return sample; }
+    return sample + static_cast<std::int64_t>(std::floor((at_ns - ns) / ns_per_sample));
+}
+
+std::int64_t Drift_clock::Estimate::ns_for_sample(std::int64_t at_sample) const
+{
+    return static_cast<std::int64_t>(std::llround(ns + (at_sample - sample) * ns_per_sample));
+}
+
+Drift_clock::Drift_clock(double nominal_srate, double bandwidth_hz)
+        : _nominal_srate{nominal_srate},
+          _bandwidth_hz{bandwidth_hz} {}
+
+std::int64_t Drift_clock::now_ns()
+{
+    auto time = timespec{};
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &time);
+#endif
+    return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+void Drift_clock::observe(std::int64_t sample, std::int64_t ns)
+{
+    // the loop starts at the nominal rate, only the phase is known from one observation
+    if (!_has_origin) {
+        _estimate = Estimate{sample, static_cast<double>(ns), 1000000000. / _nominal_srate};
+        _origin = _estimate;
+        _has_origin = true;
+        return;
+    }
+
+    auto samples = sample - _estimate.sample;
+    if (samples <= 0) { return; }
+
+    auto predicted = _estimate.ns + samples * _estimate.ns_per_sample;
+    auto error = ns - predicted;
+
+    // the bandwidth is fixed in Hz, so the gains follow how much time the update covers
+    auto omega = std::min(2. * pi * _bandwidth_hz * (samples * _estimate.ns_per_sample / 1000000000.), max_omega);
+    _estimate.sample = sample;
+    _estimate.ns = predicted + std::sqrt(2.) * omega * error;
+    _estimate.ns_per_sample += omega * omega * error / samples;
+}
+
+double Drift_clock::average_srate() const
+{
+    auto ns = _estimate.ns - _origin.ns;
+    if (ns <= 0.) { return _nominal_srate; }
+    return (_estimate.sample - _origin.sample) * 1000000000. / ns;
+}
+
+double Drift_clock::drift_ppm() const
+{
+    if (_nominal_srate <= 0.) { return 0.; }
+    return (average_srate() / _nominal_srate - 1.) * 1000000.;
+}
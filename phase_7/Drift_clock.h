@@ -0,0 +1,63 @@
+#ifndef CORE_MIDI_GEN2_DRIFT_CLOCK_H
+#define CORE_MIDI_GEN2_DRIFT_CLOCK_H
+
+#include <cstdint>
+
+// follows an audio device's sample clock against the monotonic raw clock with a second order delay-locked loop
+// the device consumes samples at its own crystal's rate, a few ppm off its nominal one, which a fixed
+// samples-per-second mapping turns into a growing offset over a long session
+// the loop filters the jitter of when blocks are rendered out and keeps the measured rate and phase,
+// so wall time and device samples convert both ways without drifting apart or needing a resync
+// single writer, the render side observes once per block and publishes the estimate
+class Drift_clock {
+public:
+    // where the device clock is, a sample and the wall time it plays at plus the measured period
+    struct Estimate {
+        std::int64_t sample = 0;
+        double ns = 0.;
+        // 0 until the first observation, when only sample is known
+        double ns_per_sample = 0.;
+
+        bool is_valid() const { return ns_per_sample > 0.; }
+
+        std::int64_t sample_at(std::int64_t at_ns) const;
+
+        std::int64_t ns_for_sample(std::int64_t at_sample) const;
+
+        double srate() const { return is_valid() ? 1000000000. / ns_per_sample : 0.; }
+    };
+
+    static const double default_bandwidth_hz;
+
+private:
+    double _nominal_srate = 0.;
+    double _bandwidth_hz = default_bandwidth_hz;
+    Estimate _estimate;
+    // the first observation, the rate averaged since then is what drift is reported on
+    Estimate _origin;
+    bool _has_origin = false;
+
+public:
+    Drift_clock() = default;
+
+    // a narrower bandwidth filters more jitter and follows a change in the device rate more slowly
+    explicit Drift_clock(double nominal_srate, double bandwidth_hz = default_bandwidth_hz);
+
+    ~Drift_clock() = default;
+
+    // CLOCK_MONOTONIC_RAW in nanoseconds, which NTP never slews, so it only drifts against the device by the crystals
+    static std::int64_t now_ns();
+
+    // the sample the device was at when the wall clock read ns, samples must not go backwards
+    void observe(std::int64_t sample, std::int64_t ns);
+
+    const Estimate &estimate() const { return _estimate; }
+
+    // the loop's period swings with the jitter, over a session the average rate since the start is far steadier
+    double average_srate() const;
+
+    // average rate against the nominal one, in parts per million
+    double drift_ppm() const;
+};
+
+#endif //CORE_MIDI_GEN2_DRIFT_CLOCK_H
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "Drift_clock.h"
+#include "Endpoint_dispatcher.h"
+#include "Midi_sequence.h"
+#include "util.h"
+
+// initialize static variables
+const std::int64_t Endpoint_dispatcher::resolution_ns = 250000;
+const std::size_t Endpoint_dispatcher::capacity = 1 << 16;
+
+Endpoint_dispatcher::Endpoint_dispatcher(
+        MIDIPortRef port,
+        MIDIEndpointRef destination,
+        Float64 srate,
+        std::int64_t start_sample,
+        std::int64_t origin_ns
+)
+        : _port{port},
+          _destination{destination},
+          _srate{srate},
+          _start_sample{start_sample},
+          _origin_ns{origin_ns},
+          _block_start{start_sample},
+          _wheel{origin_ns, resolution_ns, capacity},
+          _packet_buffer(65536) {}
+
+std::int64_t Endpoint_dispatcher::now_ns()
+{
+    return Drift_clock::now_ns();
+}
+
+void Endpoint_dispatcher::channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset)
+{
+    _schedule(Timed_event{_block_start + offset, nullptr, 0, status, data_1, data_2});
+}
+
+void Endpoint_dispatcher::sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset)
+{
+    // the SMF stores an F0 message without its status byte
+    _sysex_messages.emplace_back();
+    auto &message = _sysex_messages.back();
+    if (status == midi::sysex) {
+        message.push_back(midi::sysex);
+    }
+    message.insert(message.end(), payload, payload + length);
+
+    _schedule(Timed_event{_block_start + offset, message.data(), static_cast<UInt32>(message.size()), status, 0, 0});
+}
+
+void Endpoint_dispatcher::_schedule(const Timed_event &event)
+{
+    auto deadline = _origin_ns + static_cast<std::int64_t>(
+            std::llround((event.sample - _start_sample) * 1000000000. / _srate)
+    );
+    if (!_wheel.insert(deadline, event)) {
+        // only if the caller ignores has_room
+        auto entry = Wheel::Entry{deadline, 0, event};
+        _send(&entry, 1, now_ns());
+    }
+}
+
+std::int64_t Endpoint_dispatcher::dispatch(std::int64_t now)
+{
+    _due.clear();
+    _wheel.advance(now, _due);
+    if (!_due.empty()) {
+        _send(_due.data(), _due.size(), now);
+    }
+    return _wheel.next_expiry();
+}
+
+std::int64_t Endpoint_dispatcher::sample_at(std::int64_t ns) const
+{
+    return _start_sample + static_cast<std::int64_t>((ns - _origin_ns) * _srate / 1000000000.);
+}
+
+void Endpoint_dispatcher::_send(const Wheel::Entry *entries, std::size_t count, std::int64_t now)
+{
+    auto packet_list = reinterpret_cast<MIDIPacketList *>(_packet_buffer.data());
+    auto packet = MIDIPacketListInit(packet_list);
+    for (auto i = std::size_t{0}; i < count; ++i) {
+        const auto &event = entries[i].item;
+        auto bytes = std::array<UInt8, 3>{event.status, event.data_1, event.data_2};
+        auto data = event.sysex ? event.sysex : bytes.data();
+        auto length = event.sysex ? event.sysex_length : static_cast<UInt32>(1 + midi::channel_data_length(event.status));
+
+        // timestamp 0 is now, the wheel already decided when
+        auto next = MIDIPacketListAdd(packet_list, _packet_buffer.size(), packet, 0, length, data);
+        if (!next) {
+            auto result = MIDISend(_port, _destination, packet_list);
+            check_error(result, "MIDISend");
+            packet = MIDIPacketListInit(packet_list);
+            next = MIDIPacketListAdd(packet_list, _packet_buffer.size(), packet, 0, length, data);
+        }
+        // a sysex message bigger than the whole buffer is dropped
+        if (next) { packet = next; }
+
+        _max_error_ns = std::max(_max_error_ns, now - entries[i].deadline);
+    }
+
+    auto result = MIDISend(_port, _destination, packet_list);
+    check_error(result, "MIDISend");
+    _sent += count;
+}
@@ -0,0 +1,89 @@
+#ifndef CORE_MIDI_GEN2_ENDPOINT_DISPATCHER_H
+#define CORE_MIDI_GEN2_ENDPOINT_DISPATCHER_H
+
+#include <CoreMIDI/CoreMIDI.h>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "Live_renderer.h"
+#include "Sequencer.h"
+#include "Timing_wheel.h"
+
+// plays to a CoreMIDI destination in place of MusicPlayer, which hides when its events actually go out
+// the sequencer's events are put on a Timing_wheel at their deadlines on the monotonic raw clock and each tick's batch
+// is sent as one MIDIPacketList stamped now, so the scheduling is ours and so is its error
+// there is no audio device here to drift against, the sample clock is the wall clock at the nominal rate
+// control thread only
+class Endpoint_dispatcher : public Event_sink {
+public:
+    using Wheel = Timing_wheel<Timed_event>;
+
+    // a quarter of a millisecond, under the 320 us a three byte message takes on a MIDI cable
+    static const std::int64_t resolution_ns;
+    static const std::size_t capacity;
+
+private:
+    MIDIPortRef _port;
+    MIDIEndpointRef _destination;
+    Float64 _srate;
+    // the sequence sample playing at origin_ns
+    std::int64_t _start_sample;
+    std::int64_t _origin_ns;
+    std::int64_t _block_start = 0;
+    Wheel _wheel;
+    std::vector<Wheel::Entry> _due;
+    // complete sysex messages, kept until playback ends
+    std::deque<std::vector<UInt8>> _sysex_messages;
+    std::vector<UInt8> _packet_buffer;
+    std::int64_t _max_error_ns = 0;
+    std::uint64_t _sent = 0;
+
+public:
+    Endpoint_dispatcher(
+            MIDIPortRef port,
+            MIDIEndpointRef destination,
+            Float64 srate,
+            std::int64_t start_sample,
+            std::int64_t origin_ns
+    );
+
+    ~Endpoint_dispatcher() override = default;
+
+    Endpoint_dispatcher(const Endpoint_dispatcher &) = delete;
+
+    Endpoint_dispatcher &operator=(const Endpoint_dispatcher &) = delete;
+
+    // Drift_clock::now_ns, what origin_ns and dispatch are measured on
+    static std::int64_t now_ns();
+
+    // sample of the block the sequencer is about to render
+    void set_block_start(std::int64_t sample) { _block_start = sample; }
+
+    void channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset) override;
+
+    void sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset) override;
+
+    // sends everything due by now, returns when the next batch could be
+    std::int64_t dispatch(std::int64_t now);
+
+    std::int64_t sample_at(std::int64_t ns) const;
+
+    // the sequencer should stop topping up past this, a full wheel sends straight away
+    bool has_room() const { return _wheel.size() < capacity / 2; }
+
+    bool is_idle() const { return _wheel.empty(); }
+
+    // worst lateness of a sent event against its deadline
+    std::int64_t max_error_ns() const { return _max_error_ns; }
+
+    std::uint64_t sent() const { return _sent; }
+
+private:
+    void _schedule(const Timed_event &event);
+
+    void _send(const Wheel::Entry *entries, std::size_t count, std::int64_t now);
+};
+
+#endif //CORE_MIDI_GEN2_ENDPOINT_DISPATCHER_H
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Gm_wavetable_bank.h"
+
+namespace {
+    const double pi = 3.14159265358979323846;
+    const std::uint32_t table_length = 2048;
+    const std::uint32_t drum_rate = 44100;
+    // each table is played from middle C
+    const std::uint8_t table_root = 60;
+    const double middle_c_hz = 261.6255653;
+    const double max_harmonic_hz = 20000.;
+
+    enum class Wave {
+        sine,
+        piano,
+        organ,
+        saw,
+        square,
+        hollow,
+        brass,
+        bell
+    };
+
+    // partial amplitude of harmonic n (1 is the fundamental)
+    double partial(Wave wave, int n)
+    {
+        switch (wave) {
+            case Wave::sine:
+                return n == 1 ? 1. : 0.;
+            case Wave::piano:
+                return 1. / std::pow(n, 1.6);
+            case Wave::organ:
+                // drawbars 8', 4', 2 2/3', 2'
+                return (n == 1 || n == 2) ? 1. : (n == 3 || n == 4) ? .6 : (n == 6 || n == 8) ? .3 : 0.;
+            case Wave::saw:
+                return 1. / n;
+            case Wave::square:
+                return (n % 2) ? 1. / n : 0.;
+            case Wave::hollow:
+                return (n % 2) ? 1. / (n * n) : 0.;
+            case Wave::brass:
+                return 1. / std::pow(n, .8) * (n <= 8 ? 1. : .3);
+            case Wave::bell:
+                // the inharmonic partials of a bell, rounded to the nearest harmonic
+                return (n == 1) ? 1. : (n == 2) ? .5 : (n == 5) ? .4 : (n == 7) ? .25 : (n == 11) ? .15 : 0.;
+        }
+        return 0.;
+    }
+
+    struct Family {
+        Wave wave;
+        Envelope envelope;
+    };
+
+    Envelope envelope(float attack, float decay, float sustain, float release)
+    {
+        auto result = Envelope{};
+        result.attack = attack;
+        result.decay = decay;
+        result.sustain = sustain;
+        result.release = release;
+        return result;
+    }
+
+    // the sixteen GM families of eight programs each
+    const Family families[16] = {
+            {Wave::piano, envelope(.002f, 4.f, 0.f, .3f)},   // piano
+            {Wave::bell, envelope(.001f, 1.5f, 0.f, .5f)},   // chromatic percussion
+            {Wave::organ, envelope(.005f, 0.f, 1.f, .05f)},  // organ
+            {Wave::saw, envelope(.002f, 2.f, 0.f, .2f)},     // guitar
+            {Wave::hollow, envelope(.005f, 1.f, .6f, .1f)},  // bass
+            {Wave::saw, envelope(.12f, 0.f, 1.f, .4f)},      // strings
+            {Wave::saw, envelope(.2f, 0.f, 1.f, .5f)},       // ensemble
+            {Wave::brass, envelope(.04f, .3f, .8f, .15f)},   // brass
+            {Wave::square, envelope(.03f, .2f, .85f, .1f)},  // reed
+            {Wave::hollow, envelope(.05f, .1f, .9f, .15f)},  // pipe
+            {Wave::square, envelope(.005f, 0.f, 1.f, .1f)},  // synth lead
+            {Wave::saw, envelope(.4f, 0.f, 1.f, 1.f)},       // synth pad
+            {Wave::bell, envelope(.3f, 2.f, .5f, 1.f)},      // synth effects
+            {Wave::piano, envelope(.003f, 1.5f, 0.f, .2f)},  // ethnic
+            {Wave::sine, envelope(.001f, .4f, 0.f, .1f)},    // percussive
+            {Wave::hollow, envelope(.05f, 1.f, .3f, .5f)}    // sound effects
+    };
+
+    std::vector<std::int16_t> to_samples(const std::vector<double> &signal, double peak_gain)
+    {
+        auto peak = 0.;
+        for (auto value : signal) { peak = std::max(peak, std::fabs(value)); }
+        auto scale = (peak > 0.) ? peak_gain * 32767. / peak : 0.;
+
+        auto samples = std::vector<std::int16_t>(signal.size());
+        for (auto i = std::size_t{0}; i < signal.size(); ++i) {
+            samples[i] = static_cast<std::int16_t>(std::lround(signal[i] * scale));
+        }
+        return samples;
+    }
+
+    // the same noise every run
+    class Noise {
+    private:
+        std::uint32_t _state = 0x12345678;
+
+    public:
+        double next()
+        {
+            _state = _state * 1664525u + 1013904223u;
+            return static_cast<std::int32_t>(_state) / 2147483648.;
+        }
+    };
+
+    struct Drum {
+        // pitch in Hz at the start and end of the sweep, 0 for no tone
+        double tone_start;
+        double tone_end;
+        double tone_decay;
+        double noise_level;
+        double noise_decay;
+        // 0 - 1, how much of the noise is high passed
+        double brightness;
+        double length;
+        std::uint32_t exclusive_class;
+    };
+
+    Drum drum_for_key(int key)
+    {
+        switch (key) {
+            case 35:
+            case 36:
+                return Drum{150., 45., .35, .05, .02, 0., .6, 0};             // kicks
+            case 37:
+                return Drum{800., 700., .01, .5, .015, .5, .08, 0};           // side stick
+            case 38:
+            case 40:
+                return Drum{190., 160., .08, 1., .18, .4, .35, 0};            // snares
+            case 39:
+                return Drum{0., 0., 0., 1., .12, .6, .3, 0};                  // clap
+            case 42:
+            case 44:
+                return Drum{0., 0., 0., 1., .04, 1., .15, 1};                 // closed and pedal hi-hat
+            case 46:
+                return Drum{0., 0., 0., 1., .35, 1., .8, 1};                  // open hi-hat
+            case 41:
+            case 43:
+            case 45:
+            case 47:
+            case 48:
+            case 50: {
+                // toms, low floor to high
+                auto pitch = 80. * std::pow(2., (key - 41) / 12.);
+                return Drum{pitch * 1.5, pitch, .3, .15, .05, .2, .7, 0};
+            }
+            case 49:
+            case 52:
+            case 55:
+            case 57:
+                return Drum{0., 0., 0., 1., 1.2, .9, 2.5, 0};                 // crashes, china, splash
+            case 51:
+            case 53:
+            case 59:
+                return Drum{420., 420., .8, .6, .9, .95, 1.8, 0};             // rides
+            case 54:
+                return Drum{0., 0., 0., 1., .15, .95, .3, 0};                 // tambourine
+            case 56:
+                return Drum{560., 560., .15, 0., .01, 0., .3, 0};             // cowbell
+            default: {
+                // everything else is a short pitched hit, higher up the keyboard
+                auto pitch = 200. * std::pow(2., (key - 60) / 12.);
+                return Drum{pitch, pitch, .12, .4, .05, .5, .3, 0};
+            }
+        }
+    }
+}
+
+Gm_wavetable_bank::Gm_wavetable_bank()
+{
+    _build_melodic();
+    _build_drum_kit();
+}
+
+const Bank_preset *Gm_wavetable_bank::preset(std::uint16_t bank, std::uint8_t program) const
+{
+    if (bank == percussion_bank) {
+        return (program == 0) ? &_drum_kit : nullptr;
+    }
+    return (bank == 0 && program < _melodic.size()) ? &_melodic[program] : nullptr;
+}
+
+const std::int16_t *Gm_wavetable_bank::_add_sample(std::vector<std::int16_t> samples)
+{
+    // the region keeps a pointer to the data, which a vector of vectors doesn't move when it grows
+    _samples.push_back(std::move(samples));
+    return _samples.back().data();
+}
+
+void Gm_wavetable_bank::_build_melodic()
+{
+    const auto table_rate = static_cast<std::uint32_t>(std::lround(middle_c_hz * table_length));
+    // harmonic n of the table is every nth entry of one sine cycle
+    auto sine = std::vector<double>(table_length);
+    for (auto i = std::uint32_t{0}; i < table_length; ++i) {
+        sine[i] = std::sin(2. * pi * i / table_length);
+    }
+
+    auto family_regions = std::array<std::vector<Sample_region>, 16>{};
+    for (auto f = std::size_t{0}; f < 16; ++f) {
+        const auto &family = families[f];
+        // one table per octave band, with the harmonics the band's top key can play without aliasing
+        for (auto key_low = 0; key_low < 128; key_low += 12) {
+            auto key_high = std::min(key_low + 11, 127);
+            auto top_hz = 440. * std::pow(2., (key_high - 69) / 12.);
+            auto harmonics = std::max(1, std::min(64, static_cast<int>(max_harmonic_hz / top_hz)));
+
+            auto signal = std::vector<double>(table_length, 0.);
+            for (auto n = 1; n <= harmonics; ++n) {
+                auto amplitude = partial(family.wave, n);
+                if (amplitude == 0.) { continue; }
+                for (auto i = std::uint32_t{0}; i < table_length; ++i) {
+                    signal[i] += amplitude * sine[(n * i) % table_length];
+                }
+            }
+
+            auto region = Sample_region{};
+            region.key_low = static_cast<std::uint8_t>(key_low);
+            region.key_high = static_cast<std::uint8_t>(key_high);
+            region.samples = _add_sample(to_samples(signal, .8));
+            region.length = table_length;
+            region.loops = true;
+            region.loop_start = 0;
+            region.loop_end = table_length;
+            region.sample_rate = table_rate;
+            region.root_key = table_root;
+            region.envelope = family.envelope;
+            family_regions[f].push_back(region);
+        }
+    }
+
+    for (auto program = std::size_t{0}; program < _melodic.size(); ++program) {
+        _melodic[program].regions = family_regions[program / 8];
+    }
+}
+
+void Gm_wavetable_bank::_build_drum_kit()
+{
+    // GM percussion runs from 35 (acoustic bass drum) to 81 (open triangle)
+    auto noise = Noise{};
+    for (auto key = 35; key <= 81; ++key) {
+        auto drum = drum_for_key(key);
+        auto length = static_cast<std::size_t>(drum.length * drum_rate);
+
+        auto signal = std::vector<double>(length);
+        auto phase = 0.;
+        auto previous_noise = 0.;
+        for (auto i = std::size_t{0}; i < length; ++i) {
+            auto t = static_cast<double>(i) / drum_rate;
+            auto value = 0.;
+            if (drum.tone_start > 0.) {
+                auto hz = drum.tone_end + (drum.tone_start - drum.tone_end) * std::exp(-t / .05);
+                phase += 2. * pi * hz / drum_rate;
+                value += std::sin(phase) * std::exp(-t / drum.tone_decay);
+            }
+            if (drum.noise_level > 0.) {
+                // a first difference is a crude high pass, mixed in by brightness
+                auto white = noise.next();
+                auto shaped = white * (1. - drum.brightness) + (white - previous_noise) * .5 * drum.brightness;
+                previous_noise = white;
+                value += drum.noise_level * shaped * std::exp(-t / drum.noise_decay);
+            }
+            signal[i] = value;
+        }
+        // a few ms fade so the end doesn't click
+        auto fade = std::min(length, static_cast<std::size_t>(drum_rate / 200));
+        for (auto i = std::size_t{0}; i < fade; ++i) {
+            signal[length - 1 - i] *= static_cast<double>(i) / fade;
+        }
+
+        auto region = Sample_region{};
+        region.key_low = static_cast<std::uint8_t>(key);
+        region.key_high = static_cast<std::uint8_t>(key);
+        region.samples = _add_sample(to_samples(signal, .9));
+        region.length = static_cast<std::uint32_t>(length);
+        region.sample_rate = drum_rate;
+        region.root_key = static_cast<std::uint8_t>(key);
+        region.key_cents = 0.f;
+        region.one_shot = true;
+        region.exclusive_class = drum.exclusive_class;
+        // spread across the stereo field by key, as a kit is miked
+        region.pan = static_cast<float>((key % 7) - 3) / 6.f;
+        region.envelope = envelope(.001f, 0.f, 1.f, .05f);
+        _drum_kit.regions.push_back(region);
+    }
+}
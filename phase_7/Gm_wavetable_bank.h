@@ -0,0 +1,40 @@
+#ifndef CORE_MIDI_GEN2_GM_WAVETABLE_BANK_H
+#define CORE_MIDI_GEN2_GM_WAVETABLE_BANK_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "Sample_bank.h"
+
+// the synth's own General MIDI set, generated at construction so it needs no file
+// each melodic family (eight programs) plays a looped single cycle wavetable with the family's envelope,
+// one table per octave with only the harmonics that stay under Nyquist at 44.1 kHz, so high notes don't alias
+// the standard kit (bank 128) is synthesized one-shot drums on the GM percussion keys
+// a stand-in for a real bank, -b replaces it
+class Gm_wavetable_bank : public Sample_bank {
+private:
+    std::vector<std::vector<std::int16_t>> _samples;
+    std::array<Bank_preset, 128> _melodic;
+    Bank_preset _drum_kit;
+
+public:
+    Gm_wavetable_bank();
+
+    ~Gm_wavetable_bank() override = default;
+
+    Gm_wavetable_bank(const Gm_wavetable_bank &) = delete;
+
+    Gm_wavetable_bank &operator=(const Gm_wavetable_bank &) = delete;
+
+    const Bank_preset *preset(std::uint16_t bank, std::uint8_t program) const override;
+
+private:
+    const std::int16_t *_add_sample(std::vector<std::int16_t> samples);
+
+    void _build_melodic();
+
+    void _build_drum_kit();
+};
+
+#endif //CORE_MIDI_GEN2_GM_WAVETABLE_BANK_H
@@ -0,0 +1,153 @@
+#include "Live_renderer.h"
+#include "Midi_sequence.h"
+#include "util.h"
+
+Live_renderer::Live_renderer(
+        AudioUnit synth,
+        Event_sink *native_synth,
+        AudioUnit output_unit,
+        Playback_status &status,
+        std::int64_t start_sample,
+        std::int64_t end_sample,
+        std::int64_t low_water,
+        Float64 srate
+)
+        : _synth{synth},
+          _native_synth{native_synth},
+          _output_unit{output_unit},
+          _status(status),
+          _start_sample{start_sample},
+          _end_sample{end_sample},
+          _low_water{low_water},
+          _srate{srate},
+          _queued_until{start_sample},
+          _block_end{start_sample},
+          _clock{srate}
+{
+    auto result = AudioUnitAddRenderNotify(_output_unit, _render_notify, this);
+    check_error(result, "AudioUnitAddRenderNotify");
+}
+
+Live_renderer::~Live_renderer()
+{
+    AudioUnitRemoveRenderNotify(_output_unit, _render_notify, this);
+}
+
+OSStatus Live_renderer::_render_notify(
+        void *ref_con,
+        AudioUnitRenderActionFlags *action_flags,
+        const AudioTimeStamp *timestamp,
+        UInt32 bus_number,
+        UInt32 num_frames,
+        AudioBufferList */* data */
+)
+{
+    if (bus_number != 0) { return noErr; }
+
+    auto renderer = static_cast<Live_renderer *>(ref_con);
+    if (*action_flags & kAudioUnitRenderAction_PreRender) {
+        renderer->_pre_render(*timestamp, num_frames);
+    } else if (*action_flags & kAudioUnitRenderAction_PostRender) {
+        renderer->_post_render();
+    }
+    return noErr;
+}
+
+void Live_renderer::_pre_render(const AudioTimeStamp &timestamp, UInt32 num_frames)
+{
+    _pre_render_ns = Drift_clock::now_ns();
+
+    // the device clock doesn't start at zero, count from the first block we see
+    if (!_has_origin) {
+        _device_origin = timestamp.mSampleTime;
+        _has_origin = true;
+    }
+    auto block_start = _start_sample + static_cast<std::int64_t>(timestamp.mSampleTime - _device_origin);
+    _block_end = block_start + num_frames;
+    _block_frames = num_frames;
+    _clock.observe(block_start, _pre_render_ns);
+
+    // errors can't be reported from here, check_error would exit on the audio thread
+    _late_events = 0;
+    for (auto event = _events.front(); event && event->sample < _block_end; event = _events.front()) {
+        auto offset = event->sample - block_start;
+        if (offset < 0) {
+            offset = 0;
+            ++_late_events;
+        }
+
+        if (_native_synth) {
+            _deliver_native(*event, static_cast<std::uint32_t>(offset));
+        } else if (event->sysex) {
+            MusicDeviceSysEx(_synth, event->sysex, event->sysex_length);
+        } else {
+            MusicDeviceMIDIEvent(_synth, event->status, event->data_1, event->data_2, static_cast<UInt32>(offset));
+        }
+        _events.pop();
+    }
+}
+
+void Live_renderer::_deliver_native(const Timed_event &event, std::uint32_t offset)
+{
+    if (!event.sysex) {
+        _native_synth->channel_event(event.status, event.data_1, event.data_2, offset);
+        return;
+    }
+    // an Event_sink takes the payload as the SMF stores it, without the F0 the ring's message starts with
+    auto skip = (event.status == midi::sysex) ? 1u : 0u;
+    _native_synth->sysex(event.status, event.sysex + skip, event.sysex_length - skip, offset);
+}
+
+void Live_renderer::_post_render()
+{
+    if (!_block_frames) { return; }
+
+    // the whole graph renders between the two notifications, so this is the share of the block's duration used
+    auto elapsed = Drift_clock::now_ns() - _pre_render_ns;
+    auto block_load = static_cast<float>(elapsed / 1000000000. * _srate / _block_frames);
+    _cpu_load += (block_load - _cpu_load) * 0.125f;
+    _status.publish_clock(_clock.estimate());
+    _status.publish_block(_block_end, _cpu_load, _late_events);
+
+    if (_block_end >= _end_sample) {
+        if (!_status.is_finished()) { _status.finish(); }
+        return;
+    }
+
+    // once per top-up, the control thread moves _queued_until on when it has refilled the ring
+    auto queued_until = _queued_until.load(std::memory_order_acquire);
+    if (queued_until != _woken_for && _block_end + _low_water >= queued_until) {
+        _woken_for = queued_until;
+        _status.wake();
+    }
+}
+
+void Live_event_sink::channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset)
+{
+    auto event = Timed_event{_block_start + offset, nullptr, 0, status, data_1, data_2};
+    if (_pending.empty() && _renderer.push(event)) { return; }
+    _pending.push_back(event);
+}
+
+void Live_event_sink::sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset)
+{
+    // the SMF stores an F0 message without its status byte
+    _sysex_messages.emplace_back();
+    auto &message = _sysex_messages.back();
+    if (status == midi::sysex) {
+        message.push_back(midi::sysex);
+    }
+    message.insert(message.end(), payload, payload + length);
+
+    auto event = Timed_event{_block_start + offset, message.data(), static_cast<UInt32>(message.size()), status, 0, 0};
+    if (_pending.empty() && _renderer.push(event)) { return; }
+    _pending.push_back(event);
+}
+
+bool Live_event_sink::flush()
+{
+    while (!_pending.empty() && _renderer.push(_pending.front())) {
+        _pending.pop_front();
+    }
+    return _pending.empty();
+}
@@ -0,0 +1,141 @@
+#ifndef CORE_MIDI_GEN2_LIVE_RENDERER_H
+#define CORE_MIDI_GEN2_LIVE_RENDERER_H
+
+#include <AudioToolbox/AudioToolbox.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "Drift_clock.h"
+#include "Playback_status.h"
+#include "Sequencer.h"
+#include "Spsc_queue.h"
+
+// an event on the sequence's sample clock, sysex points at a complete message (F0 included)
+struct Timed_event {
+    std::int64_t sample;
+    const UInt8 *sysex;
+    UInt32 sysex_length;
+    UInt8 status;
+    UInt8 data_1;
+    UInt8 data_2;
+};
+
+// feeds the synth from inside the output unit's render cycle during live playback
+// the control thread pushes timed events ahead of time, the pre-render notification takes the ones due
+// in the coming block and schedules them at their sample offsets, the post-render one publishes the
+// position, load and device clock estimate to a Playback_status and wakes the control thread when the ring runs low or the sequence ends
+// there is no ring of per-block reports back the other way, the control thread only wants the latest position and load
+// and the running counts, which the status's atomics hold without a queue to drain or to fill up while it sleeps
+// on the audio thread nothing allocates, locks or waits
+class Live_renderer {
+public:
+    using Event_queue = Spsc_queue<Timed_event, 4096>;
+
+private:
+    AudioUnit _synth;
+    // -a, takes the events in place of _synth
+    Event_sink *_native_synth;
+    AudioUnit _output_unit;
+    Playback_status &_status;
+    Event_queue _events;
+    std::int64_t _start_sample;
+    std::int64_t _end_sample;
+    // the ring is topped up once less than this is queued ahead of the device
+    std::int64_t _low_water;
+    Float64 _srate;
+    // sample up to which the control thread has queued everything, written by the control thread
+    std::atomic<std::int64_t> _queued_until{0};
+    // audio thread only
+    bool _has_origin = false;
+    Float64 _device_origin = 0.;
+    std::int64_t _block_end = 0;
+    UInt32 _block_frames = 0;
+    UInt32 _late_events = 0;
+    std::int64_t _pre_render_ns = 0;
+    // the device's sample clock against the wall clock, observed as each block starts rendering
+    Drift_clock _clock;
+    float _cpu_load = 0.f;
+    std::int64_t _woken_for = -1;
+
+public:
+    // start_sample is the sequence sample the first rendered frame plays, the status is finished at end_sample
+    // native_synth is the built-in synth rendering in place of the music device, nullptr if there is none
+    Live_renderer(
+            AudioUnit synth,
+            Event_sink *native_synth,
+            AudioUnit output_unit,
+            Playback_status &status,
+            std::int64_t start_sample,
+            std::int64_t end_sample,
+            std::int64_t low_water,
+            Float64 srate
+    );
+
+    // the graph must be stopped first
+    ~Live_renderer();
+
+    Live_renderer(const Live_renderer &) = delete;
+
+    Live_renderer &operator=(const Live_renderer &) = delete;
+
+    // control thread, false when the queue is full
+    bool push(const Timed_event &event) { return _events.try_push(event); }
+
+    // control thread, after each top-up
+    void set_queued_until(std::int64_t sample) { _queued_until.store(sample, std::memory_order_release); }
+
+    // only once the graph is stopped, Playback_status::clock has the estimate while playing
+    const Drift_clock &clock() const { return _clock; }
+
+private:
+    static OSStatus _render_notify(
+            void *ref_con,
+            AudioUnitRenderActionFlags *action_flags,
+            const AudioTimeStamp *timestamp,
+            UInt32 bus_number,
+            UInt32 num_frames,
+            AudioBufferList *data
+    );
+
+    void _pre_render(const AudioTimeStamp &timestamp, UInt32 num_frames);
+
+    void _deliver_native(const Timed_event &event, std::uint32_t offset);
+
+    void _post_render();
+};
+
+// turns the sequencer's per-block events into timed events for a Live_renderer
+// whatever doesn't fit in the ring waits here (on the control thread) until the next flush
+class Live_event_sink : public Event_sink {
+private:
+    Live_renderer &_renderer;
+    std::int64_t _block_start = 0;
+    std::deque<Timed_event> _pending;
+    // complete sysex messages, kept until playback ends as the render thread may still read them
+    std::deque<std::vector<UInt8>> _sysex_messages;
+
+public:
+    explicit Live_event_sink(Live_renderer &renderer) : _renderer(renderer) {}
+
+    ~Live_event_sink() override = default;
+
+    // sample of the block the sequencer is about to render
+    void set_block_start(std::int64_t sample) { _block_start = sample; }
+
+    void channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset) override;
+
+    void sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset) override;
+
+    // moves pending events into the ring, true once nothing is left waiting
+    bool flush();
+
+    bool has_pending() const { return !_pending.empty(); }
+
+    // sample of the earliest event still waiting, only when has_pending
+    std::int64_t pending_from() const { return _pending.front().sample; }
+};
+
+#endif //CORE_MIDI_GEN2_LIVE_RENDERER_H
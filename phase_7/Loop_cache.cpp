@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "Loop_cache.h"
+
+namespace {
+    const std::uint8_t cc_sustain = 64;
+}
+
+void Held_note_sink::channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset)
+{
+    auto channel = status & 0x0F;
+    switch (status & 0xF0) {
+        case 0x90:
+            _notes[channel][data_1] = data_2 != 0;
+            break;
+        case 0x80:
+            _notes[channel][data_1] = false;
+            break;
+        case 0xB0:
+            if (data_1 == cc_sustain) {
+                _sustained[channel] = data_2 >= 64;
+            }
+            break;
+        default:
+            break;
+    }
+    _downstream.channel_event(status, data_1, data_2, offset);
+}
+
+void Held_note_sink::sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset)
+{
+    _downstream.sysex(status, payload, length, offset);
+}
+
+void Held_note_sink::release_all(std::uint32_t offset)
+{
+    for (auto channel = std::uint8_t{0}; channel < 16; ++channel) {
+        if (_sustained[channel]) {
+            _downstream.channel_event(static_cast<std::uint8_t>(0xB0 | channel), cc_sustain, 0, offset);
+        }
+        if (_notes[channel].none()) { continue; }
+
+        for (auto key = std::uint8_t{0}; key < 128; ++key) {
+            if (_notes[channel][key]) {
+                _downstream.channel_event(static_cast<std::uint8_t>(0x80 | channel), key, 0, offset);
+            }
+        }
+    }
+    for (auto &notes : _notes) {
+        notes.reset();
+    }
+    _sustained.reset();
+}
+
+Loop_cache::Loop_cache(std::vector<std::uint32_t> widths, std::int64_t body_frames, std::uint32_t repeats)
+        : _widths{std::move(widths)},
+          _body_frames{body_frames},
+          _repeats{repeats}
+{
+    for (auto &part : _parts) {
+        part.resize(_widths.size());
+    }
+    auto &body = _parts[static_cast<std::size_t>(Part::body)];
+    for (auto i = std::size_t{0}; i < body.size(); ++i) {
+        body[i].reserve(static_cast<std::size_t>(_body_frames) * _widths[i]);
+    }
+}
+
+void Loop_cache::append(Part part, const float *const *buffers, std::uint32_t frames)
+{
+    auto &lanes = _parts[static_cast<std::size_t>(part)];
+    for (auto i = std::size_t{0}; i < lanes.size(); ++i) {
+        lanes[i].insert(lanes[i].end(), buffers[i], buffers[i] + std::size_t{frames} * _widths[i]);
+    }
+}
+
+std::int64_t Loop_cache::part_frames(Part part) const
+{
+    const auto &lanes = _parts[static_cast<std::size_t>(part)];
+    if (lanes.empty() || _widths[0] == 0) { return 0; }
+    return static_cast<std::int64_t>(lanes[0].size() / _widths[0]);
+}
+
+std::int64_t Loop_cache::total_frames() const
+{
+    return std::max(_repeats * _body_frames + part_frames(Part::tail), part_frames(Part::intro_tail));
+}
+
+void Loop_cache::mix(std::int64_t position, std::uint32_t frames, float *const *buffers) const
+{
+    for (auto i = std::size_t{0}; i < _widths.size(); ++i) {
+        std::memset(buffers[i], 0, sizeof(float) * frames * _widths[i]);
+    }
+
+    auto end = position + frames;
+    _add(Part::intro_tail, 0, position, frames, buffers);
+
+    // the repeats whose body overlaps the span
+    auto last_repeat = std::min(static_cast<std::int64_t>(_repeats), (end - 1) / _body_frames + 1);
+    for (auto repeat = position / _body_frames; repeat < last_repeat; ++repeat) {
+        _add(Part::body, repeat * _body_frames, position, frames, buffers);
+    }
+
+    // repeat r's tail starts where repeat r + 1 does, a tail longer than the body overlaps several
+    auto tail_frames = part_frames(Part::tail);
+    auto first_tail = std::max(std::int64_t{1}, (position - tail_frames) / _body_frames + 1);
+    auto last_tail = std::min(static_cast<std::int64_t>(_repeats), (end - 1) / _body_frames);
+    for (auto repeat = first_tail; repeat <= last_tail; ++repeat) {
+        _add(Part::tail, repeat * _body_frames, position, frames, buffers);
+    }
+}
+
+void Loop_cache::_add(Part part, std::int64_t start, std::int64_t position, std::uint32_t frames, float *const *buffers) const
+{
+    auto from = std::max(position, start);
+    auto to = std::min(position + frames, start + part_frames(part));
+    if (from >= to) { return; }
+
+    const auto &lanes = _parts[static_cast<std::size_t>(part)];
+    for (auto i = std::size_t{0}; i < lanes.size(); ++i) {
+        auto width = _widths[i];
+        auto source = lanes[i].data() + (from - start) * width;
+        auto dest = buffers[i] + (from - position) * width;
+        auto count = static_cast<std::size_t>(to - from) * width;
+        for (auto j = std::size_t{0}; j < count; ++j) {
+            dest[j] += source[j];
+        }
+    }
+}
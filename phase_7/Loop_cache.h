@@ -0,0 +1,75 @@
+#ifndef CORE_MIDI_GEN2_LOOP_CACHE_H
+#define CORE_MIDI_GEN2_LOOP_CACHE_H
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+#include "Sequencer.h"
+
+// forwards events downstream and remembers which notes are still down,
+// so a loop boundary can close them instead of leaving them hanging into the next pass
+class Held_note_sink : public Event_sink {
+private:
+    Event_sink &_downstream;
+    std::array<std::bitset<128>, 16> _notes;
+    std::bitset<16> _sustained;
+
+public:
+    explicit Held_note_sink(Event_sink &downstream) : _downstream(downstream) {}
+
+    ~Held_note_sink() override = default;
+
+    void channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset) override;
+
+    void sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset) override;
+
+    // a note off for every held note and a pedal up for every sustained channel
+    void release_all(std::uint32_t offset);
+};
+
+// the audio of a loop region, rendered once and mixed into every repeat
+// the body is the region from a synth entering it with the chased loop start state,
+// the tail is what that synth still sounds once the notes are released at the loop end,
+// and the intro tail is what the part before the loop still sounds when it enters
+// repeat k plays the body at k * body_frames with the tail of repeat k - 1 added on, and the last tail rings out
+// each part is kept as the output buffer list lays it out, one float array per buffer with width floats per frame
+class Loop_cache {
+public:
+    enum class Part {
+        intro_tail,
+        body,
+        tail
+    };
+
+private:
+    std::vector<std::uint32_t> _widths;
+    std::int64_t _body_frames;
+    std::uint32_t _repeats;
+    // per part, per buffer
+    std::array<std::vector<std::vector<float>>, 3> _parts;
+
+public:
+    Loop_cache(std::vector<std::uint32_t> widths, std::int64_t body_frames, std::uint32_t repeats);
+
+    ~Loop_cache() = default;
+
+    // frames more of the part, one array per buffer
+    void append(Part part, const float *const *buffers, std::uint32_t frames);
+
+    std::int64_t part_frames(Part part) const;
+
+    // from the loop start until every tail has rung out
+    std::int64_t total_frames() const;
+
+    // writes frames of the looped output starting at position (0 is the loop start), one array per buffer
+    // only the parts that overlap the span are added, so each block costs a few passes whatever the repeat count
+    void mix(std::int64_t position, std::uint32_t frames, float *const *buffers) const;
+
+private:
+    // adds the part placed at start into the span
+    void _add(Part part, std::int64_t start, std::int64_t position, std::uint32_t frames, float *const *buffers) const;
+};
+
+#endif //CORE_MIDI_GEN2_LOOP_CACHE_H
@@ -0,0 +1,47 @@
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Mapped_file.h"
+
+Mapped_file::Mapped_file(const std::string &path)
+        : _path{path}
+{
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error{errno, std::generic_category(), "open: " + path};
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        auto err = errno;
+        close(fd);
+        throw std::system_error{err, std::generic_category(), "fstat: " + path};
+    }
+
+    _size = static_cast<std::size_t>(info.st_size);
+    // mmap rejects zero-length mappings, an empty file is simply an empty range
+    if (_size != 0) {
+        auto addr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            auto err = errno;
+            close(fd);
+            throw std::system_error{err, std::generic_category(), "mmap: " + path};
+        }
+        _data = static_cast<const std::uint8_t *>(addr);
+    }
+
+    // the mapping keeps its own reference to the file
+    close(fd);
+}
+
+Mapped_file::~Mapped_file()
+{
+    if (_data) {
+        munmap(const_cast<std::uint8_t *>(_data), _size);
+    }
+}
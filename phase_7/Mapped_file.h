@@ -0,0 +1,36 @@
+#ifndef CORE_MIDI_GEN2_MAPPED_FILE_H
+#define CORE_MIDI_GEN2_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// read-only POSIX mapping of a whole file, unmapped in the dtor
+// non-copyable so the bytes handed out stay valid for the lifetime of the object
+class Mapped_file {
+private:
+    const std::uint8_t *_data = nullptr;
+    std::size_t _size = 0;
+    std::string _path;
+
+public:
+    explicit Mapped_file(const std::string &path);
+
+    ~Mapped_file();
+
+    Mapped_file(const Mapped_file &) = delete;
+
+    Mapped_file &operator=(const Mapped_file &) = delete;
+
+    const std::uint8_t *data() const { return _data; }
+
+    std::size_t size() const { return _size; }
+
+    const std::uint8_t *begin() const { return _data; }
+
+    const std::uint8_t *end() const { return _data + _size; }
+
+    const std::string &path() const { return _path; }
+};
+
+#endif //CORE_MIDI_GEN2_MAPPED_FILE_H
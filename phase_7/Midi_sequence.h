@@ -0,0 +1,203 @@
+#ifndef CORE_MIDI_GEN2_MIDI_SEQUENCE_H
+#define CORE_MIDI_GEN2_MIDI_SEQUENCE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Array_view.h"
+#include "Mapped_file.h"
+
+namespace midi {
+    const std::uint8_t sysex = 0xF0;
+    const std::uint8_t sysex_escape = 0xF7;
+    const std::uint8_t meta = 0xFF;
+
+    const std::uint8_t meta_end_of_track = 0x2F;
+    const std::uint8_t meta_tempo = 0x51;
+
+    // 120 bpm, the SMF default until the first tempo event
+    const std::uint32_t default_usec_per_quarter = 500000;
+
+    inline bool is_channel_status(std::uint8_t status) { return status >= 0x80 && status < 0xF0; }
+
+    // number of data bytes following a channel status byte
+    inline int channel_data_length(std::uint8_t status)
+    {
+        auto kind = status & 0xF0;
+        return (kind == 0xC0 || kind == 0xD0) ? 1 : 2;
+    }
+
+    // SMPTE files have no tempo, treat them as running at the default 120 bpm
+    inline double ticks_per_quarter(std::uint16_t division)
+    {
+        if (!(division & 0x8000)) { return division; }
+        auto frames_per_sec = -static_cast<std::int8_t>(division >> 8);
+        auto ticks_per_frame = division & 0xFF;
+        auto ticks_per_sec = (frames_per_sec == 29 ? 29.97 : frames_per_sec) * ticks_per_frame;
+        return ticks_per_sec * default_usec_per_quarter / 1000000.;
+    }
+};
+
+// struct-of-arrays view of one track, event i is (ticks[i], status[i], data_1[i], data_2[i])
+// sysex and meta events keep their bytes in the sequence's payload arena at payload_offset[i]
+// for meta events data_1 holds the meta type
+struct Midi_track {
+    Array_view<std::uint32_t> ticks;
+    Array_view<std::uint8_t> status;
+    Array_view<std::uint8_t> data_1;
+    Array_view<std::uint8_t> data_2;
+    Array_view<std::uint32_t> payload_offset;
+    Array_view<std::uint32_t> payload_length;
+    // tick of the end-of-track meta event (or of the last event if it is missing)
+    std::uint32_t end_tick = 0;
+
+    std::size_t size() const { return ticks.size(); }
+
+    bool empty() const { return ticks.empty(); }
+};
+
+// owning storage behind a Midi_track, filled by the parser
+struct Midi_track_buffer {
+    std::vector<std::uint32_t> ticks;
+    std::vector<std::uint8_t> status;
+    std::vector<std::uint8_t> data_1;
+    std::vector<std::uint8_t> data_2;
+    std::vector<std::uint32_t> payload_offset;
+    std::vector<std::uint32_t> payload_length;
+    std::uint32_t end_tick = 0;
+
+    std::size_t size() const { return ticks.size(); }
+
+    void reserve(std::size_t count)
+    {
+        ticks.reserve(count);
+        status.reserve(count);
+        data_1.reserve(count);
+        data_2.reserve(count);
+        payload_offset.reserve(count);
+        payload_length.reserve(count);
+    }
+
+    void resize(std::size_t count)
+    {
+        ticks.resize(count);
+        status.resize(count);
+        data_1.resize(count);
+        data_2.resize(count);
+        payload_offset.resize(count);
+        payload_length.resize(count);
+    }
+
+    void push_back(
+            std::uint32_t tick,
+            std::uint8_t status_byte,
+            std::uint8_t data_1_byte,
+            std::uint8_t data_2_byte,
+            std::uint32_t offset = 0,
+            std::uint32_t length = 0
+    )
+    {
+        ticks.push_back(tick);
+        status.push_back(status_byte);
+        data_1.push_back(data_1_byte);
+        data_2.push_back(data_2_byte);
+        payload_offset.push_back(offset);
+        payload_length.push_back(length);
+    }
+
+    void push_back(const Midi_track_buffer &other, std::size_t i)
+    {
+        push_back(other.ticks[i], other.status[i], other.data_1[i], other.data_2[i],
+                  other.payload_offset[i], other.payload_length[i]);
+    }
+
+    // stable, so events that share a tick keep their relative order
+    void sort_by_tick()
+    {
+        if (std::is_sorted(ticks.begin(), ticks.end())) { return; }
+
+        auto order = std::vector<std::size_t>(size());
+        for (auto i = std::size_t{0}; i < order.size(); ++i) { order[i] = i; }
+        std::stable_sort(order.begin(), order.end(), [this](std::size_t lhs, std::size_t rhs) {
+            return ticks[lhs] < ticks[rhs];
+        });
+
+        auto sorted = Midi_track_buffer{};
+        sorted.reserve(size());
+        for (auto i : order) { sorted.push_back(*this, i); }
+        sorted.end_tick = end_tick;
+        *this = std::move(sorted);
+    }
+
+    Midi_track view() const
+    {
+        auto track = Midi_track{};
+        track.ticks = ticks;
+        track.status = status;
+        track.data_1 = data_1;
+        track.data_2 = data_2;
+        track.payload_offset = payload_offset;
+        track.payload_length = payload_length;
+        track.end_tick = end_tick;
+        return track;
+    }
+};
+
+// project-owned equivalent of a MusicSequence
+// like MusicSequence, tempo events (and the conductor track of a format 1 file) live in a separate tempo track
+// so track indices line up with the ones -t has always used
+// move-only, the track views point into buffers (or into the mapping in source)
+struct Midi_sequence {
+    std::uint16_t format = 0;
+    std::uint16_t division = 0;
+    Midi_track tempo_track;
+    std::vector<Midi_track> tracks;
+    // sysex and meta payload bytes, payload offsets are relative to this
+    const std::uint8_t *payload_arena = nullptr;
+    std::size_t payload_arena_size = 0;
+    std::vector<Midi_track_buffer> buffers;
+    std::shared_ptr<const Mapped_file> source;
+
+    Midi_sequence() = default;
+
+    Midi_sequence(Midi_sequence &&) = default;
+
+    Midi_sequence &operator=(Midi_sequence &&) = default;
+
+    Midi_sequence(const Midi_sequence &) = delete;
+
+    Midi_sequence &operator=(const Midi_sequence &) = delete;
+
+    // offset and length are clamped to the arena here, where a payload is read,
+    // so a corrupt cache can't reach outside it and loading one checks no events
+    const std::uint8_t *payload(const Midi_track &track, std::size_t i) const
+    {
+        return payload_arena + std::min<std::size_t>(track.payload_offset[i], payload_arena_size);
+    }
+
+    std::uint32_t payload_length(const Midi_track &track, std::size_t i) const
+    {
+        auto offset = std::min<std::size_t>(track.payload_offset[i], payload_arena_size);
+        return static_cast<std::uint32_t>(std::min<std::size_t>(track.payload_length[i], payload_arena_size - offset));
+    }
+
+    // one pass over the cached per-track end ticks
+    std::uint32_t end_tick() const
+    {
+        auto tick = tempo_track.end_tick;
+        for (const auto &track : tracks) {
+            tick = std::max(tick, track.end_tick);
+        }
+        return tick;
+    }
+
+    bool is_smpte() const { return (division & 0x8000) != 0; }
+
+    double ticks_per_quarter() const { return midi::ticks_per_quarter(division); }
+
+    double beats_for_tick(std::uint32_t tick) const { return tick / ticks_per_quarter(); }
+};
+
+#endif //CORE_MIDI_GEN2_MIDI_SEQUENCE_H
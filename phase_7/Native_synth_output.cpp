@@ -0,0 +1,74 @@
+#include "Native_synth_output.h"
+#include "util.h"
+
+void Native_synth_output::install(AUGraph graph, Float64 srate)
+{
+    auto node_count = UInt32{};
+    auto result = AUGraphGetNodeCount(graph, &node_count);
+    check_error(result, "AUGraphGetNodeCount");
+
+    auto output_node = AUNode{};
+    auto output_unit = static_cast<AudioUnit>(nullptr);
+    for (auto i = static_cast<UInt32>(0); i < node_count && !output_unit; ++i) {
+        auto node = AUNode{};
+        result = AUGraphGetIndNode(graph, i, &node);
+        check_error(result, "AUGraphGetIndNode");
+
+        auto desc = AudioComponentDescription{};
+        result = AUGraphNodeInfo(graph, node, &desc, nullptr);
+        check_error(result, "AUGraphNodeInfo");
+
+        if (desc.componentType == kAudioUnitType_Output) {
+            output_node = node;
+            result = AUGraphNodeInfo(graph, node, nullptr, &output_unit);
+            check_error(result, "AUGraphNodeInfo");
+        }
+    }
+
+    result = (output_unit == nullptr);
+    check_error(result, "output_unit == NULL");
+
+    // the synth is built here rather than in the constructor, the device decides the rate when playing live
+    _synth = std::make_unique<Wavetable_synth>(_bank, _max_voices, srate, _streamer);
+
+    result = AUGraphDisconnectNodeInput(graph, output_node, 0);
+    check_error(result, "AUGraphDisconnectNodeInput");
+
+    // what _render writes, the output unit converts it to whatever the device or the file wants
+    auto format = AudioStreamBasicDescription{};
+    format.mSampleRate = srate;
+    format.mFormatID = kAudioFormatLinearPCM;
+    format.mFormatFlags = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+    format.mBytesPerPacket = sizeof(Float32);
+    format.mFramesPerPacket = 1;
+    format.mBytesPerFrame = sizeof(Float32);
+    format.mChannelsPerFrame = 2;
+    format.mBitsPerChannel = 32;
+    result = AudioUnitSetProperty(output_unit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &format, sizeof(format));
+    check_error(result, "AudioUnitSetProperty: kAudioUnitProperty_StreamFormat");
+
+    auto callback = AURenderCallbackStruct{_render, this};
+    result = AUGraphSetNodeInputCallback(graph, output_node, 0, &callback);
+    check_error(result, "AUGraphSetNodeInputCallback");
+}
+
+OSStatus Native_synth_output::_render(
+        void *ref_con,
+        AudioUnitRenderActionFlags */* action_flags */,
+        const AudioTimeStamp */* timestamp */,
+        UInt32 /* bus_number */,
+        UInt32 num_frames,
+        AudioBufferList *data
+)
+{
+    // runs on the render thread, nothing here may fail loudly
+    if (data->mNumberBuffers < 2) { return kAudio_ParamError; }
+
+    auto output = static_cast<Native_synth_output *>(ref_con);
+    output->_synth->render(
+            num_frames,
+            static_cast<float *>(data->mBuffers[0].mData),
+            static_cast<float *>(data->mBuffers[1].mData)
+    );
+    return noErr;
+}
@@ -0,0 +1,54 @@
+#ifndef CORE_MIDI_GEN2_NATIVE_SYNTH_OUTPUT_H
+#define CORE_MIDI_GEN2_NATIVE_SYNTH_OUTPUT_H
+
+#include <AudioToolbox/AudioToolbox.h>
+
+#include <memory>
+
+#include "Disk_streamer.h"
+#include "Sample_bank.h"
+#include "Wavetable_synth.h"
+
+// -a, puts a Wavetable_synth in front of the graph's output unit in place of its music device
+// the output's input is disconnected and fed from a render callback instead, so AudioUnitRender offline
+// and the device's render cycle live both pull the native synth, and the render notifications still bracket it
+// the music device stays in the graph, unconnected and never rendered
+class Native_synth_output {
+private:
+    const Sample_bank &_bank;
+    UInt32 _max_voices;
+    // -d, or nullptr
+    Disk_streamer *_streamer;
+    std::unique_ptr<Wavetable_synth> _synth;
+
+public:
+    // the bank and the streamer must outlive the output
+    Native_synth_output(const Sample_bank &bank, UInt32 max_voices, Disk_streamer *streamer)
+            : _bank(bank),
+              _max_voices{max_voices},
+              _streamer{streamer} {}
+
+    ~Native_synth_output() = default;
+
+    Native_synth_output(const Native_synth_output &) = delete;
+
+    Native_synth_output &operator=(const Native_synth_output &) = delete;
+
+    // once the graph is set up and its sample rate known, before it is initialized
+    void install(AUGraph graph, Float64 srate);
+
+    // only once installed
+    Wavetable_synth &synth() { return *_synth; }
+
+private:
+    static OSStatus _render(
+            void *ref_con,
+            AudioUnitRenderActionFlags *action_flags,
+            const AudioTimeStamp *timestamp,
+            UInt32 bus_number,
+            UInt32 num_frames,
+            AudioBufferList *data
+    );
+};
+
+#endif //CORE_MIDI_GEN2_NATIVE_SYNTH_OUTPUT_H
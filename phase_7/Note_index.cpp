@@ -0,0 +1,129 @@
+#include <algorithm>
+
+#include "Note_index.h"
+
+// initialize static variables
+const std::uint32_t Note_index::no_child;
+
+Note_index::Note_index(const Midi_sequence &sequence, const Merged_timeline &timeline)
+{
+    _pair(sequence, timeline);
+
+    _by_start.reserve(_notes.size());
+    _by_end.reserve(_notes.size());
+    auto positions = std::vector<std::uint32_t>(_notes.size());
+    for (auto i = std::size_t{0}; i < positions.size(); ++i) {
+        positions[i] = static_cast<std::uint32_t>(i);
+    }
+    if (!positions.empty()) {
+        _build(positions);
+    }
+}
+
+void Note_index::_pair(const Midi_sequence &sequence, const Merged_timeline &timeline)
+{
+    const auto &events = timeline.events;
+    // open notes per channel and key, oldest first
+    auto open = std::vector<std::vector<std::uint32_t>>(16 * 128);
+
+    for (auto i = std::size_t{0}; i < events.size(); ++i) {
+        auto status = events.status[i];
+        auto kind = status & 0xF0;
+        if (kind != 0x80 && kind != 0x90) { continue; }
+
+        auto channel = static_cast<std::uint8_t>(status & 0x0F);
+        auto key = events.data_1[i];
+        auto &keys_open = open[channel * 128 + key];
+        if (kind == 0x90 && events.data_2[i] != 0) {
+            auto source = timeline.sources[i];
+            auto track = (source == Merged_timeline::tempo_source) ? Note::tempo_track : static_cast<std::uint16_t>(source - 1);
+            keys_open.push_back(static_cast<std::uint32_t>(_notes.size()));
+            _notes.push_back(Note{events.ticks[i], events.ticks[i], key, events.data_2[i], channel, track});
+        } else if (!keys_open.empty()) {
+            auto &note = _notes[keys_open.front()];
+            note.end = std::max(events.ticks[i], note.start + 1);
+            keys_open.erase(keys_open.begin());
+        }
+    }
+
+    auto end_tick = std::max(sequence.end_tick(), events.empty() ? 0u : events.ticks.back());
+    for (const auto &keys_open : open) {
+        for (auto position : keys_open) {
+            auto &note = _notes[position];
+            note.end = std::max(end_tick, note.start + 1);
+        }
+    }
+}
+
+std::uint32_t Note_index::_build(std::vector<std::uint32_t> &positions)
+{
+    // the median start is inside at least its own note, so both sides shrink to at most half
+    auto center = _notes[positions[positions.size() / 2]].start;
+
+    auto left = std::vector<std::uint32_t>{};
+    auto right = std::vector<std::uint32_t>{};
+    auto node = Node{center, static_cast<std::uint32_t>(_by_start.size()), 0, no_child, no_child};
+    for (auto position : positions) {
+        const auto &note = _notes[position];
+        if (note.end <= center) {
+            left.push_back(position);
+        } else if (note.start > center) {
+            right.push_back(position);
+        } else {
+            _by_start.push_back(position);
+            _by_end.push_back(position);
+            ++node.count;
+        }
+    }
+    positions.clear();
+    positions.shrink_to_fit();
+
+    // positions come in start order, so only the end order needs sorting
+    std::stable_sort(_by_end.begin() + node.begin, _by_end.end(), [this](std::uint32_t lhs, std::uint32_t rhs) {
+        return _notes[lhs].end > _notes[rhs].end;
+    });
+
+    auto index = static_cast<std::uint32_t>(_nodes.size());
+    _nodes.push_back(node);
+    if (!left.empty()) {
+        auto child = _build(left);
+        _nodes[index].left = child;
+    }
+    if (!right.empty()) {
+        auto child = _build(right);
+        _nodes[index].right = child;
+    }
+    return index;
+}
+
+void Note_index::find(std::uint32_t first_tick, std::uint32_t end_tick, std::vector<std::uint32_t> &positions) const
+{
+    if (_nodes.empty() || first_tick >= end_tick) { return; }
+
+    // at most the two paths down the edges of the range are visited without reporting anything
+    auto pending = std::vector<std::uint32_t>{0};
+    while (!pending.empty()) {
+        const auto &node = _nodes[pending.back()];
+        pending.pop_back();
+
+        auto by_start = _by_start.begin() + node.begin;
+        auto by_end = _by_end.begin() + node.begin;
+        if (node.center < first_tick) {
+            // every note here starts before the range, the ones still sounding when it starts overlap
+            for (auto i = std::uint32_t{0}; i < node.count && _notes[by_end[i]].end > first_tick; ++i) {
+                positions.push_back(by_end[i]);
+            }
+            if (node.right != no_child) { pending.push_back(node.right); }
+        } else if (node.center >= end_tick) {
+            // every note here sounds past the range, the ones that start before it ends overlap
+            for (auto i = std::uint32_t{0}; i < node.count && _notes[by_start[i]].start < end_tick; ++i) {
+                positions.push_back(by_start[i]);
+            }
+            if (node.left != no_child) { pending.push_back(node.left); }
+        } else {
+            positions.insert(positions.end(), by_start, by_start + node.count);
+            if (node.left != no_child) { pending.push_back(node.left); }
+            if (node.right != no_child) { pending.push_back(node.right); }
+        }
+    }
+}
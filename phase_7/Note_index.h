@@ -0,0 +1,72 @@
+#ifndef CORE_MIDI_GEN2_NOTE_INDEX_H
+#define CORE_MIDI_GEN2_NOTE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Midi_sequence.h"
+#include "Track_merger.h"
+
+// a note on paired with its note off, sounding over the ticks [start, end)
+struct Note {
+    // the tempo track's notes, if a format 1 conductor track has any
+    static const std::uint16_t tempo_track = 0xFFFF;
+
+    std::uint32_t start;
+    std::uint32_t end;
+    std::uint8_t key;
+    std::uint8_t velocity;
+    std::uint8_t channel;
+    // zero based as -t counts, or tempo_track
+    std::uint16_t track;
+};
+
+// every note of a merged timeline, paired in one pass at load time and kept in start order,
+// with a centered interval tree on top so the notes sounding over a range of ticks are found in O(log n + k)
+// instead of rescanning the events from time zero
+// a note off ends the earliest open note of its key and channel, a note left open ends at the end of the sequence
+// and one that ends on the tick it starts sounds for one tick
+class Note_index {
+private:
+    // the notes that contain center, in start order and in descending end order
+    struct Node {
+        std::uint32_t center;
+        std::uint32_t begin;
+        std::uint32_t count;
+        // children are nodes indices, none when no_child
+        std::uint32_t left;
+        std::uint32_t right;
+    };
+
+    static const std::uint32_t no_child = 0xFFFFFFFF;
+
+    std::vector<Note> _notes;
+    std::vector<Node> _nodes;
+    std::vector<std::uint32_t> _by_start;
+    std::vector<std::uint32_t> _by_end;
+
+public:
+    Note_index() = default;
+
+    Note_index(const Midi_sequence &sequence, const Merged_timeline &timeline);
+
+    ~Note_index() = default;
+
+    const std::vector<Note> &notes() const { return _notes; }
+
+    std::size_t size() const { return _notes.size(); }
+
+    // appends the positions in notes() of every note sounding at some tick in [first_tick, end_tick), in no order
+    void find(std::uint32_t first_tick, std::uint32_t end_tick, std::vector<std::uint32_t> &positions) const;
+
+    void sounding_at(std::uint32_t tick, std::vector<std::uint32_t> &positions) const { find(tick, tick + 1, positions); }
+
+private:
+    void _pair(const Midi_sequence &sequence, const Merged_timeline &timeline);
+
+    // builds the subtree over the notes, returns its node
+    std::uint32_t _build(std::vector<std::uint32_t> &positions);
+};
+
+#endif //CORE_MIDI_GEN2_NOTE_INDEX_H
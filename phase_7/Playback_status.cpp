@@ -0,0 +1,84 @@
+#include "Playback_status.h"
+
+void Playback_status::reset(std::int64_t position)
+{
+    _position.store(position, std::memory_order_release);
+    _cpu_load.store(0.f, std::memory_order_relaxed);
+    _late_events.store(0, std::memory_order_relaxed);
+    publish_clock(Drift_clock::Estimate{position, 0., 0.});
+    _finished.store(false, std::memory_order_release);
+    _seen_wakes = _wake_count.load(std::memory_order_acquire);
+}
+
+void Playback_status::publish_block(std::int64_t next_position, float cpu_load, std::uint32_t late_events)
+{
+    _cpu_load.store(cpu_load, std::memory_order_relaxed);
+    if (late_events) {
+        _late_events.fetch_add(late_events, std::memory_order_relaxed);
+    }
+    _position.store(next_position, std::memory_order_release);
+}
+
+void Playback_status::publish_clock(const Drift_clock::Estimate &estimate)
+{
+    // a single writer, so the count only needs to be odd around the stores
+    auto version = _clock_version.load(std::memory_order_relaxed);
+    _clock_version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _clock_sample.store(estimate.sample, std::memory_order_relaxed);
+    _clock_ns.store(estimate.ns, std::memory_order_relaxed);
+    _clock_ns_per_sample.store(estimate.ns_per_sample, std::memory_order_relaxed);
+    _clock_version.store(version + 2, std::memory_order_release);
+}
+
+void Playback_status::publish_overload(std::uint64_t ns)
+{
+    _overload_ns.store(ns, std::memory_order_relaxed);
+    _overload_count.fetch_add(1, std::memory_order_release);
+    wake();
+}
+
+void Playback_status::finish()
+{
+    _finished.store(true, std::memory_order_release);
+    wake();
+}
+
+void Playback_status::wake()
+{
+    _wake_count.fetch_add(1, std::memory_order_release);
+    // without the mutex, see the class comment
+    _condition.notify_one();
+}
+
+std::uint32_t Playback_status::take_overloads(std::uint64_t &ns)
+{
+    // the listener may count another overload after this, it is picked up on the next call
+    auto overloads = _overload_count.exchange(0, std::memory_order_acquire);
+    ns = _overload_ns.load(std::memory_order_relaxed);
+    return overloads;
+}
+
+Drift_clock::Estimate Playback_status::clock() const
+{
+    auto estimate = Drift_clock::Estimate{};
+    auto version = std::uint32_t{0};
+    do {
+        version = _clock_version.load(std::memory_order_acquire);
+        estimate.sample = _clock_sample.load(std::memory_order_relaxed);
+        estimate.ns = _clock_ns.load(std::memory_order_relaxed);
+        estimate.ns_per_sample = _clock_ns_per_sample.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((version & 1) || version != _clock_version.load(std::memory_order_relaxed));
+    return estimate;
+}
+
+bool Playback_status::wait_until(Clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+    auto woken = _condition.wait_until(lock, deadline, [this] {
+        return _wake_count.load(std::memory_order_acquire) != _seen_wakes;
+    });
+    _seen_wakes = _wake_count.load(std::memory_order_acquire);
+    return woken;
+}
@@ -0,0 +1,90 @@
+#ifndef CORE_MIDI_GEN2_PLAYBACK_STATUS_H
+#define CORE_MIDI_GEN2_PLAYBACK_STATUS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include "Drift_clock.h"
+
+// what the render side publishes to the control thread while playing
+// position, load and counters are plain atomics, wake() tells the control thread that something needs it now
+// (end of sequence, the event ring running low, an overload) so it never has to poll on a fixed interval
+// the audio thread can't take the mutex, so a wake that races the control thread's check can be missed,
+// which is why wait_until always has a deadline and callers keep it short enough to cover one
+// the device clock estimate is several values, published under a sequence count the reader retries on
+class Playback_status {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    // sequence sample the next rendered block starts on
+    std::atomic<std::int64_t> _position{0};
+    // share of the block duration spent rendering, smoothed by the render side
+    std::atomic<float> _cpu_load{0.f};
+    std::atomic<std::uint32_t> _late_events{0};
+    std::atomic<std::uint32_t> _overload_count{0};
+    // Drift_clock::now_ns of the latest overload
+    std::atomic<std::uint64_t> _overload_ns{0};
+    // odd while the render side is writing the estimate
+    std::atomic<std::uint32_t> _clock_version{0};
+    std::atomic<std::int64_t> _clock_sample{0};
+    std::atomic<double> _clock_ns{0.};
+    std::atomic<double> _clock_ns_per_sample{0.};
+    std::atomic<bool> _finished{false};
+    std::atomic<std::uint32_t> _wake_count{0};
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    // control thread only
+    std::uint32_t _seen_wakes = 0;
+
+public:
+    Playback_status() = default;
+
+    ~Playback_status() = default;
+
+    Playback_status(const Playback_status &) = delete;
+
+    Playback_status &operator=(const Playback_status &) = delete;
+
+    // control thread, before the render side starts
+    void reset(std::int64_t position);
+
+    // render side, once per block
+    void publish_block(std::int64_t next_position, float cpu_load, std::uint32_t late_events);
+
+    // render side, once per block, never blocks
+    void publish_clock(const Drift_clock::Estimate &estimate);
+
+    // device overload listener
+    void publish_overload(std::uint64_t ns);
+
+    // render side, wakes the control thread
+    void finish();
+
+    // any thread, never blocks
+    void wake();
+
+    std::int64_t position() const { return _position.load(std::memory_order_acquire); }
+
+    float cpu_load() const { return _cpu_load.load(std::memory_order_relaxed); }
+
+    std::uint32_t late_events() const { return _late_events.load(std::memory_order_relaxed); }
+
+    bool has_overloads() const { return _overload_count.load(std::memory_order_relaxed) != 0; }
+
+    // overloads since the last call, ns is when the latest one happened
+    std::uint32_t take_overloads(std::uint64_t &ns);
+
+    // where the device clock was at the latest block, not valid until the first one is rendered
+    Drift_clock::Estimate clock() const;
+
+    bool is_finished() const { return _finished.load(std::memory_order_acquire); }
+
+    // control thread, sleeps until the deadline or a wake, true when woken
+    bool wait_until(Clock::time_point deadline);
+};
+
+#endif //CORE_MIDI_GEN2_PLAYBACK_STATUS_H
@@ -0,0 +1,149 @@
+#include <algorithm>
+
+#include "Polyphony_profile.h"
+
+namespace {
+    const std::uint8_t cc_sustain = 64;
+    const std::uint8_t cc_all_sound_off = 120;
+    const std::uint8_t cc_reset_all_controllers = 121;
+    const std::uint8_t cc_all_notes_off = 123;
+
+    // the notes of one channel, a key struck again before its note off sounds twice
+    struct Channel_notes {
+        std::array<std::uint8_t, 128> held;
+        // released while the pedal was down
+        std::array<std::uint8_t, 128> sustained;
+        bool pedal = false;
+        std::uint16_t sounding = 0;
+
+        Channel_notes()
+        {
+            held.fill(0);
+            sustained.fill(0);
+        }
+
+        void note_on(std::uint8_t key)
+        {
+            if (held[key] == 0xFF) { return; }
+            ++held[key];
+            ++sounding;
+        }
+
+        void note_off(std::uint8_t key)
+        {
+            if (!held[key]) { return; }
+            --held[key];
+            if (pedal && sustained[key] < 0xFF) {
+                ++sustained[key];
+            } else {
+                --sounding;
+            }
+        }
+
+        void pedal_up()
+        {
+            pedal = false;
+            for (auto &count : sustained) {
+                sounding -= count;
+                count = 0;
+            }
+        }
+
+        void all_off()
+        {
+            held.fill(0);
+            sustained.fill(0);
+            sounding = 0;
+        }
+
+        void apply(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2)
+        {
+            switch (status & 0xF0) {
+                case 0x90:
+                    if (data_2) {
+                        note_on(data_1);
+                    } else {
+                        note_off(data_1);
+                    }
+                    break;
+                case 0x80:
+                    note_off(data_1);
+                    break;
+                case 0xB0:
+                    if (data_1 == cc_sustain || data_1 == cc_reset_all_controllers) {
+                        if (data_1 == cc_sustain && data_2 >= 64) {
+                            pedal = true;
+                        } else {
+                            pedal_up();
+                        }
+                    } else if (data_1 == cc_all_sound_off || data_1 == cc_all_notes_off) {
+                        all_off();
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    };
+}
+
+Polyphony_profile::Polyphony_profile(const Merged_timeline &timeline, const Tempo_map &tempo_map, std::uint32_t block_frames)
+        : _block_frames{block_frames}
+{
+    _channel_peaks.fill(0);
+
+    const auto &events = timeline.events;
+    if (events.empty()) { return; }
+    auto last_sample = tempo_map.sample_for_tick(events.ticks.back());
+    _block_peaks.assign(static_cast<std::size_t>(last_sample / block_frames) + 1, 0);
+
+    auto channels = std::array<Channel_notes, 16>{};
+    auto sounding = std::uint16_t{0};
+    auto cursor = Tempo_map::Cursor{tempo_map};
+    auto block = std::size_t{0};
+
+    for (auto i = std::size_t{0}; i < events.size();) {
+        auto tick = events.ticks[i];
+        auto event_block = static_cast<std::size_t>(cursor.sample_for_tick(tick) / block_frames);
+        // whatever sounded after the last tick carried on through every block up to this one
+        for (; block < event_block; ++block) {
+            _block_peaks[block + 1] = std::max(_block_peaks[block + 1], sounding);
+        }
+
+        // a note off and a note on sharing a tick hand over a voice, so the counts are only taken once the tick is done
+        auto touched = std::uint16_t{0};
+        for (; i < events.size() && events.ticks[i] == tick; ++i) {
+            auto status = events.status[i];
+            if (!midi::is_channel_status(status)) { continue; }
+
+            auto &channel = channels[status & 0x0F];
+            sounding -= channel.sounding;
+            channel.apply(status, events.data_1[i], events.data_2[i]);
+            sounding += channel.sounding;
+            touched |= 1 << (status & 0x0F);
+        }
+        for (auto c = std::size_t{0}; c < channels.size(); ++c) {
+            if (touched & (1 << c)) {
+                _channel_peaks[c] = std::max(_channel_peaks[c], channels[c].sounding);
+            }
+        }
+        _block_peaks[block] = std::max(_block_peaks[block], sounding);
+        _peak = std::max(_peak, sounding);
+    }
+}
+
+std::vector<Polyphony_profile::Section> Polyphony_profile::sections_over(std::uint16_t budget) const
+{
+    auto sections = std::vector<Section>{};
+    for (auto block = std::size_t{0}; block < _block_peaks.size(); ++block) {
+        if (_block_peaks[block] <= budget) { continue; }
+
+        if (!sections.empty() && sections.back().end_block == block) {
+            sections.back().end_block = block + 1;
+            sections.back().peak = std::max(sections.back().peak, _block_peaks[block]);
+        } else {
+            sections.push_back(Section{block, block + 1, _block_peaks[block]});
+        }
+    }
+    return sections;
+}
@@ -0,0 +1,53 @@
+#ifndef CORE_MIDI_GEN2_POLYPHONY_PROFILE_H
+#define CORE_MIDI_GEN2_POLYPHONY_PROFILE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Tempo_map.h"
+#include "Track_merger.h"
+
+// how many notes a merged timeline has sounding at once, per channel and per render block, from one pass at load time
+// a note sounds from its note on until its note off, or until the pedal comes up when the note off
+// arrives with the sustain pedal (CC 64) down, all notes off and all sound off end a channel's notes
+// release tails aren't counted, they depend on the bank
+// lets the renderer size its voice state before rendering and see where a voice budget will be exceeded
+class Polyphony_profile {
+public:
+    // a run of blocks [first_block, end_block) with more voices than the budget
+    struct Section {
+        std::size_t first_block;
+        std::size_t end_block;
+        std::uint16_t peak;
+    };
+
+private:
+    std::uint32_t _block_frames = 0;
+    std::array<std::uint16_t, 16> _channel_peaks;
+    std::uint16_t _peak = 0;
+    // the most notes sounding at once within each block
+    std::vector<std::uint16_t> _block_peaks;
+
+public:
+    Polyphony_profile() { _channel_peaks.fill(0); }
+
+    // blocks are block_frames samples of the tempo map's clock, counted from sample 0
+    Polyphony_profile(const Merged_timeline &timeline, const Tempo_map &tempo_map, std::uint32_t block_frames);
+
+    ~Polyphony_profile() = default;
+
+    std::uint16_t peak() const { return _peak; }
+
+    std::uint16_t channel_peak(std::size_t channel) const { return _channel_peaks[channel]; }
+
+    std::uint32_t block_frames() const { return _block_frames; }
+
+    const std::vector<std::uint16_t> &block_peaks() const { return _block_peaks; }
+
+    // the sections over budget, in order
+    std::vector<Section> sections_over(std::uint16_t budget) const;
+};
+
+#endif //CORE_MIDI_GEN2_POLYPHONY_PROFILE_H
@@ -0,0 +1,71 @@
+#include "Render_stats.h"
+
+// initialize static variables
+const char *const Render_stats::_stage_names[Render_stats::_num_stages] = {"sequence", "render", "write"};
+
+Render_stats::Render_stats(double srate)
+        : _srate{srate}
+{
+    _stage_times.fill(Clock::duration::zero());
+}
+
+void Render_stats::start()
+{
+    _start = Clock::now();
+    _mark = _start;
+}
+
+void Render_stats::end_stage(Stage stage)
+{
+    auto now = Clock::now();
+    _stage_times[static_cast<std::size_t>(stage)] += now - _mark;
+    _mark = now;
+}
+
+void Render_stats::end_block(std::uint32_t frames)
+{
+    ++_blocks;
+    _frames += frames;
+}
+
+void Render_stats::finish()
+{
+    _total = Clock::now() - _start;
+}
+
+double Render_stats::realtime_factor() const
+{
+    auto wall = wall_seconds();
+    return (wall > 0.) ? audio_seconds() / wall : 0.;
+}
+
+double Render_stats::blocks_per_sec() const
+{
+    auto wall = wall_seconds();
+    return (wall > 0.) ? _blocks / wall : 0.;
+}
+
+void Render_stats::print(FILE *file) const
+{
+    fprintf(file, "rendered %.2f s of audio in %.3f s: %.1fx realtime, %lu blocks, %.0f blocks/s\n",
+            audio_seconds(), wall_seconds(), realtime_factor(), static_cast<unsigned long>(_blocks), blocks_per_sec());
+
+    auto wall = wall_seconds();
+    auto other = _total;
+    for (auto i = std::size_t{0}; i < _num_stages; ++i) {
+        other -= _stage_times[i];
+    }
+
+    auto print_stage = [&](const char *name, Clock::duration time) {
+        auto seconds = std::chrono::duration<double>(time).count();
+        fprintf(file, "\t%-10s %10.3f s %6.1f%% %10.2f us/block\n",
+                name,
+                seconds,
+                (wall > 0.) ? 100. * seconds / wall : 0.,
+                _blocks ? 1000000. * seconds / _blocks : 0.);
+    };
+    for (auto i = std::size_t{0}; i < _num_stages; ++i) {
+        print_stage(_stage_names[i], _stage_times[i]);
+    }
+    print_stage("other", other);
+}
@@ -0,0 +1,64 @@
+#ifndef CORE_MIDI_GEN2_RENDER_STATS_H
+#define CORE_MIDI_GEN2_RENDER_STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// wall time of an offline render, split by stage, and how far ahead of real time it ran
+// the render loop marks the end of each stage, whatever isn't charged to a stage shows up as other
+class Render_stats {
+public:
+    enum class Stage {
+        sequence,
+        render,
+        write
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+private:
+    static const std::size_t _num_stages = 3;
+    static const char *const _stage_names[_num_stages];
+
+    double _srate;
+    std::array<Clock::duration, _num_stages> _stage_times;
+    Clock::time_point _start;
+    Clock::time_point _mark;
+    Clock::duration _total = Clock::duration::zero();
+    std::uint64_t _blocks = 0;
+    std::uint64_t _frames = 0;
+
+public:
+    explicit Render_stats(double srate);
+
+    ~Render_stats() = default;
+
+    // starts the wall clock and the first stage
+    void start();
+
+    // charges the time since the last mark to the stage
+    void end_stage(Stage stage);
+
+    void end_block(std::uint32_t frames);
+
+    // stops the wall clock
+    void finish();
+
+    double audio_seconds() const { return _frames / _srate; }
+
+    double wall_seconds() const { return std::chrono::duration<double>(_total).count(); }
+
+    // wall time so far, while still rendering
+    double elapsed_seconds() const { return std::chrono::duration<double>(Clock::now() - _start).count(); }
+
+    // seconds of audio per second of wall time, what the render fleet is sized on
+    double realtime_factor() const;
+
+    double blocks_per_sec() const;
+
+    void print(FILE *file) const;
+};
+
+#endif //CORE_MIDI_GEN2_RENDER_STATS_H
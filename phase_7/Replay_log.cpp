@@ -0,0 +1,185 @@
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include "Midi_sequence.h"
+#include "Replay_log.h"
+
+namespace {
+    const char replay_magic[8] = {'C', 'M', 'G', 'R', 'E', 'P', 'L', 'Y'};
+    const std::uint32_t replay_version = 1;
+    const std::uint32_t replay_byte_order = 0x01020304;
+}
+
+// initialize static variable
+const std::size_t Replay_log_writer::_flush_size = 1 << 16;
+
+Replay_log_writer::~Replay_log_writer()
+{
+    if (_file) {
+        fclose(_file);
+    }
+}
+
+void Replay_log_writer::open(const std::string &path, std::uint32_t srate, std::uint32_t block_frames, Event_sink &downstream)
+{
+    _file = fopen(path.c_str(), "wb");
+    if (!_file) {
+        throw std::system_error{errno, std::generic_category(), "fopen: " + path};
+    }
+    _path = path;
+    _downstream = &downstream;
+    _block = 0;
+    _last_block = 0;
+
+    _header = Replay_log_header{};
+    std::memcpy(_header.magic, replay_magic, sizeof(replay_magic));
+    _header.version = replay_version;
+    _header.byte_order = replay_byte_order;
+    _header.srate = srate;
+    _header.block_frames = block_frames;
+
+    // the totals are filled in by close
+    _buffer.reserve(_flush_size + 64);
+    auto bytes = reinterpret_cast<const std::uint8_t *>(&_header);
+    _buffer.assign(bytes, bytes + sizeof(_header));
+    _size = 0;
+}
+
+void Replay_log_writer::channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset)
+{
+    _downstream->channel_event(status, data_1, data_2, offset);
+
+    _begin_record(status, offset);
+    _buffer.push_back(data_1);
+    if (midi::channel_data_length(status) == 2) {
+        _buffer.push_back(data_2);
+    }
+    if (_buffer.size() >= _flush_size) { _flush(); }
+}
+
+void Replay_log_writer::sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset)
+{
+    _downstream->sysex(status, payload, length, offset);
+
+    _begin_record(status, offset);
+    _put_vlq(length);
+    _buffer.insert(_buffer.end(), payload, payload + length);
+    if (_buffer.size() >= _flush_size) { _flush(); }
+}
+
+void Replay_log_writer::close()
+{
+    _flush();
+    _header.file_size = _size;
+    _header.block_count = _block;
+
+    auto did_write = fseek(_file, 0, SEEK_SET) == 0 && fwrite(&_header, sizeof(_header), 1, _file) == 1;
+    auto did_close = fclose(_file) == 0;
+    _file = nullptr;
+    if (!did_write || !did_close) {
+        throw std::system_error{errno, std::generic_category(), "write: " + _path};
+    }
+}
+
+void Replay_log_writer::_put_vlq(std::uint64_t value)
+{
+    // LEB128, low 7 bits first, blocks and offsets are mostly a single byte
+    while (value >= 0x80) {
+        _buffer.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    _buffer.push_back(static_cast<std::uint8_t>(value));
+}
+
+void Replay_log_writer::_begin_record(std::uint8_t status, std::uint32_t offset)
+{
+    _put_vlq(_block - _last_block);
+    _last_block = _block;
+    _put_vlq(offset);
+    _buffer.push_back(status);
+    ++_header.event_count;
+}
+
+void Replay_log_writer::_flush()
+{
+    if (_buffer.empty()) { return; }
+    if (fwrite(_buffer.data(), 1, _buffer.size(), _file) != _buffer.size()) {
+        throw std::system_error{errno, std::generic_category(), "write: " + _path};
+    }
+    _size += _buffer.size();
+    _buffer.clear();
+}
+
+Replay_log_reader::Replay_log_reader(const std::string &path)
+        : _file{path}
+{
+    if (_file.size() < sizeof(_header)) {
+        throw bad_replay_log{"not a replay log: " + path};
+    }
+    std::memcpy(&_header, _file.data(), sizeof(_header));
+    if (std::memcmp(_header.magic, replay_magic, sizeof(replay_magic)) != 0 || _header.byte_order != replay_byte_order) {
+        throw bad_replay_log{"not a replay log: " + path};
+    }
+    if (_header.version != replay_version) {
+        throw bad_replay_log{"unsupported replay log version: " + path};
+    }
+    if (_header.file_size != _file.size()) {
+        throw bad_replay_log{"incomplete replay log: " + path};
+    }
+
+    _position = _file.data() + sizeof(_header);
+    _read_record_head();
+}
+
+void Replay_log_reader::deliver_block(Event_sink &sink)
+{
+    while (_has_record && _record_block == _block) {
+        if (midi::is_channel_status(_record_status)) {
+            auto length = midi::channel_data_length(_record_status);
+            if (_file.end() - _position < length) {
+                throw bad_replay_log{"truncated event: " + _file.path()};
+            }
+            sink.channel_event(_record_status, _position[0], (length == 2) ? _position[1] : 0, _record_offset);
+            _position += length;
+        } else if (_record_status == midi::sysex || _record_status == midi::sysex_escape) {
+            auto length = _read_vlq();
+            if (static_cast<std::uint64_t>(_file.end() - _position) < length) {
+                throw bad_replay_log{"truncated sysex: " + _file.path()};
+            }
+            sink.sysex(_record_status, _position, static_cast<std::uint32_t>(length), _record_offset);
+            _position += length;
+        } else {
+            throw bad_replay_log{"bad status byte: " + _file.path()};
+        }
+        _read_record_head();
+    }
+    ++_block;
+}
+
+std::uint64_t Replay_log_reader::_read_vlq()
+{
+    auto value = std::uint64_t{0};
+    for (auto shift = 0; shift < 64; shift += 7) {
+        if (_position == _file.end()) {
+            throw bad_replay_log{"truncated number: " + _file.path()};
+        }
+        auto byte = *_position++;
+        value |= std::uint64_t{byte & 0x7Fu} << shift;
+        if (!(byte & 0x80)) { return value; }
+    }
+    throw bad_replay_log{"number longer than 64 bits: " + _file.path()};
+}
+
+void Replay_log_reader::_read_record_head()
+{
+    _has_record = _position != _file.end();
+    if (!_has_record) { return; }
+
+    _record_block += _read_vlq();
+    _record_offset = static_cast<std::uint32_t>(_read_vlq());
+    if (_position == _file.end()) {
+        throw bad_replay_log{"truncated event: " + _file.path()};
+    }
+    _record_status = *_position++;
+}
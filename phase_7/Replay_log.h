@@ -0,0 +1,123 @@
+#ifndef CORE_MIDI_GEN2_REPLAY_LOG_H
+#define CORE_MIDI_GEN2_REPLAY_LOG_H
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Mapped_file.h"
+#include "Sequencer.h"
+
+class bad_replay_log : public std::runtime_error {
+public:
+    explicit bad_replay_log(const std::string &what) : std::runtime_error{what} {}
+};
+
+// exactly what an offline render handed the synth, block by block, so it can be played back without the SMF
+// a fixed header in host byte order (rewritten with the totals when the log is closed), then one record per event:
+// blocks since the previous record and the sample offset as LEB128, the status byte, then the channel data bytes
+// or a LEB128 length and the sysex payload, with no F0 as in the SMF
+struct Replay_log_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    // 0 until the log is closed, a log cut short by a crash is rejected
+    std::uint64_t file_size;
+    std::uint64_t block_count;
+    std::uint64_t event_count;
+    std::uint32_t srate;
+    std::uint32_t block_frames;
+};
+
+// records every event on its way to the downstream sink, the render loop calls end_block after each block
+// events sent before the first block (a -s chase) are recorded in block 0 at offset 0
+class Replay_log_writer : public Event_sink {
+private:
+    static const std::size_t _flush_size;
+
+    FILE *_file = nullptr;
+    std::string _path;
+    Event_sink *_downstream = nullptr;
+    std::vector<std::uint8_t> _buffer;
+    Replay_log_header _header;
+    std::uint64_t _block = 0;
+    std::uint64_t _last_block = 0;
+    std::uint64_t _size = 0;
+
+public:
+    Replay_log_writer() = default;
+
+    // an unclosed log is left behind incomplete
+    ~Replay_log_writer() override;
+
+    Replay_log_writer(const Replay_log_writer &) = delete;
+
+    Replay_log_writer &operator=(const Replay_log_writer &) = delete;
+
+    // throws std::system_error
+    void open(const std::string &path, std::uint32_t srate, std::uint32_t block_frames, Event_sink &downstream);
+
+    bool is_open() const { return _file != nullptr; }
+
+    void channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset) override;
+
+    void sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset) override;
+
+    void end_block() { ++_block; }
+
+    // writes the totals into the header, throws std::system_error
+    void close();
+
+    std::uint64_t block_count() const { return _block; }
+
+    std::uint64_t event_count() const { return _header.event_count; }
+
+private:
+    void _put_vlq(std::uint64_t value);
+
+    void _begin_record(std::uint8_t status, std::uint32_t offset);
+
+    void _flush();
+};
+
+// plays a replay log back into a sink a block at a time, the sysex payloads point into the mapping
+class Replay_log_reader {
+private:
+    Mapped_file _file;
+    Replay_log_header _header;
+    const std::uint8_t *_position = nullptr;
+    std::uint64_t _block = 0;
+    // the next record, decoded up to its status byte
+    bool _has_record = false;
+    std::uint64_t _record_block = 0;
+    std::uint32_t _record_offset = 0;
+    std::uint8_t _record_status = 0;
+
+public:
+    // throws bad_replay_log or std::system_error
+    explicit Replay_log_reader(const std::string &path);
+
+    ~Replay_log_reader() = default;
+
+    std::uint32_t srate() const { return _header.srate; }
+
+    std::uint32_t block_frames() const { return _header.block_frames; }
+
+    std::uint64_t block_count() const { return _header.block_count; }
+
+    std::uint64_t event_count() const { return _header.event_count; }
+
+    // hands the next block's events to the sink in the order they were recorded, throws bad_replay_log
+    void deliver_block(Event_sink &sink);
+
+    bool is_finished() const { return _block == _header.block_count; }
+
+private:
+    std::uint64_t _read_vlq();
+
+    void _read_record_head();
+};
+
+#endif //CORE_MIDI_GEN2_REPLAY_LOG_H
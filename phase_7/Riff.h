@@ -0,0 +1,88 @@
+#ifndef CORE_MIDI_GEN2_RIFF_H
+#define CORE_MIDI_GEN2_RIFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Sample_bank.h"
+
+// the chunks of a RIFF file (SoundFont 2, DLS), read in place from a mapping
+// everything is little endian and each chunk is padded to an even length
+namespace riff {
+    inline std::uint16_t read_u16(const std::uint8_t *p)
+    {
+        return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    inline std::uint32_t read_u32(const std::uint8_t *p)
+    {
+        return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+               (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+    }
+
+    struct Chunk {
+        const std::uint8_t *id = nullptr;
+        const std::uint8_t *data = nullptr;
+        std::uint32_t size = 0;
+
+        bool is(const char *fourcc) const { return std::memcmp(id, fourcc, 4) == 0; }
+
+        // a RIFF or LIST chunk of the form type, whose chunks follow the type
+        bool is_list(const char *type) const
+        {
+            return (is("RIFF") || is("LIST")) && size >= 4 && std::memcmp(data, type, 4) == 0;
+        }
+
+        const std::uint8_t *end() const { return data + size; }
+    };
+
+    // whether the bytes are a RIFF file of the form type
+    inline bool is_form(const std::uint8_t *begin, std::size_t size, const char *type)
+    {
+        return size >= 12 && std::memcmp(begin, "RIFF", 4) == 0 && std::memcmp(begin + 8, type, 4) == 0;
+    }
+
+    // the chunks one after another from begin to end, throws bad_sound_bank if one runs past end
+    inline std::vector<Chunk> chunks(const std::uint8_t *begin, const std::uint8_t *end)
+    {
+        auto result = std::vector<Chunk>{};
+        auto p = begin;
+        while (end - p >= 8) {
+            auto chunk = Chunk{p, p + 8, read_u32(p + 4)};
+            if (chunk.size > static_cast<std::size_t>(end - chunk.data)) {
+                throw bad_sound_bank{"chunk runs past its parent"};
+            }
+            result.push_back(chunk);
+            p = chunk.data + chunk.size + (chunk.size & 1);
+        }
+        return result;
+    }
+
+    // the chunks of a RIFF or LIST chunk
+    inline std::vector<Chunk> children(const Chunk &list)
+    {
+        return chunks(list.data + 4, list.end());
+    }
+
+    // the first chunk with the id, nullptr if there is none
+    inline const Chunk *find(const std::vector<Chunk> &chunks, const char *id)
+    {
+        for (const auto &chunk : chunks) {
+            if (chunk.is(id)) { return &chunk; }
+        }
+        return nullptr;
+    }
+
+    // the first list of the form type, nullptr if there is none
+    inline const Chunk *find_list(const std::vector<Chunk> &chunks, const char *type)
+    {
+        for (const auto &chunk : chunks) {
+            if (chunk.is_list(type)) { return &chunk; }
+        }
+        return nullptr;
+    }
+}
+
+#endif //CORE_MIDI_GEN2_RIFF_H
@@ -0,0 +1,90 @@
+#ifndef CORE_MIDI_GEN2_SAMPLE_BANK_H
+#define CORE_MIDI_GEN2_SAMPLE_BANK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class bad_sound_bank : public std::runtime_error {
+public:
+    explicit bad_sound_bank(const std::string &what) : std::runtime_error{what} {}
+};
+
+// volume envelope of a region, times in seconds, sustain as a gain (0 - 1)
+struct Envelope {
+    float delay = 0.f;
+    float attack = 0.002f;
+    float hold = 0.f;
+    float decay = 0.f;
+    float sustain = 1.f;
+    float release = 0.1f;
+};
+
+// one mono sample and the notes it plays, as the synth needs it at note on
+// the sample data belongs to the bank (a generated table, a mapped file, a decoded cache) and outlives the synth
+struct Sample_region {
+    std::uint8_t key_low = 0;
+    std::uint8_t key_high = 127;
+    std::uint8_t velocity_low = 0;
+    std::uint8_t velocity_high = 127;
+
+    const std::int16_t *samples = nullptr;
+    std::uint32_t length = 0;
+    // [loop_start, loop_end) repeats while the note is held, when the region loops
+    bool loops = false;
+    std::uint32_t loop_start = 0;
+    std::uint32_t loop_end = 0;
+    std::uint32_t sample_rate = 44100;
+    // where samples start in the bank's file when they are stored there as they play (16 bit mono), -1 otherwise,
+    // what -d streams from
+    std::int64_t file_offset = -1;
+
+    // the key that plays the sample at its own pitch, tuning on top in cents
+    std::uint8_t root_key = 60;
+    float tune_cents = 0.f;
+    // 0 for a key that doesn't follow the keyboard (most drums), 100 cents per key otherwise
+    float key_cents = 100.f;
+    float attenuation_db = 0.f;
+    // -1 left, 1 right
+    float pan = 0.f;
+    // note offs are ignored, the sample plays out (GM drums)
+    bool one_shot = false;
+    // notes in the same non-zero group cut each other off, like an open and a closed hi-hat
+    std::uint32_t exclusive_class = 0;
+    Envelope envelope;
+
+    bool matches(std::uint8_t key, std::uint8_t velocity) const
+    {
+        return key >= key_low && key <= key_high && velocity >= velocity_low && velocity <= velocity_high;
+    }
+};
+
+// what a program change selects, a note on plays every region that matches it (layers, stereo pairs)
+struct Bank_preset {
+    std::vector<Sample_region> regions;
+};
+
+// instruments for the native synth, looked up once per program change rather than per note
+// bank 128 is the percussion bank, as SoundFont and DLS number it
+class Sample_bank {
+public:
+    static const std::uint16_t percussion_bank = 128;
+
+    virtual ~Sample_bank() = default;
+
+    // nullptr when the bank has no such preset
+    virtual const Bank_preset *preset(std::uint16_t bank, std::uint8_t program) const = 0;
+
+    // falls back to bank 0 (or the standard kit for percussion), as GM synths do
+    const Bank_preset *find_preset(std::uint16_t bank, std::uint8_t program) const
+    {
+        auto found = preset(bank, program);
+        if (!found && bank == percussion_bank) { found = preset(percussion_bank, 0); }
+        if (!found && bank != percussion_bank) { found = preset(0, program); }
+        return found;
+    }
+};
+
+#endif //CORE_MIDI_GEN2_SAMPLE_BANK_H
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Seek_index.h"
+#include "Wavetable_synth.h"
+
+// initialize static variables
+const std::uint8_t Channel_state::unset;
+const std::uint16_t Channel_state::unset_bend;
+const std::size_t Channel_state::num_rpns;
+const double Seek_index::default_interval_beats = 8.;
+
+namespace {
+    const std::uint8_t cc_bank_select = 0;
+    const std::uint8_t cc_modulation = 1;
+    const std::uint8_t cc_data_entry = 6;
+    const std::uint8_t cc_expression = 11;
+    const std::uint8_t cc_bank_select_lsb = 32;
+    const std::uint8_t cc_data_entry_lsb = 38;
+    const std::uint8_t cc_sustain = 64;
+    const std::uint8_t cc_soft_pedal = 67;
+    const std::uint8_t cc_nrpn_lsb = 98;
+    const std::uint8_t cc_nrpn_msb = 99;
+    const std::uint8_t cc_rpn_lsb = 100;
+    const std::uint8_t cc_rpn_msb = 101;
+    // 120 and up are channel mode messages, they carry no state worth chasing
+    const std::uint8_t cc_reset_all_controllers = 121;
+    const std::uint8_t first_channel_mode = 120;
+    // the null RPN, deselects any parameter
+    const std::uint8_t rpn_null = 127;
+}
+
+Channel_state::Channel_state()
+{
+    controllers.fill(unset);
+    for (auto &value : rpn_values) {
+        value.fill(unset);
+    }
+}
+
+void Channel_state::apply(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2)
+{
+    switch (status & 0xF0) {
+        case 0xB0:
+            _apply_controller(data_1, data_2);
+            break;
+        case 0xC0:
+            program = data_1;
+            break;
+        case 0xD0:
+            pressure = data_1;
+            break;
+        case 0xE0:
+            pitch_bend = static_cast<std::uint16_t>(data_1 | (data_2 << 7));
+            break;
+        default:
+            // notes and poly pressure end with the note
+            break;
+    }
+}
+
+void Channel_state::_apply_controller(std::uint8_t controller, std::uint8_t value)
+{
+    switch (controller) {
+        case cc_rpn_msb:
+            rpn_msb = value;
+            break;
+        case cc_rpn_lsb:
+            rpn_lsb = value;
+            break;
+        case cc_nrpn_msb:
+        case cc_nrpn_lsb:
+            // data entry now goes to an NRPN, which isn't chased
+            rpn_msb = rpn_null;
+            rpn_lsb = rpn_null;
+            break;
+        case cc_data_entry:
+        case cc_data_entry_lsb:
+            if (rpn_msb == 0 && rpn_lsb < num_rpns) {
+                rpn_values[rpn_lsb][controller == cc_data_entry ? 0 : 1] = value;
+            }
+            break;
+        case cc_reset_all_controllers:
+            // what RP-015 resets, volume, pan, bank and program are kept
+            controllers[cc_modulation] = unset;
+            controllers[cc_expression] = unset;
+            std::fill(controllers.begin() + cc_sustain, controllers.begin() + cc_soft_pedal + 1, unset);
+            rpn_msb = unset;
+            rpn_lsb = unset;
+            pitch_bend = unset_bend;
+            pressure = unset;
+            break;
+        default:
+            if (controller < first_channel_mode) {
+                controllers[controller] = value;
+            }
+            break;
+    }
+}
+
+Seek_index::Seek_index(const Midi_sequence &sequence, const Merged_timeline &timeline, double interval_beats)
+        : _events{timeline.events},
+          _sequence{&sequence},
+          _interval{static_cast<std::uint32_t>(std::max(1l, std::lround(interval_beats * sequence.ticks_per_quarter())))}
+{
+    for (auto i = std::size_t{0}; i < _events.size(); ++i) {
+        if (_events.status[i] == midi::sysex || _events.status[i] == midi::sysex_escape) {
+            _sysex_positions.push_back(i);
+        }
+    }
+
+    // one pass, copying the running state out at the boundary of each interval an event falls in,
+    // an interval without events has the state of the snapshot before it, so a long silence costs nothing
+    auto state = Seek_state{};
+    _snapshots.push_back(state);
+    for (auto i = std::size_t{0}; i < _events.size(); ++i) {
+        auto boundary = _events.ticks[i] / _interval * _interval;
+        if (boundary > _snapshots.back().tick) {
+            state.tick = boundary;
+            state.position = i;
+            _snapshots.push_back(state);
+        }
+        _apply(state, i);
+    }
+}
+
+void Seek_index::_apply(Seek_state &state, std::size_t i) const
+{
+    auto status = _events.status[i];
+    if (midi::is_channel_status(status)) {
+        state.channels[status & 0x0F].apply(status, _events.data_1[i], _events.data_2[i]);
+    } else if (status == midi::meta && _events.data_1[i] == midi::meta_tempo && _sequence->payload_length(_events, i) >= 3) {
+        auto payload = _sequence->payload(_events, i);
+        auto usec_per_quarter = static_cast<std::uint32_t>((payload[0] << 16) | (payload[1] << 8) | payload[2]);
+        if (usec_per_quarter != 0) {
+            state.usec_per_quarter = usec_per_quarter;
+        }
+    } else if (Wavetable_synth::is_system_on(status, _sequence->payload(_events, i), _sequence->payload_length(_events, i))) {
+        // the chase replays the sysex before the messages, so what was set before a GM system on
+        // must not be sent after it, every channel is back to the synth's defaults
+        state.channels.fill(Channel_state{});
+    }
+}
+
+Seek_state Seek_index::state_at(std::uint32_t tick) const
+{
+    if (_snapshots.empty()) {
+        auto state = Seek_state{};
+        state.tick = tick;
+        return state;
+    }
+
+    // the last snapshot at or before the tick, the first one is at tick 0
+    auto snapshot = std::upper_bound(_snapshots.begin(), _snapshots.end(), tick, [](std::uint32_t target, const Seek_state &state) {
+        return target < state.tick;
+    });
+    auto state = *(snapshot - 1);
+    auto i = state.position;
+    for (; i < _events.size() && _events.ticks[i] < tick; ++i) {
+        _apply(state, i);
+    }
+    state.tick = tick;
+    state.position = i;
+    return state;
+}
+
+Array_view<std::size_t> Seek_index::sysex_before(const Seek_state &state) const
+{
+    auto end = std::lower_bound(_sysex_positions.begin(), _sysex_positions.end(), state.position);
+    return Array_view<std::size_t>{_sysex_positions.data(), static_cast<std::size_t>(end - _sysex_positions.begin())};
+}
+
+std::vector<Chase_message> Seek_index::messages(const Seek_state &state)
+{
+    auto messages = std::vector<Chase_message>{};
+    for (auto channel = 0; channel < 16; ++channel) {
+        const auto &channel_state = state.channels[channel];
+        auto control = static_cast<std::uint8_t>(0xB0 | channel);
+        auto push_controller = [&](std::uint8_t controller, std::uint8_t value) {
+            messages.push_back(Chase_message{control, controller, value});
+        };
+
+        const auto &controllers = channel_state.controllers;
+        if (controllers[cc_bank_select] != Channel_state::unset) {
+            push_controller(cc_bank_select, controllers[cc_bank_select]);
+        }
+        if (controllers[cc_bank_select_lsb] != Channel_state::unset) {
+            push_controller(cc_bank_select_lsb, controllers[cc_bank_select_lsb]);
+        }
+        if (channel_state.program != Channel_state::unset) {
+            messages.push_back(Chase_message{static_cast<std::uint8_t>(0xC0 | channel), channel_state.program, 0});
+        }
+
+        for (auto controller = std::uint8_t{1}; controller < first_channel_mode; ++controller) {
+            if (controller != cc_bank_select_lsb && controllers[controller] != Channel_state::unset) {
+                push_controller(controller, controllers[controller]);
+            }
+        }
+
+        auto did_select = false;
+        for (auto rpn = std::size_t{0}; rpn < Channel_state::num_rpns; ++rpn) {
+            const auto &value = channel_state.rpn_values[rpn];
+            if (value[0] == Channel_state::unset && value[1] == Channel_state::unset) { continue; }
+
+            push_controller(cc_rpn_msb, 0);
+            push_controller(cc_rpn_lsb, static_cast<std::uint8_t>(rpn));
+            if (value[0] != Channel_state::unset) { push_controller(cc_data_entry, value[0]); }
+            if (value[1] != Channel_state::unset) { push_controller(cc_data_entry_lsb, value[1]); }
+            did_select = true;
+        }
+        // leave the selection as the file had it, or deselected so stray data entry does nothing
+        if (did_select || channel_state.rpn_msb != Channel_state::unset) {
+            auto is_set = channel_state.rpn_msb != Channel_state::unset && channel_state.rpn_lsb != Channel_state::unset;
+            push_controller(cc_rpn_msb, is_set ? channel_state.rpn_msb : rpn_null);
+            push_controller(cc_rpn_lsb, is_set ? channel_state.rpn_lsb : rpn_null);
+        }
+
+        if (channel_state.pitch_bend != Channel_state::unset_bend) {
+            messages.push_back(Chase_message{
+                    static_cast<std::uint8_t>(0xE0 | channel),
+                    static_cast<std::uint8_t>(channel_state.pitch_bend & 0x7F),
+                    static_cast<std::uint8_t>(channel_state.pitch_bend >> 7)
+            });
+        }
+        if (channel_state.pressure != Channel_state::unset) {
+            messages.push_back(Chase_message{static_cast<std::uint8_t>(0xD0 | channel), channel_state.pressure, 0});
+        }
+    }
+    return messages;
+}
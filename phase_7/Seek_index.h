@@ -0,0 +1,92 @@
+#ifndef CORE_MIDI_GEN2_SEEK_INDEX_H
+#define CORE_MIDI_GEN2_SEEK_INDEX_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Array_view.h"
+#include "Midi_sequence.h"
+#include "Track_merger.h"
+
+// everything about one channel that outlives the event that set it
+// 0xFF (0xFFFF for the bend) means the file never set it, or not since a GM system on, so the synth default stands
+struct Channel_state {
+    static const std::uint8_t unset = 0xFF;
+    static const std::uint16_t unset_bend = 0xFFFF;
+    // registered parameters chased through data entry: bend range, fine and coarse tuning
+    static const std::size_t num_rpns = 3;
+
+    std::array<std::uint8_t, 128> controllers;
+    std::uint8_t program = unset;
+    std::uint8_t pressure = unset;
+    std::uint16_t pitch_bend = unset_bend;
+    // current CC 101/100 selection
+    std::uint8_t rpn_msb = unset;
+    std::uint8_t rpn_lsb = unset;
+    // data entry MSB/LSB per registered parameter
+    std::array<std::array<std::uint8_t, 2>, num_rpns> rpn_values;
+
+    Channel_state();
+
+    void apply(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2);
+
+private:
+    void _apply_controller(std::uint8_t controller, std::uint8_t value);
+};
+
+// the chased state just before a tick, position is the first timeline event at or after it
+struct Seek_state {
+    std::uint32_t tick = 0;
+    std::size_t position = 0;
+    std::uint32_t usec_per_quarter = midi::default_usec_per_quarter;
+    std::array<Channel_state, 16> channels;
+};
+
+struct Chase_message {
+    std::uint8_t status;
+    std::uint8_t data_1;
+    std::uint8_t data_2;
+};
+
+// full channel-state snapshots of a merged timeline at the start of every interval (of interval ticks) with events in it,
+// built in one pass at load time
+// a seek restores the snapshot at or before the target and replays at most one interval of events,
+// instead of chasing from the start of the file
+class Seek_index {
+private:
+    Midi_track _events;
+    const Midi_sequence *_sequence = nullptr;
+    std::uint32_t _interval = 1;
+    // in tick order, the first at tick 0, then one per interval that has events
+    std::vector<Seek_state> _snapshots;
+    // timeline positions of the sysex events, which are replayed as they are rather than snapshotted
+    std::vector<std::size_t> _sysex_positions;
+
+public:
+    static const double default_interval_beats;
+
+    Seek_index() = default;
+
+    // the sequence and the timeline's events must stay alive as long as the index
+    Seek_index(const Midi_sequence &sequence, const Merged_timeline &timeline, double interval_beats = default_interval_beats);
+
+    ~Seek_index() = default;
+
+    Seek_state state_at(std::uint32_t tick) const;
+
+    // timeline positions of the sysex events before the state's position, in order
+    Array_view<std::size_t> sysex_before(const Seek_state &state) const;
+
+    // messages that put a freshly reset synth into the state: bank select before program change,
+    // then controllers, registered parameters, pitch bend and pressure
+    static std::vector<Chase_message> messages(const Seek_state &state);
+
+    std::size_t size() const { return _snapshots.size(); }
+
+private:
+    void _apply(Seek_state &state, std::size_t i) const;
+};
+
+#endif //CORE_MIDI_GEN2_SEEK_INDEX_H
@@ -0,0 +1,329 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Sequence_cache.h"
+
+// initialize static variables
+const char Sequence_cache::_magic[8] = {'C', 'M', 'G', 'C', 'A', 'C', 'H', 'E'};
+const std::uint32_t Sequence_cache::_version = 2;
+const std::uint32_t Sequence_cache::_byte_order = 0x01020304;
+
+namespace {
+    // appends arrays to the cache image at 8 byte alignment
+    class Image_writer {
+    private:
+        std::vector<std::uint8_t> _image;
+
+    public:
+        explicit Image_writer(std::size_t reserved) : _image(reserved) {}
+
+        template<typename T>
+        std::pair<std::uint64_t, std::uint64_t> append(const T *data, std::size_t count)
+        {
+            _image.resize((_image.size() + 7) & ~std::size_t{7});
+            auto offset = _image.size();
+            auto bytes = reinterpret_cast<const std::uint8_t *>(data);
+            _image.insert(_image.end(), bytes, bytes + count * sizeof(T));
+            return {offset, count};
+        }
+
+        std::vector<std::uint8_t> &image() { return _image; }
+    };
+
+    const std::int64_t ns_per_second = 1000000000;
+
+    // nanoseconds since the epoch, as fine as the file system keeps them
+    bool stat_file(const std::string &path, std::uint64_t &size, std::int64_t &mtime)
+    {
+        struct stat info{};
+        if (stat(path.c_str(), &info) != 0) { return false; }
+        size = static_cast<std::uint64_t>(info.st_size);
+#ifdef __APPLE__
+        const auto &time = info.st_mtimespec;
+#else
+        const auto &time = info.st_mtim;
+#endif
+        mtime = static_cast<std::int64_t>(time.tv_sec) * ns_per_second + time.tv_nsec;
+        return true;
+    }
+}
+
+Sequence_cache::Sequence_cache(const std::string &source_path, Smf_track_mode mode)
+        : _source_path{source_path},
+          _cache_path{path_for(source_path)},
+          _mode{mode} {}
+
+std::uint64_t Sequence_cache::hash_bytes(const std::uint8_t *data, std::size_t size)
+{
+    auto hash = std::uint64_t{0xCBF29CE484222325} ^ size;
+    auto mix = [&hash](std::uint64_t word) {
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15;
+        hash ^= hash >> 29;
+    };
+
+    auto i = std::size_t{0};
+    for (; i + 8 <= size; i += 8) {
+        auto word = std::uint64_t{};
+        std::memcpy(&word, data + i, sizeof(word));
+        mix(word);
+    }
+    auto tail = std::uint64_t{0};
+    std::memcpy(&tail, data + i, size - i);
+    mix(tail);
+    return hash;
+}
+
+template<typename T>
+bool Sequence_cache::_is_valid(const Section &section) const
+{
+    auto size = _mapping->size();
+    return section.offset % alignof(T) == 0 &&
+           section.offset <= size &&
+           section.count <= (size - section.offset) / sizeof(T);
+}
+
+bool Sequence_cache::_is_valid(const Track_entry &entry) const
+{
+    // only the sections, the payload ranges are clamped to the arena where they are read
+    auto count = entry.ticks.count;
+    return _is_valid<std::uint32_t>(entry.ticks) &&
+           _is_valid<std::uint8_t>(entry.status) && entry.status.count == count &&
+           _is_valid<std::uint8_t>(entry.data_1) && entry.data_1.count == count &&
+           _is_valid<std::uint8_t>(entry.data_2) && entry.data_2.count == count &&
+           _is_valid<std::uint32_t>(entry.payload_offset) && entry.payload_offset.count == count &&
+           _is_valid<std::uint32_t>(entry.payload_length) && entry.payload_length.count == count;
+}
+
+bool Sequence_cache::is_fresh()
+{
+    auto source_size = std::uint64_t{};
+    auto source_mtime = std::int64_t{};
+    auto cache_size = std::uint64_t{};
+    auto cache_mtime = std::int64_t{};
+    if (!stat_file(_source_path, source_size, source_mtime) ||
+        !stat_file(_cache_path, cache_size, cache_mtime)) {
+        return false;
+    }
+
+    try {
+        _mapping = std::make_shared<const Mapped_file>(_cache_path);
+    } catch (const std::system_error &) {
+        // no cache yet
+        return false;
+    }
+
+    if (_mapping->size() < sizeof(Header)) { return false; }
+    _header = reinterpret_cast<const Header *>(_mapping->data());
+
+    if (std::memcmp(_header->magic, _magic, sizeof(_magic)) != 0 ||
+        _header->version != _version ||
+        _header->byte_order != _byte_order ||
+        _header->file_size != _mapping->size() ||
+        _header->track_mode != static_cast<std::uint32_t>(_mode) ||
+        _header->source_size != source_size) {
+        return false;
+    }
+
+    // a touched but unchanged file (checkout, copy) is still fresh, only then is the source read
+    // a source modified in the second the cache was written is read too, as with whole second
+    // mtimes a same size edit in that second would look untouched
+    auto is_touched = (_header->source_mtime != source_mtime) ||
+                      (source_mtime / ns_per_second >= cache_mtime / ns_per_second);
+    if (is_touched) {
+        Mapped_file source{_source_path};
+        if (hash_bytes(source.data(), source.size()) != _header->source_hash) { return false; }
+    }
+
+    if (!_is_valid<Track_entry>(_header->tracks) || _header->tracks.count == 0 ||
+        !_is_valid<std::uint8_t>(_header->payloads) ||
+        !_is_valid<Tempo_change>(_header->tempo_changes) ||
+        !_is_valid<std::uint8_t>(_header->enabled) ||
+        !_is_valid(_header->timeline) ||
+        !_is_valid<std::uint16_t>(_header->timeline_sources) ||
+        _header->timeline_sources.count != _header->timeline.ticks.count) {
+        return false;
+    }
+
+    for (const auto &entry : _view<Track_entry>(_header->tracks)) {
+        if (!_is_valid(entry)) { return false; }
+    }
+
+    if (is_touched) {
+        _refresh_mtime(source_mtime);
+    }
+    return true;
+}
+
+void Sequence_cache::_refresh_mtime(std::int64_t source_mtime) const
+{
+    // so the next load takes the size and mtime check again instead of hashing the source,
+    // the mapping is private and read only, so the field is written through the file
+    // the write also moves the cache's own mtime past the source's second, once that second is over
+    // a cache that can't be written (read-only directory) is just hashed again next time
+    auto fd = open(_cache_path.c_str(), O_WRONLY);
+    if (fd < 0) { return; }
+    pwrite(fd, &source_mtime, sizeof(source_mtime), offsetof(Header, source_mtime));
+    close(fd);
+}
+
+Midi_track Sequence_cache::_track(const Track_entry &entry) const
+{
+    auto track = Midi_track{};
+    track.ticks = _view<std::uint32_t>(entry.ticks);
+    track.status = _view<std::uint8_t>(entry.status);
+    track.data_1 = _view<std::uint8_t>(entry.data_1);
+    track.data_2 = _view<std::uint8_t>(entry.data_2);
+    track.payload_offset = _view<std::uint32_t>(entry.payload_offset);
+    track.payload_length = _view<std::uint32_t>(entry.payload_length);
+    track.end_tick = entry.end_tick;
+    return track;
+}
+
+Midi_sequence Sequence_cache::sequence() const
+{
+    auto sequence = Midi_sequence{};
+    sequence.format = _header->format;
+    sequence.division = _header->division;
+
+    auto entries = _view<Track_entry>(_header->tracks);
+    sequence.tempo_track = _track(entries[0]);
+    sequence.tracks.reserve(entries.size() - 1);
+    for (auto i = std::size_t{1}; i < entries.size(); ++i) {
+        sequence.tracks.push_back(_track(entries[i]));
+    }
+
+    sequence.payload_arena = _mapping->data() + _header->payloads.offset;
+    sequence.payload_arena_size = static_cast<std::size_t>(_header->payloads.count);
+    sequence.source = _mapping;
+    return sequence;
+}
+
+Array_view<Tempo_change> Sequence_cache::tempo_changes() const
+{
+    return _view<Tempo_change>(_header->tempo_changes);
+}
+
+bool Sequence_cache::has_timeline(const std::vector<bool> &enabled) const
+{
+    auto stored = _view<std::uint8_t>(_header->enabled);
+    if (stored.size() != enabled.size()) { return false; }
+    for (auto i = std::size_t{0}; i < enabled.size(); ++i) {
+        if ((stored[i] != 0) != enabled[i]) { return false; }
+    }
+    return true;
+}
+
+Merged_timeline Sequence_cache::timeline() const
+{
+    return Merged_timeline{_track(_header->timeline), _view<std::uint16_t>(_header->timeline_sources)};
+}
+
+void Sequence_cache::write(
+        const Midi_sequence &sequence,
+        const Merged_timeline &timeline,
+        const std::vector<bool> &enabled
+) const
+{
+    auto header = Header{};
+    std::memcpy(header.magic, _magic, sizeof(_magic));
+    header.version = _version;
+    header.byte_order = _byte_order;
+    header.format = sequence.format;
+    header.division = sequence.division;
+    header.track_mode = static_cast<std::uint32_t>(_mode);
+    if (!stat_file(_source_path, header.source_size, header.source_mtime)) {
+        throw std::system_error{errno, std::generic_category(), "stat: " + _source_path};
+    }
+    {
+        Mapped_file source{_source_path};
+        header.source_hash = hash_bytes(source.data(), source.size());
+    }
+
+    // only the sysex/meta payloads are kept, packed into a new arena
+    // the lengths are the clamped ones, so every range written lies inside it
+    auto payloads = std::vector<std::uint8_t>{};
+    auto remapped = std::unordered_map<std::uint32_t, std::uint32_t>{};
+    auto remap_payloads = [&](const Midi_track &track, std::vector<std::uint32_t> &offsets, std::vector<std::uint32_t> &lengths) {
+        offsets.assign(track.size(), 0);
+        lengths.assign(track.size(), 0);
+        for (auto i = std::size_t{0}; i < track.size(); ++i) {
+            auto length = sequence.payload_length(track, i);
+            if (length == 0) { continue; }
+
+            // a track and the timeline share their events, so an offset seen before is the same payload
+            auto found = remapped.find(track.payload_offset[i]);
+            if (found == remapped.end()) {
+                auto bytes = sequence.payload(track, i);
+                found = remapped.emplace(track.payload_offset[i], static_cast<std::uint32_t>(payloads.size())).first;
+                payloads.insert(payloads.end(), bytes, bytes + length);
+            }
+            offsets[i] = found->second;
+            lengths[i] = length;
+        }
+    };
+
+    auto writer = Image_writer{sizeof(Header)};
+    auto append_track = [&](const Midi_track &track) {
+        auto entry = Track_entry{};
+        auto offsets = std::vector<std::uint32_t>{};
+        auto lengths = std::vector<std::uint32_t>{};
+        remap_payloads(track, offsets, lengths);
+        auto section = [](std::pair<std::uint64_t, std::uint64_t> placed) { return Section{placed.first, placed.second}; };
+        entry.end_tick = track.end_tick;
+        entry.ticks = section(writer.append(track.ticks.data(), track.size()));
+        entry.status = section(writer.append(track.status.data(), track.size()));
+        entry.data_1 = section(writer.append(track.data_1.data(), track.size()));
+        entry.data_2 = section(writer.append(track.data_2.data(), track.size()));
+        entry.payload_offset = section(writer.append(offsets.data(), offsets.size()));
+        entry.payload_length = section(writer.append(lengths.data(), lengths.size()));
+        return entry;
+    };
+
+    auto entries = std::vector<Track_entry>{};
+    entries.reserve(sequence.tracks.size() + 1);
+    entries.push_back(append_track(sequence.tempo_track));
+    for (const auto &track : sequence.tracks) {
+        entries.push_back(append_track(track));
+    }
+    header.timeline = append_track(timeline.events);
+
+    auto placed = writer.append(timeline.sources.data(), timeline.sources.size());
+    header.timeline_sources = Section{placed.first, placed.second};
+    placed = writer.append(entries.data(), entries.size());
+    header.tracks = Section{placed.first, placed.second};
+    placed = writer.append(payloads.data(), payloads.size());
+    header.payloads = Section{placed.first, placed.second};
+
+    auto changes = Tempo_map::tempo_changes(sequence);
+    placed = writer.append(changes.data(), changes.size());
+    header.tempo_changes = Section{placed.first, placed.second};
+
+    auto enabled_bytes = std::vector<std::uint8_t>(enabled.begin(), enabled.end());
+    placed = writer.append(enabled_bytes.data(), enabled_bytes.size());
+    header.enabled = Section{placed.first, placed.second};
+
+    auto &image = writer.image();
+    header.file_size = image.size();
+    std::memcpy(image.data(), &header, sizeof(header));
+
+    auto temp_path = _cache_path + ".tmp";
+    auto file = fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        throw std::system_error{errno, std::generic_category(), "fopen: " + temp_path};
+    }
+    auto written = fwrite(image.data(), 1, image.size(), file);
+    auto did_close = (fclose(file) == 0);
+    if (written != image.size() || !did_close || rename(temp_path.c_str(), _cache_path.c_str()) != 0) {
+        auto err = errno;
+        unlink(temp_path.c_str());
+        throw std::system_error{err, std::generic_category(), "write: " + _cache_path};
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef CORE_MIDI_GEN2_SEQUENCE_CACHE_H
+#define CORE_MIDI_GEN2_SEQUENCE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Mapped_file.h"
+#include "Midi_sequence.h"
+#include "Smf_parser.h"
+#include "Tempo_map.h"
+#include "Track_merger.h"
+
+// versioned on-disk image of a parsed sequence: the SoA track arrays, the payload bytes,
+// the tempo changes and the merged timeline, all 8 byte aligned in host byte order
+// loading maps the file once and points the views straight into it, there is no per-event work
+// a cache is fresh when it was written by this version, for the same -c mode, from a source
+// with the same size and nanosecond mtime (or, if only the mtime moved, the same content hash, after which the mtime is updated)
+// a source modified in the second the cache was written is always hashed, its mtime may be whole seconds
+class Sequence_cache {
+private:
+    struct Section {
+        std::uint64_t offset;
+        std::uint64_t count;
+    };
+
+    struct Track_entry {
+        std::uint32_t end_tick;
+        std::uint32_t unused;
+        Section ticks;
+        Section status;
+        Section data_1;
+        Section data_2;
+        Section payload_offset;
+        Section payload_length;
+    };
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        std::uint64_t file_size;
+        std::uint64_t source_size;
+        std::int64_t source_mtime;
+        std::uint64_t source_hash;
+        std::uint16_t format;
+        std::uint16_t division;
+        std::uint32_t track_mode;
+        // tempo track first, then the tracks
+        Section tracks;
+        Section payloads;
+        Section tempo_changes;
+        // one byte per track, the -t selection the timeline was merged for
+        Section enabled;
+        Track_entry timeline;
+        Section timeline_sources;
+    };
+
+    static const char _magic[8];
+    static const std::uint32_t _version;
+    static const std::uint32_t _byte_order;
+
+    std::string _source_path;
+    std::string _cache_path;
+    Smf_track_mode _mode;
+    std::shared_ptr<const Mapped_file> _mapping;
+    const Header *_header = nullptr;
+
+public:
+    Sequence_cache(const std::string &source_path, Smf_track_mode mode);
+
+    ~Sequence_cache() = default;
+
+    static std::string path_for(const std::string &source_path) { return source_path + ".cmgc"; }
+
+    // maps and validates the cache file, false if it is missing, corrupt or stale
+    bool is_fresh();
+
+    // the views keep the mapping alive through Midi_sequence::source
+    Midi_sequence sequence() const;
+
+    Array_view<Tempo_change> tempo_changes() const;
+
+    bool has_timeline(const std::vector<bool> &enabled) const;
+
+    // views into the mapping, only valid while a sequence() from this cache is alive
+    Merged_timeline timeline() const;
+
+    // written to a temporary file and renamed into place, so readers never see a partial cache
+    void write(const Midi_sequence &sequence, const Merged_timeline &timeline, const std::vector<bool> &enabled) const;
+
+    // 64 bit content hash of the source file, word at a time
+    static std::uint64_t hash_bytes(const std::uint8_t *data, std::size_t size);
+
+private:
+    template<typename T>
+    Array_view<T> _view(const Section &section) const
+    {
+        return Array_view<T>{reinterpret_cast<const T *>(_mapping->data() + section.offset),
+                             static_cast<std::size_t>(section.count)};
+    }
+
+    template<typename T>
+    bool _is_valid(const Section &section) const;
+
+    bool _is_valid(const Track_entry &entry) const;
+
+    Midi_track _track(const Track_entry &entry) const;
+
+    // the source's new mtime into the cache's header, once its hash has shown the content is the same
+    void _refresh_mtime(std::int64_t source_mtime) const;
+};
+
+#endif //CORE_MIDI_GEN2_SEQUENCE_CACHE_H
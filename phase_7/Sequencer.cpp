@@ -0,0 +1,34 @@
+#include <algorithm>
+
+#include "Sequencer.h"
+
+Sequencer::Sequencer(const Midi_sequence &sequence, const Merged_timeline &timeline, const Tempo_map &tempo_map)
+        : _events{timeline.events},
+          _sequence{&sequence},
+          _cursor{tempo_map} {}
+
+void Sequencer::seek(std::uint32_t tick)
+{
+    _position = static_cast<std::size_t>(std::lower_bound(_events.ticks.begin(), _events.ticks.end(), tick) -
+                                          _events.ticks.begin());
+    _block_start = _cursor.sample_for_tick(tick);
+}
+
+void Sequencer::render_block(std::uint32_t frames, Event_sink &sink)
+{
+    auto block_end = _block_start + frames;
+    for (; _position < _events.size(); ++_position) {
+        auto sample = _cursor.sample_for_tick(_events.ticks[_position]);
+        if (sample >= block_end) { break; }
+
+        // only a seek between ticks can leave an event before the block
+        auto offset = static_cast<std::uint32_t>(std::max(sample - _block_start, std::int64_t{0}));
+        auto status = _events.status[_position];
+        if (midi::is_channel_status(status)) {
+            sink.channel_event(status, _events.data_1[_position], _events.data_2[_position], offset);
+        } else if (status == midi::sysex || status == midi::sysex_escape) {
+            sink.sysex(status, _sequence->payload(_events, _position), _sequence->payload_length(_events, _position), offset);
+        }
+    }
+    _block_start = block_end;
+}
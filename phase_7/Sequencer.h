@@ -0,0 +1,52 @@
+#ifndef CORE_MIDI_GEN2_SEQUENCER_H
+#define CORE_MIDI_GEN2_SEQUENCER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Midi_sequence.h"
+#include "Tempo_map.h"
+#include "Track_merger.h"
+
+// where the sequencer delivers the events of a block, offset is the sample frame within the block
+class Event_sink {
+public:
+    virtual ~Event_sink() = default;
+
+    virtual void channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset) = 0;
+
+    // payload as stored in the SMF, without the F0 of a sysex message
+    virtual void sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset) = 0;
+};
+
+// plays a merged timeline block by block on the tempo map's sample clock, in place of MusicPlayer
+// each event lands on the exact sample its tick maps to, whatever the block size,
+// so an offline render is a pure function of the sequence, the start tick and the sample rate
+// meta events aren't delivered, tempo is already in the map
+class Sequencer {
+private:
+    Midi_track _events;
+    const Midi_sequence *_sequence = nullptr;
+    Tempo_map::Cursor _cursor;
+    std::size_t _position = 0;
+    // first sample of the next block
+    std::int64_t _block_start = 0;
+
+public:
+    // the sequence, timeline and map must outlive the sequencer
+    Sequencer(const Midi_sequence &sequence, const Merged_timeline &timeline, const Tempo_map &tempo_map);
+
+    ~Sequencer() = default;
+
+    // the next block starts on the tick, events before it are skipped (chase them with a Seek_index)
+    void seek(std::uint32_t tick);
+
+    // hands every event in the next frames samples to the sink, in timeline order
+    void render_block(std::uint32_t frames, Event_sink &sink);
+
+    bool is_finished() const { return _position == _events.size(); }
+
+    std::int64_t block_start() const { return _block_start; }
+};
+
+#endif //CORE_MIDI_GEN2_SEQUENCER_H
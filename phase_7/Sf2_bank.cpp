@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+
+#include "Sf2_bank.h"
+
+namespace {
+    const std::size_t phdr_size = 38;
+    const std::size_t phdr_bag_index = 24;
+    const std::size_t inst_size = 22;
+    const std::size_t inst_bag_index = 20;
+    const std::size_t bag_size = 4;
+    const std::size_t gen_size = 4;
+    const std::size_t shdr_size = 46;
+
+    const std::uint16_t rom_sample = 0x8000;
+    const std::int16_t no_time = -12000;
+
+    // timecents to seconds, the spec's -12000 (or less) is no time at all
+    float seconds(int timecents)
+    {
+        if (timecents <= no_time) { return 0.f; }
+        return std::exp2(std::min(timecents, 8000) / 1200.f);
+    }
+}
+
+Sf2_bank::Zone::Zone()
+{
+    amounts.fill(0);
+    set.fill(false);
+    for (auto generator : {delay_vol_env, attack_vol_env, hold_vol_env, decay_vol_env, release_vol_env}) {
+        amounts[generator] = no_time;
+    }
+    amounts[key_range] = 0x7F00;
+    amounts[velocity_range] = 0x7F00;
+    amounts[scale_tuning] = 100;
+    amounts[overriding_root_key] = -1;
+}
+
+void Sf2_bank::Zone::overlay(const Zone &zone)
+{
+    for (auto g = std::size_t{0}; g < generator_count; ++g) {
+        if (zone.set[g]) {
+            amounts[g] = zone.amounts[g];
+            set[g] = true;
+        }
+    }
+}
+
+Sf2_bank::Sf2_bank(std::shared_ptr<const Mapped_file> file)
+        : _file{std::move(file)}
+{
+    try {
+        if (!riff::is_form(_file->data(), _file->size(), "sfbk")) {
+            throw bad_sound_bank{"not a SoundFont 2 bank"};
+        }
+        auto top = riff::chunks(_file->begin(), _file->end());
+        if (top.empty() || !top[0].is_list("sfbk")) {
+            throw bad_sound_bank{"bad RIFF header"};
+        }
+        auto sfbk = riff::children(top[0]);
+        auto sdta = riff::find_list(sfbk, "sdta");
+        auto pdta = riff::find_list(sfbk, "pdta");
+        if (!sdta || !pdta) {
+            throw bad_sound_bank{"missing sdta or pdta list"};
+        }
+        _find_samples(riff::children(*sdta));
+
+        auto hydra = riff::children(*pdta);
+        auto chunk = [&hydra](const char *id) -> const riff::Chunk & {
+            auto found = riff::find(hydra, id);
+            if (!found) {
+                throw bad_sound_bank{std::string{"missing "} + id + " chunk"};
+            }
+            return *found;
+        };
+        const auto &phdr = chunk("phdr");
+        auto preset_zones = _read_zones(phdr, phdr_size, phdr_bag_index, chunk("pbag"), chunk("pgen"), instrument);
+        auto instrument_zones = _read_zones(chunk("inst"), inst_size, inst_bag_index, chunk("ibag"), chunk("igen"), sample_id);
+        auto samples = _read_sample_headers(chunk("shdr"));
+
+        for (auto p = std::size_t{0}; p < preset_zones.size(); ++p) {
+            auto header = phdr.data + p * phdr_size;
+            auto program = riff::read_u16(header + 20);
+            auto bank = riff::read_u16(header + 22);
+            if (program > 127 || bank > percussion_bank) { continue; }
+
+            // the first of two presets with the same number wins, as in most players
+            auto inserted = _presets.emplace(static_cast<std::uint32_t>(bank << 8 | program), Bank_preset{});
+            if (!inserted.second) { continue; }
+            auto &regions = inserted.first->second.regions;
+
+            for (const auto &preset_zone : preset_zones[p]) {
+                auto index = static_cast<std::uint16_t>(preset_zone.amounts[instrument]);
+                if (index >= instrument_zones.size()) { continue; }
+
+                for (const auto &instrument_zone : instrument_zones[index]) {
+                    auto sample = static_cast<std::uint16_t>(instrument_zone.amounts[sample_id]);
+                    auto region = Sample_region{};
+                    if (sample < samples.size() && _make_region(preset_zone, instrument_zone, samples[sample], region)) {
+                        regions.push_back(region);
+                    }
+                }
+            }
+            _region_count += regions.size();
+        }
+    } catch (const bad_sound_bank &e) {
+        throw bad_sound_bank{std::string{e.what()} + ": " + _file->path()};
+    }
+}
+
+const Bank_preset *Sf2_bank::preset(std::uint16_t bank, std::uint8_t program) const
+{
+    auto found = _presets.find(static_cast<std::uint32_t>(bank << 8 | program));
+    return (found != _presets.end()) ? &found->second : nullptr;
+}
+
+void Sf2_bank::_find_samples(const std::vector<riff::Chunk> &sdta)
+{
+    auto smpl = riff::find(sdta, "smpl");
+    if (!smpl) {
+        throw bad_sound_bank{"missing smpl chunk"};
+    }
+    // chunks start on even offsets and the mapping on a page, so the samples are aligned for int16_t,
+    // and they are little endian like every host this runs on, so they are used as they are in the file
+    if (reinterpret_cast<std::uintptr_t>(smpl->data) % alignof(std::int16_t) != 0) {
+        throw bad_sound_bank{"misaligned smpl chunk"};
+    }
+    _sample_data = reinterpret_cast<const std::int16_t *>(smpl->data);
+    _sample_count = smpl->size / sizeof(std::int16_t);
+}
+
+std::vector<std::vector<Sf2_bank::Zone>> Sf2_bank::_read_zones(
+        const riff::Chunk &headers,
+        std::size_t header_size,
+        std::size_t bag_index_offset,
+        const riff::Chunk &bags,
+        const riff::Chunk &generators,
+        Generator terminal
+)
+{
+    // the last header, bag and generator of each list only terminate it
+    auto header_count = headers.size / header_size;
+    auto bag_count = bags.size / bag_size;
+    auto generator_count_in_chunk = generators.size / gen_size;
+    if (header_count < 1 || bag_count < 1) {
+        throw bad_sound_bank{"empty preset or instrument list"};
+    }
+
+    auto result = std::vector<std::vector<Zone>>(header_count - 1);
+    for (auto h = std::size_t{0}; h + 1 < header_count; ++h) {
+        auto bag_begin = riff::read_u16(headers.data + h * header_size + bag_index_offset);
+        auto bag_end = riff::read_u16(headers.data + (h + 1) * header_size + bag_index_offset);
+        if (bag_begin > bag_end || bag_end >= bag_count) {
+            throw bad_sound_bank{"bad bag index"};
+        }
+
+        // a first zone without the terminal generator is the global zone, the defaults of every other one
+        auto global = Zone{};
+        for (auto b = bag_begin; b < bag_end; ++b) {
+            auto generator_begin = riff::read_u16(bags.data + b * bag_size);
+            auto generator_end = riff::read_u16(bags.data + (b + 1) * bag_size);
+            if (generator_begin > generator_end || generator_end > generator_count_in_chunk) {
+                throw bad_sound_bank{"bad generator index"};
+            }
+
+            auto zone = Zone{};
+            auto has_terminal = false;
+            for (auto g = generator_begin; g < generator_end; ++g) {
+                auto record = generators.data + g * gen_size;
+                auto oper = riff::read_u16(record);
+                if (oper >= generator_count) { continue; }
+                zone.amounts[oper] = static_cast<std::int16_t>(riff::read_u16(record + 2));
+                zone.set[oper] = true;
+                // anything after the terminal generator is ignored
+                if (oper == terminal) {
+                    has_terminal = true;
+                    break;
+                }
+            }
+
+            if (has_terminal) {
+                auto merged = global;
+                merged.overlay(zone);
+                result[h].push_back(merged);
+            } else if (b == bag_begin) {
+                global.overlay(zone);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<Sf2_bank::Sample_header> Sf2_bank::_read_sample_headers(const riff::Chunk &shdr)
+{
+    auto count = shdr.size / shdr_size;
+    auto result = std::vector<Sample_header>{};
+    result.reserve(count);
+    // the last is the EOS terminator
+    for (auto i = std::size_t{0}; i + 1 < count; ++i) {
+        auto record = shdr.data + i * shdr_size;
+        result.push_back(Sample_header{
+                riff::read_u32(record + 20),
+                riff::read_u32(record + 24),
+                riff::read_u32(record + 28),
+                riff::read_u32(record + 32),
+                riff::read_u32(record + 36),
+                record[40],
+                static_cast<std::int8_t>(record[41]),
+                riff::read_u16(record + 44)
+        });
+    }
+    return result;
+}
+
+bool Sf2_bank::_make_region(const Zone &preset_zone, const Zone &instrument_zone, const Sample_header &sample, Sample_region &region) const
+{
+    if (sample.type & rom_sample) { return false; }
+
+    // ranges are the overlap of the two zones'
+    region.key_low = std::max(preset_zone.low(key_range), instrument_zone.low(key_range));
+    region.key_high = std::min(preset_zone.high(key_range), instrument_zone.high(key_range));
+    region.velocity_low = std::max(preset_zone.low(velocity_range), instrument_zone.low(velocity_range));
+    region.velocity_high = std::min(preset_zone.high(velocity_range), instrument_zone.high(velocity_range));
+    if (region.key_low > region.key_high || region.velocity_low > region.velocity_high) { return false; }
+
+    // sample addresses are instrument only, coarse offsets count in 32768 sample steps
+    auto address = [&instrument_zone](std::uint32_t base, Generator fine, Generator coarse) {
+        return static_cast<std::int64_t>(base) + instrument_zone.amounts[fine] + instrument_zone.amounts[coarse] * 32768ll;
+    };
+    auto start = address(sample.start, start_offset, start_coarse_offset);
+    auto end = address(sample.end, end_offset, end_coarse_offset);
+    auto loop_start = address(sample.loop_start, loop_start_offset, loop_start_coarse_offset);
+    auto loop_end = address(sample.loop_end, loop_end_offset, loop_end_coarse_offset);
+    if (start < 0 || end > _sample_count || start >= end) { return false; }
+
+    region.samples = _sample_data + start;
+    region.length = static_cast<std::uint32_t>(end - start);
+    region.file_offset = reinterpret_cast<const std::uint8_t *>(region.samples) - _file->data();
+    // 1 loops throughout, 3 loops until the release and the synth keeps on looping, which only differs in the tail
+    auto modes = instrument_zone.amounts[sample_modes] & 3;
+    region.loops = (modes == 1 || modes == 3) && start <= loop_start && loop_start < loop_end && loop_end <= end;
+    if (region.loops) {
+        region.loop_start = static_cast<std::uint32_t>(loop_start - start);
+        region.loop_end = static_cast<std::uint32_t>(loop_end - start);
+    }
+    region.sample_rate = sample.sample_rate ? sample.sample_rate : 44100;
+
+    // the rest add the preset zone's amount onto the instrument zone's
+    auto amount = [&preset_zone, &instrument_zone](Generator generator) {
+        return instrument_zone.amounts[generator] + (preset_zone.set[generator] ? preset_zone.amounts[generator] : 0);
+    };
+    auto root_key = instrument_zone.amounts[overriding_root_key];
+    if (root_key < 0 || root_key > 127) {
+        root_key = (sample.original_pitch <= 127) ? sample.original_pitch : 60;
+    }
+    region.root_key = static_cast<std::uint8_t>(root_key);
+    region.tune_cents = static_cast<float>(amount(coarse_tune) * 100 + amount(fine_tune) + sample.pitch_correction);
+    region.key_cents = static_cast<float>(amount(scale_tuning));
+    // centibels, which EMU's hardware and most players apply at 0.4 of their nominal value
+    region.attenuation_db = std::max(amount(initial_attenuation), 0) * .04f;
+    region.pan = std::min(std::max(amount(pan) / 500.f, -1.f), 1.f);
+    region.exclusive_class = static_cast<std::uint32_t>(std::max<int>(instrument_zone.amounts[exclusive_class], 0));
+
+    // a SoundFont decay or release falls 100 dB and the synth's only 60, the times are scaled to keep the slope
+    region.envelope.delay = seconds(amount(delay_vol_env));
+    region.envelope.attack = seconds(amount(attack_vol_env));
+    region.envelope.hold = seconds(amount(hold_vol_env));
+    region.envelope.decay = seconds(amount(decay_vol_env)) * .6f;
+    region.envelope.sustain = std::pow(10.f, -std::min(std::max(amount(sustain_vol_env), 0), 1000) / 200.f);
+    region.envelope.release = seconds(amount(release_vol_env)) * .6f;
+    return true;
+}
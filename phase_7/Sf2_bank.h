@@ -0,0 +1,126 @@
+#ifndef CORE_MIDI_GEN2_SF2_BANK_H
+#define CORE_MIDI_GEN2_SF2_BANK_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Mapped_file.h"
+#include "Riff.h"
+#include "Sample_bank.h"
+
+// a SoundFont 2 bank read in place from a mapping of the file
+// only the pdta hierarchy (presets, instruments, their zones and the sample headers) is parsed at load,
+// the preset and instrument generators are folded into one flat Sample_region per preset zone and instrument zone pair,
+// and each region points straight into the smpl chunk, so sample data is only paged in when a note plays it
+// and a large bank loads in the time it takes to walk its directory, whatever the size of its samples
+// 16 bit samples only, the 24 bit sm24 extension and the modulators are ignored
+class Sf2_bank : public Sample_bank {
+public:
+    // the generators this reader understands, numbered as in the SoundFont 2.04 spec
+    enum Generator : std::uint16_t {
+        start_offset = 0,
+        end_offset = 1,
+        loop_start_offset = 2,
+        loop_end_offset = 3,
+        start_coarse_offset = 4,
+        end_coarse_offset = 12,
+        pan = 17,
+        delay_vol_env = 33,
+        attack_vol_env = 34,
+        hold_vol_env = 35,
+        decay_vol_env = 36,
+        sustain_vol_env = 37,
+        release_vol_env = 38,
+        instrument = 41,
+        key_range = 43,
+        velocity_range = 44,
+        loop_start_coarse_offset = 45,
+        initial_attenuation = 48,
+        loop_end_coarse_offset = 50,
+        coarse_tune = 51,
+        fine_tune = 52,
+        sample_id = 53,
+        sample_modes = 54,
+        scale_tuning = 56,
+        exclusive_class = 57,
+        overriding_root_key = 58,
+        generator_count = 61
+    };
+
+private:
+    // one zone's generators, set marks the ones the zone gives
+    struct Zone {
+        std::array<std::int16_t, generator_count> amounts;
+        std::array<bool, generator_count> set;
+
+        Zone();
+
+        // the amount of a range generator as its low and high bytes
+        std::uint8_t low(Generator generator) const { return static_cast<std::uint8_t>(amounts[generator] & 0xFF); }
+
+        std::uint8_t high(Generator generator) const { return static_cast<std::uint8_t>((amounts[generator] >> 8) & 0xFF); }
+
+        void overlay(const Zone &zone);
+    };
+
+    struct Sample_header {
+        std::uint32_t start;
+        std::uint32_t end;
+        std::uint32_t loop_start;
+        std::uint32_t loop_end;
+        std::uint32_t sample_rate;
+        std::uint8_t original_pitch;
+        std::int8_t pitch_correction;
+        std::uint16_t type;
+    };
+
+    std::shared_ptr<const Mapped_file> _file;
+    const std::int16_t *_sample_data = nullptr;
+    std::uint32_t _sample_count = 0;
+    // keyed by bank << 8 | program
+    std::unordered_map<std::uint32_t, Bank_preset> _presets;
+    std::size_t _region_count = 0;
+
+public:
+    // throws bad_sound_bank
+    explicit Sf2_bank(std::shared_ptr<const Mapped_file> file);
+
+    ~Sf2_bank() override = default;
+
+    Sf2_bank(const Sf2_bank &) = delete;
+
+    Sf2_bank &operator=(const Sf2_bank &) = delete;
+
+    const Bank_preset *preset(std::uint16_t bank, std::uint8_t program) const override;
+
+    std::size_t preset_count() const { return _presets.size(); }
+
+    std::size_t region_count() const { return _region_count; }
+
+    // the size of the smpl chunk, none of which is read at load
+    std::size_t sample_bytes() const { return _sample_count * sizeof(std::int16_t); }
+
+private:
+    void _find_samples(const std::vector<riff::Chunk> &sdta);
+
+    // the zones of each preset or instrument, from its bag index to the next one's
+    static std::vector<std::vector<Zone>> _read_zones(
+            const riff::Chunk &headers,
+            std::size_t header_size,
+            std::size_t bag_index_offset,
+            const riff::Chunk &bags,
+            const riff::Chunk &generators,
+            Generator terminal
+    );
+
+    static std::vector<Sample_header> _read_sample_headers(const riff::Chunk &shdr);
+
+    // the instrument zone as the preset zone adjusts it, false when the two don't overlap or the sample is unusable
+    bool _make_region(const Zone &preset_zone, const Zone &instrument_zone, const Sample_header &sample, Sample_region &region) const;
+};
+
+#endif //CORE_MIDI_GEN2_SF2_BANK_H
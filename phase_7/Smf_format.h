@@ -0,0 +1,207 @@
+#ifndef CORE_MIDI_GEN2_SMF_FORMAT_H
+#define CORE_MIDI_GEN2_SMF_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "Midi_sequence.h"
+
+class bad_smf_file : public std::runtime_error {
+public:
+    explicit bad_smf_file(const std::string &what) : std::runtime_error{what} {}
+};
+
+// the Standard MIDI File encoding shared by the parser, the probe and the stream reader
+// numbers are big endian, delta times and lengths are variable-length quantities
+namespace smf {
+    inline std::uint32_t read_u32_be(const std::uint8_t *p)
+    {
+        return (static_cast<std::uint32_t>(p[0]) << 24) |
+               (static_cast<std::uint32_t>(p[1]) << 16) |
+               (static_cast<std::uint32_t>(p[2]) << 8) |
+               static_cast<std::uint32_t>(p[3]);
+    }
+
+    inline std::uint16_t read_u16_be(const std::uint8_t *p)
+    {
+        return static_cast<std::uint16_t>((p[0] << 8) | p[1]);
+    }
+
+    struct Header {
+        std::uint16_t format;
+        std::uint16_t division;
+        // the MThd chunk with its chunk header, the first chunk after it starts here
+        std::size_t size;
+    };
+
+    // the MThd chunk at the start of a file of size bytes, path is only for the errors
+    inline Header read_header(const std::uint8_t *p, std::size_t size, const std::string &path)
+    {
+        if (size < 14 || std::memcmp(p, "MThd", 4) != 0) {
+            throw bad_smf_file{"missing MThd header: " + path};
+        }
+        auto length = read_u32_be(p + 4);
+        if (length < 6 || length > size - 8) {
+            throw bad_smf_file{"bad MThd length: " + path};
+        }
+
+        auto header = Header{read_u16_be(p + 8), read_u16_be(p + 12), std::size_t{8} + length};
+        if (header.format > 2 || header.division == 0) {
+            throw bad_smf_file{"unsupported format or division: " + path};
+        }
+        return header;
+    }
+
+    // calls visit(begin, end) for each MTrk chunk from begin to end in file order
+    // the MThd track count is only a hint, the chunks actually present are trusted
+    template<typename Visit>
+    void for_each_track(const std::uint8_t *begin, const std::uint8_t *end, Visit visit)
+    {
+        auto p = begin;
+        while (end - p >= 8) {
+            auto chunk_length = read_u32_be(p + 4);
+            auto chunk_begin = p + 8;
+            // be lenient about a truncated final chunk, decoding stops at the end of the file anyway
+            auto chunk_end = (chunk_length > static_cast<std::size_t>(end - chunk_begin)) ? end : chunk_begin + chunk_length;
+
+            // unknown chunk types must be skipped
+            if (std::memcmp(p, "MTrk", 4) == 0) {
+                visit(chunk_begin, chunk_end);
+            }
+            p = chunk_end;
+        }
+    }
+
+    // variable-length quantity, at most 4 bytes in a well formed file
+    inline std::uint32_t read_vlq(const std::uint8_t *&p, const std::uint8_t *end)
+    {
+        auto value = std::uint32_t{0};
+        for (auto i = 0; i < 4; ++i) {
+            if (p == end) {
+                throw bad_smf_file{"truncated variable-length quantity"};
+            }
+            auto byte = *p++;
+            value = (value << 7) | (byte & 0x7F);
+            if (!(byte & 0x80)) { return value; }
+        }
+        throw bad_smf_file{"variable-length quantity longer than 4 bytes"};
+    }
+
+    // one MTrk event, for meta events data_1 holds the meta type
+    // payload is the sysex (without its F0) or meta bytes, only valid until the source reads on
+    struct Event {
+        std::uint32_t tick = 0;
+        std::uint8_t status = 0;
+        std::uint8_t data_1 = 0;
+        std::uint8_t data_2 = 0;
+        const std::uint8_t *payload = nullptr;
+        std::uint32_t payload_length = 0;
+    };
+
+    // what carries over from one event of a track to the next
+    struct Track_state {
+        std::uint32_t tick = 0;
+        std::uint8_t running_status = 0;
+    };
+
+    // the bytes of a track in memory, a source for read_event
+    class Memory_source {
+    protected:
+        const std::uint8_t *_p;
+        const std::uint8_t *_end;
+
+    public:
+        Memory_source(const std::uint8_t *begin, const std::uint8_t *end) : _p{begin}, _end{end} {}
+
+        bool at_end() const { return _p == _end; }
+
+        const std::uint8_t *position() const { return _p; }
+
+        // only over bytes already looked at
+        void skip(std::size_t count) { _p += count; }
+
+        std::uint8_t read_byte(const char *error)
+        {
+            if (_p == _end) {
+                throw bad_smf_file{error};
+            }
+            return *_p++;
+        }
+
+        std::uint32_t read_vlq() { return smf::read_vlq(_p, _end); }
+
+        const std::uint8_t *read_payload(std::uint32_t length, const char *error)
+        {
+            if (length > static_cast<std::size_t>(_end - _p)) {
+                throw bad_smf_file{error};
+            }
+            auto payload = _p;
+            _p += length;
+            return payload;
+        }
+    };
+
+    // the one MTrk event walk, the source provides read_byte(error), read_vlq() and read_payload(length, error)
+    // false at the end-of-track event, state.tick is its tick then
+    // a source out of bytes throws, check for the end of the chunk before each event
+    // always inlined, so the source's position stays in a register across the walk instead of in memory
+    template<typename Source>
+    __attribute__((always_inline)) inline bool read_event(Source &source, Track_state &state, Event &event)
+    {
+        // decoded into locals and stored once, a uint8_t store to event or state may alias the source's
+        // position, which would then be reloaded after every byte
+        auto tick = state.tick + source.read_vlq();
+        auto running_status = state.running_status;
+
+        auto status = source.read_byte("truncated event");
+        auto data_1 = std::uint8_t{0};
+        auto data_2 = std::uint8_t{0};
+        const std::uint8_t *payload = nullptr;
+        auto payload_length = std::uint32_t{0};
+        auto is_end_of_track = false;
+
+        if (midi::is_channel_status(status) || status < 0x80) {
+            if (status < 0x80) {
+                // running status, strictly it should be cancelled by sysex and meta events
+                // but plenty of files in the wild rely on it surviving them
+                if (!running_status) {
+                    throw bad_smf_file{"data byte without running status"};
+                }
+                data_1 = status;
+                status = running_status;
+            } else {
+                data_1 = source.read_byte("truncated channel event");
+            }
+            if (midi::channel_data_length(status) == 2) {
+                data_2 = source.read_byte("truncated channel event");
+            }
+            running_status = status;
+        } else if (status == midi::meta) {
+            data_1 = source.read_byte("truncated meta event");
+            payload_length = source.read_vlq();
+            payload = source.read_payload(payload_length, "truncated meta event");
+            is_end_of_track = (data_1 == midi::meta_end_of_track);
+        } else if (status == midi::sysex || status == midi::sysex_escape) {
+            payload_length = source.read_vlq();
+            payload = source.read_payload(payload_length, "truncated sysex event");
+        } else {
+            // system common and real-time messages can't appear in an SMF
+            throw bad_smf_file{"invalid status byte in track"};
+        }
+
+        state.tick = tick;
+        state.running_status = running_status;
+        event.tick = tick;
+        event.status = status;
+        event.data_1 = data_1;
+        event.data_2 = data_2;
+        event.payload = payload;
+        event.payload_length = payload_length;
+        return !is_end_of_track;
+    }
+};
+
+#endif //CORE_MIDI_GEN2_SMF_FORMAT_H
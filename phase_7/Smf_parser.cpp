@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <thread>
+
+#include "Smf_format.h"
+#include "Smf_parser.h"
+#include "Smf_scan.h"
+#include "Track_merger.h"
+
+namespace {
+    // a track in the mapping, whose VLQ lengths come from the window's high-bit mask rather than testing byte by byte
+    class Scan_source : public smf::Memory_source {
+    private:
+        smf_scan::Window _window;
+
+    public:
+        Scan_source(const std::uint8_t *begin, const std::uint8_t *end) : Memory_source{begin, end}, _window{end} {}
+
+        // high-bit mask from the current position
+        std::uint64_t bits() { return _window.bits_at(_p); }
+
+        std::uint32_t read_vlq()
+        {
+            auto length = smf_scan::vlq_length(bits());
+            if (length > _end - _p) {
+                throw bad_smf_file{"truncated variable-length quantity"};
+            }
+            if (length > 4) {
+                throw bad_smf_file{"variable-length quantity longer than 4 bytes"};
+            }
+
+            auto value = std::uint32_t{0};
+            for (auto i = 0; i < length; ++i) {
+                value = (value << 7) | (_p[i] & 0x7F);
+            }
+            _p += length;
+            return value;
+        }
+    };
+
+    // appends to a track through raw pointers that stay in registers
+    // push_back would reload each vector's end after every byte store, as a uint8_t store may alias it
+    class Track_writer {
+    private:
+        Midi_track_buffer &_track;
+        std::size_t _size = 0;
+        std::size_t _capacity = 0;
+        std::uint32_t *_ticks = nullptr;
+        std::uint8_t *_status = nullptr;
+        std::uint8_t *_data_1 = nullptr;
+        std::uint8_t *_data_2 = nullptr;
+        std::uint32_t *_payload_offset = nullptr;
+        std::uint32_t *_payload_length = nullptr;
+
+        void _grow(std::size_t count)
+        {
+            _capacity = std::max(count, 2 * _capacity);
+            _track.resize(_capacity);
+            _ticks = _track.ticks.data();
+            _status = _track.status.data();
+            _data_1 = _track.data_1.data();
+            _data_2 = _track.data_2.data();
+            _payload_offset = _track.payload_offset.data();
+            _payload_length = _track.payload_length.data();
+        }
+
+    public:
+        Track_writer(Midi_track_buffer &track, std::size_t expected) : _track(track) { _grow(std::max(expected, std::size_t{16})); }
+
+        // room for count more events
+        void reserve(std::size_t count)
+        {
+            if (_size + count > _capacity) { _grow(_size + count); }
+        }
+
+        // only after reserve
+        void put(
+                std::uint32_t tick,
+                std::uint8_t status,
+                std::uint8_t data_1,
+                std::uint8_t data_2,
+                std::uint32_t offset = 0,
+                std::uint32_t length = 0
+        )
+        {
+            _ticks[_size] = tick;
+            _status[_size] = status;
+            _data_1[_size] = data_1;
+            _data_2[_size] = data_2;
+            _payload_offset[_size] = offset;
+            _payload_length[_size] = length;
+            ++_size;
+        }
+
+        void finish() { _track.resize(_size); }
+    };
+
+    bool is_tempo_event(const Midi_track_buffer &track, std::size_t i)
+    {
+        return track.status[i] == midi::meta && track.data_1[i] == midi::meta_tempo;
+    }
+}
+
+Midi_sequence Smf_parser::load(const std::string &path) const
+{
+    return parse(std::make_shared<const Mapped_file>(path));
+}
+
+Midi_sequence Smf_parser::parse(std::shared_ptr<const Mapped_file> file) const
+{
+    auto header = smf::read_header(file->begin(), file->size(), file->path());
+    // payloads are stored as 32 bit offsets into the mapping
+    if (file->size() > UINT32_MAX) {
+        throw bad_smf_file{"file too large: " + file->path()};
+    }
+
+    auto sequence = Midi_sequence{};
+    sequence.format = header.format;
+    sequence.division = header.division;
+
+    auto chunks = _scan_chunks(file->begin() + header.size, file->end());
+    auto tempo_track = Midi_track_buffer{};
+    auto tracks = _decode_tracks(file->data(), chunks);
+
+    if (sequence.format == 1 && !tracks.empty()) {
+        // the conductor track of a format 1 file is the tempo track
+        tempo_track = std::move(tracks.front());
+        tracks.erase(tracks.begin());
+    }
+
+    _split_tempo_events(tempo_track, tracks);
+
+    if (_mode == Smf_track_mode::channels_to_tracks) {
+        _split_channels_to_tracks(tracks);
+    }
+
+    sequence.buffers.reserve(tracks.size() + 1);
+    sequence.buffers.push_back(std::move(tempo_track));
+    for (auto &track : tracks) {
+        sequence.buffers.push_back(std::move(track));
+    }
+
+    // the buffers are in place now, so the views stay valid
+    sequence.tempo_track = sequence.buffers.front().view();
+    sequence.tracks.reserve(tracks.size());
+    for (auto i = std::size_t{1}; i < sequence.buffers.size(); ++i) {
+        sequence.tracks.push_back(sequence.buffers[i].view());
+    }
+
+    sequence.payload_arena = file->data();
+    sequence.payload_arena_size = file->size();
+    sequence.source = std::move(file);
+
+    return sequence;
+}
+
+std::vector<Smf_parser::Chunk_span> Smf_parser::_scan_chunks(const std::uint8_t *begin, const std::uint8_t *end)
+{
+    auto chunks = std::vector<Chunk_span>{};
+    smf::for_each_track(begin, end, [&chunks](const std::uint8_t *chunk_begin, const std::uint8_t *chunk_end) {
+        chunks.push_back(Chunk_span{chunk_begin, chunk_end});
+    });
+    return chunks;
+}
+
+// initialize static variable
+const std::size_t Smf_parser::_min_parallel_bytes = 256 * 1024;
+
+std::vector<Midi_track_buffer> Smf_parser::_decode_tracks(
+        const std::uint8_t *base,
+        const std::vector<Chunk_span> &chunks
+) const
+{
+    auto tracks = std::vector<Midi_track_buffer>(chunks.size());
+
+    auto total_bytes = std::size_t{0};
+    for (const auto &chunk : chunks) {
+        total_bytes += static_cast<std::size_t>(chunk.end - chunk.begin);
+    }
+
+    auto num_threads = (_num_threads == 0) ? std::max(std::thread::hardware_concurrency(), 1u) : _num_threads;
+    num_threads = std::min(num_threads, static_cast<unsigned>(chunks.size()));
+
+    if (num_threads <= 1 || total_bytes < _min_parallel_bytes) {
+        for (auto i = std::size_t{0}; i < chunks.size(); ++i) {
+            tracks[i] = _decode_track(base, chunks[i].begin, chunks[i].end);
+        }
+        return tracks;
+    }
+
+    // each worker claims the next undecoded chunk, every chunk writes only its own slot
+    // so the result is in file order and identical to the serial loop above
+    std::atomic<std::size_t> next_chunk{0};
+    auto errors = std::vector<std::exception_ptr>(chunks.size());
+    auto worker = [&]() {
+        for (auto i = next_chunk++; i < chunks.size(); i = next_chunk++) {
+            try {
+                tracks[i] = _decode_track(base, chunks[i].begin, chunks[i].end);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    auto workers = std::vector<std::thread>{};
+    workers.reserve(num_threads - 1);
+    for (auto i = 1u; i < num_threads; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : workers) {
+        thread.join();
+    }
+
+    // report the first bad chunk in file order, whichever thread hit it
+    for (const auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    return tracks;
+}
+
+Midi_track_buffer Smf_parser::_decode_track(const std::uint8_t *base, const std::uint8_t *begin, const std::uint8_t *end)
+{
+    auto track = Midi_track_buffer{};
+    // a channel event is 2-3 bytes plus its delta, so this is close for dense tracks
+    auto writer = Track_writer{track, static_cast<std::size_t>(end - begin) / 3};
+
+    auto source = Scan_source{begin, end};
+    auto state = smf::Track_state{};
+    auto event = smf::Event{};
+    auto saw_end_of_track = false;
+
+    while (!source.at_end()) {
+        if (state.running_status) {
+            // under running status a run of bytes below 0x80 is a run of events with one byte deltas,
+            // (delta, data_1[, data_2]) each, so the whole run is decoded without testing a byte
+            auto status = state.running_status;
+            auto event_size = 1 + midi::channel_data_length(status);
+            auto count = smf_scan::data_run_length(source.bits()) / event_size;
+            writer.reserve(static_cast<std::size_t>(count));
+            auto p = source.position();
+            for (auto i = 0; i < count; ++i, p += event_size) {
+                state.tick += p[0];
+                writer.put(state.tick, status, p[1], (event_size == 3) ? p[2] : std::uint8_t{0});
+            }
+            source.skip(static_cast<std::size_t>(count * event_size));
+            if (count) { continue; }
+        }
+
+        writer.reserve(1);
+        if (!smf::read_event(source, state, event)) {
+            saw_end_of_track = true;
+            break;
+        }
+        // payloads stay in the mapping, stored as offsets into it
+        auto offset = event.payload ? static_cast<std::uint32_t>(event.payload - base) : std::uint32_t{0};
+        writer.put(event.tick, event.status, event.data_1, event.data_2, offset, event.payload_length);
+    }
+
+    writer.finish();
+    track.end_tick = saw_end_of_track ? state.tick : (track.ticks.empty() ? 0 : track.ticks.back());
+    return track;
+}
+
+void Smf_parser::_split_tempo_events(Midi_track_buffer &tempo_track, std::vector<Midi_track_buffer> &tracks)
+{
+    auto did_move = false;
+
+    for (auto &track : tracks) {
+        auto first = std::size_t{0};
+        while (first < track.size() && !is_tempo_event(track, first)) { ++first; }
+        // most tracks carry no tempo events, only rebuild the ones that do
+        if (first == track.size()) { continue; }
+
+        auto kept = Midi_track_buffer{};
+        kept.reserve(track.size());
+        for (auto i = std::size_t{0}; i < track.size(); ++i) {
+            if (is_tempo_event(track, i)) {
+                tempo_track.push_back(track, i);
+            } else {
+                kept.push_back(track, i);
+            }
+        }
+        kept.end_tick = track.end_tick;
+        track = std::move(kept);
+        did_move = true;
+    }
+
+    if (did_move) {
+        tempo_track.sort_by_tick();
+        tempo_track.end_tick = std::max(tempo_track.end_tick, tempo_track.ticks.back());
+    }
+}
+
+void Smf_parser::_split_channels_to_tracks(std::vector<Midi_track_buffer> &tracks)
+{
+    // like the AudioToolbox loader: one track per channel in use, then one for sysex and meta events
+    // split every source track into per-channel runs (each still in time order) and then
+    // k-way merge the runs of each channel, simultaneous events keep source track order
+    const auto num_buckets = std::size_t{17};
+    auto runs = std::vector<std::array<Midi_track_buffer, num_buckets>>(tracks.size());
+    auto end_tick = std::uint32_t{0};
+    for (auto i = std::size_t{0}; i < tracks.size(); ++i) {
+        const auto &track = tracks[i];
+        end_tick = std::max(end_tick, track.end_tick);
+        for (auto j = std::size_t{0}; j < track.size(); ++j) {
+            auto status = track.status[j];
+            auto bucket = midi::is_channel_status(status) ? (status & 0x0Fu) : (num_buckets - 1);
+            runs[i][bucket].push_back(track, j);
+        }
+    }
+    tracks.clear();
+
+    for (auto bucket = std::size_t{0}; bucket < num_buckets; ++bucket) {
+        auto views = std::vector<Midi_track>{};
+        for (const auto &source_runs : runs) {
+            views.push_back(source_runs[bucket].view());
+        }
+
+        auto merger = Track_merger{};
+        for (auto i = std::size_t{0}; i < views.size(); ++i) {
+            merger.add(views[i], static_cast<std::uint16_t>(i));
+        }
+        auto merged = merger.merge();
+        if (merged.size() == 0) { continue; }
+
+        merged.end_tick = merged.ticks.back();
+        tracks.push_back(std::move(merged));
+
+        for (auto &source_runs : runs) {
+            source_runs[bucket] = Midi_track_buffer{};
+        }
+    }
+
+    // the last track carries the end-of-track time of the source so the sequence length is unchanged
+    if (!tracks.empty()) {
+        tracks.back().end_tick = std::max(tracks.back().end_tick, end_tick);
+    }
+}
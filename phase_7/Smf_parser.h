@@ -0,0 +1,58 @@
+#ifndef CORE_MIDI_GEN2_SMF_PARSER_H
+#define CORE_MIDI_GEN2_SMF_PARSER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Mapped_file.h"
+#include "Midi_sequence.h"
+#include "Smf_format.h"
+
+// mirrors kMusicSequenceLoadSMF_PreserveTracks and kMusicSequenceLoadSMF_ChannelsToTracks
+enum class Smf_track_mode {
+    preserve_tracks,
+    channels_to_tracks
+};
+
+// native Standard MIDI File reader, decodes the MThd/MTrk chunks in place from a mapping of the file
+// chunk headers are scanned first, then the MTrk chunks are decoded in parallel and joined in file order
+class Smf_parser {
+private:
+    struct Chunk_span {
+        const std::uint8_t *begin;
+        const std::uint8_t *end;
+    };
+
+    // below this the threads cost more than they save
+    static const std::size_t _min_parallel_bytes;
+
+    Smf_track_mode _mode;
+    // 0 picks std::thread::hardware_concurrency, 1 decodes on the calling thread
+    unsigned _num_threads;
+
+public:
+    explicit Smf_parser(Smf_track_mode mode = Smf_track_mode::preserve_tracks, unsigned num_threads = 0)
+            : _mode{mode},
+              _num_threads{num_threads} {}
+
+    ~Smf_parser() = default;
+
+    Midi_sequence load(const std::string &path) const;
+
+    Midi_sequence parse(std::shared_ptr<const Mapped_file> file) const;
+
+private:
+    static std::vector<Chunk_span> _scan_chunks(const std::uint8_t *begin, const std::uint8_t *end);
+
+    std::vector<Midi_track_buffer> _decode_tracks(const std::uint8_t *base, const std::vector<Chunk_span> &chunks) const;
+
+    static Midi_track_buffer _decode_track(const std::uint8_t *base, const std::uint8_t *begin, const std::uint8_t *end);
+
+    static void _split_tempo_events(Midi_track_buffer &tempo_track, std::vector<Midi_track_buffer> &tracks);
+
+    static void _split_channels_to_tracks(std::vector<Midi_track_buffer> &tracks);
+};
+
+#endif //CORE_MIDI_GEN2_SMF_PARSER_H
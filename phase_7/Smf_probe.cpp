@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Smf_format.h"
+#include "Smf_probe.h"
+
+namespace {
+    void write_json_string(const std::string &value, std::FILE *out)
+    {
+        std::fputc('"', out);
+        for (auto c : value) {
+            auto byte = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\') {
+                std::fputc('\\', out);
+                std::fputc(c, out);
+            } else if (byte < 0x20) {
+                std::fprintf(out, "\\u%04x", byte);
+            } else {
+                std::fputc(c, out);
+            }
+        }
+        std::fputc('"', out);
+    }
+}
+
+void Smf_probe::_read_file(const std::string &path)
+{
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error{errno, std::generic_category(), "open: " + path};
+    }
+
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        auto err = errno;
+        close(fd);
+        throw std::system_error{err, std::generic_category(), "fstat: " + path};
+    }
+
+    _buffer.resize(static_cast<std::size_t>(info.st_size));
+    auto done = std::size_t{0};
+    while (done < _buffer.size()) {
+        auto count = read(fd, _buffer.data() + done, _buffer.size() - done);
+        if (count < 0 && errno == EINTR) { continue; }
+        if (count <= 0) {
+            auto err = (count < 0) ? errno : EIO;
+            close(fd);
+            throw std::system_error{err, std::generic_category(), "read: " + path};
+        }
+        done += static_cast<std::size_t>(count);
+    }
+    close(fd);
+}
+
+std::uint32_t Smf_probe::_walk_track(
+        const std::uint8_t *begin,
+        const std::uint8_t *end,
+        std::vector<Tempo_change> &tempo_changes
+)
+{
+    // the same walk as Smf_parser::_decode_track, so the end ticks agree with it
+    auto source = smf::Memory_source{begin, end};
+    auto state = smf::Track_state{};
+    auto event = smf::Event{};
+    auto last_event_tick = std::uint32_t{0};
+
+    while (!source.at_end()) {
+        if (!smf::read_event(source, state, event)) {
+            return state.tick;
+        }
+        if (event.status == midi::meta && event.data_1 == midi::meta_tempo && event.payload_length >= 3) {
+            auto p = event.payload;
+            auto usec_per_quarter = static_cast<std::uint32_t>((p[0] << 16) | (p[1] << 8) | p[2]);
+            if (usec_per_quarter != 0) {
+                tempo_changes.push_back(Tempo_change{event.tick, usec_per_quarter});
+            }
+        }
+        last_event_tick = event.tick;
+    }
+
+    return last_event_tick;
+}
+
+Smf_summary Smf_probe::probe(const std::string &path)
+{
+    _read_file(path);
+    auto p = static_cast<const std::uint8_t *>(_buffer.data());
+    auto end = p + _buffer.size();
+    auto header = smf::read_header(p, _buffer.size(), path);
+
+    auto summary = Smf_summary{};
+    summary.path = path;
+    summary.format = header.format;
+    summary.division = header.division;
+
+    auto is_conductor = (summary.format == 1);
+    smf::for_each_track(p + header.size, end, [&](const std::uint8_t *chunk_begin, const std::uint8_t *chunk_end) {
+        auto end_tick = _walk_track(chunk_begin, chunk_end, summary.tempo_changes);
+        summary.end_tick = std::max(summary.end_tick, end_tick);
+        if (!is_conductor) {
+            summary.track_end_ticks.push_back(end_tick);
+        }
+        is_conductor = false;
+    });
+
+    // tempo events are honoured from any track, stable so file order breaks ties like the parser
+    std::stable_sort(summary.tempo_changes.begin(), summary.tempo_changes.end(),
+                     [](const Tempo_change &lhs, const Tempo_change &rhs) { return lhs.tick < rhs.tick; });
+
+    auto tempo_map = Tempo_map{summary.division, summary.tempo_changes, 1000000.};
+    summary.beats = tempo_map.beats_for_tick(summary.end_tick);
+    summary.seconds = tempo_map.seconds_for_tick(summary.end_tick);
+    return summary;
+}
+
+void Smf_probe::write_json(const Smf_summary &summary, std::FILE *out)
+{
+    auto ticks_per_quarter = midi::ticks_per_quarter(summary.division);
+    auto usec_per_quarter = (!summary.tempo_changes.empty() && summary.tempo_changes.front().tick == 0) ?
+                            summary.tempo_changes.front().usec_per_quarter :
+                            midi::default_usec_per_quarter;
+
+    std::fputs("{\"path\":", out);
+    write_json_string(summary.path, out);
+    std::fprintf(out, ",\"format\":%u,\"division\":%u,\"tracks\":%lu,\"track_beats\":[",
+                 static_cast<unsigned>(summary.format),
+                 static_cast<unsigned>(summary.division),
+                 static_cast<unsigned long>(summary.track_end_ticks.size()));
+    for (auto i = std::size_t{0}; i < summary.track_end_ticks.size(); ++i) {
+        std::fprintf(out, "%s%.3f", (i == 0) ? "" : ",", summary.track_end_ticks[i] / ticks_per_quarter);
+    }
+    std::fprintf(out, "],\"tempo_bpm\":%.3f,\"tempo_changes\":%lu,\"beats\":%.3f,\"seconds\":%.3f}\n",
+                 60000000. / usec_per_quarter,
+                 static_cast<unsigned long>(summary.tempo_changes.size()),
+                 summary.beats,
+                 summary.seconds);
+}
+
+void Smf_probe::write_json_error(const std::string &path, const std::string &error, std::FILE *out)
+{
+    std::fputs("{\"path\":", out);
+    write_json_string(path, out);
+    std::fputs(",\"error\":", out);
+    write_json_string(error, out);
+    std::fputs("}\n", out);
+}
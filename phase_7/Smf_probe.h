@@ -0,0 +1,56 @@
+#ifndef CORE_MIDI_GEN2_SMF_PROBE_H
+#define CORE_MIDI_GEN2_SMF_PROBE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Smf_parser.h"
+#include "Tempo_map.h"
+
+// what run() prints before playing, without building a sequence
+struct Smf_summary {
+    std::string path;
+    std::uint16_t format = 0;
+    std::uint16_t division = 0;
+    // per track end ticks, numbered like -t (a format 1 conductor track isn't counted)
+    std::vector<std::uint32_t> track_end_ticks;
+    // from every track, in tick order
+    std::vector<Tempo_change> tempo_changes;
+    std::uint32_t end_tick = 0;
+    double beats = 0.;
+    double seconds = 0.;
+};
+
+// walks the chunk headers and delta times of a file, decoding only tempo and end-of-track meta events
+// channel and sysex data is stepped over, nothing is stored per event
+class Smf_probe {
+private:
+    // reused across files, a corpus is mostly files of a few KB
+    std::vector<std::uint8_t> _buffer;
+
+public:
+    Smf_probe() = default;
+
+    ~Smf_probe() = default;
+
+    // throws bad_smf_file or std::system_error
+    Smf_summary probe(const std::string &path);
+
+    // one JSON object per line
+    static void write_json(const Smf_summary &summary, std::FILE *out);
+
+    static void write_json_error(const std::string &path, const std::string &error, std::FILE *out);
+
+private:
+    void _read_file(const std::string &path);
+
+    static std::uint32_t _walk_track(
+            const std::uint8_t *begin,
+            const std::uint8_t *end,
+            std::vector<Tempo_change> &tempo_changes
+    );
+};
+
+#endif //CORE_MIDI_GEN2_SMF_PROBE_H
@@ -0,0 +1,131 @@
+#include <atomic>
+#include <cstring>
+
+#include "Smf_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CORE_MIDI_GEN2_SMF_SCAN_X86 1
+#endif
+
+namespace {
+    // eight bytes per step in a general register, the multiply gathers bit 7 of byte i into bit 56 + i
+    // (assumes a little-endian host, like every target this builds for)
+    std::uint64_t high_bits_scalar(const std::uint8_t *p)
+    {
+        auto bits = std::uint64_t{0};
+        for (auto i = std::size_t{0}; i < smf_scan::block_size; i += 8) {
+            auto word = std::uint64_t{};
+            std::memcpy(&word, p + i, sizeof(word));
+            word = (word & 0x8080808080808080) >> 7;
+            bits |= ((word * 0x0102040810204080) >> 56) << i;
+        }
+        return bits;
+    }
+
+#ifdef CORE_MIDI_GEN2_SMF_SCAN_X86
+    // SSE2 is part of x86-64, movemask gathers the high bit of each byte
+    __attribute__((target("sse2")))
+    std::uint64_t high_bits_sse2(const std::uint8_t *p)
+    {
+        auto bits = std::uint64_t{0};
+        for (auto i = 0; i < 4; ++i) {
+            auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+            bits |= std::uint64_t{static_cast<std::uint16_t>(_mm_movemask_epi8(block))} << (16 * i);
+        }
+        return bits;
+    }
+
+    __attribute__((target("avx2")))
+    std::uint64_t high_bits_avx2(const std::uint8_t *p)
+    {
+        auto low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        auto high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+        return std::uint64_t{static_cast<std::uint32_t>(_mm256_movemask_epi8(low))} |
+               (std::uint64_t{static_cast<std::uint32_t>(_mm256_movemask_epi8(high))} << 32);
+    }
+#endif
+
+    using High_bits_fn = std::uint64_t (*)(const std::uint8_t *);
+
+    smf_scan::Kernel best_kernel()
+    {
+#ifdef CORE_MIDI_GEN2_SMF_SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) { return smf_scan::Kernel::avx2; }
+        if (__builtin_cpu_supports("sse2")) { return smf_scan::Kernel::sse2; }
+#endif
+        return smf_scan::Kernel::scalar;
+    }
+
+    High_bits_fn function_for(smf_scan::Kernel kernel)
+    {
+#ifdef CORE_MIDI_GEN2_SMF_SCAN_X86
+        switch (kernel) {
+            case smf_scan::Kernel::avx2:
+                return high_bits_avx2;
+            case smf_scan::Kernel::sse2:
+                return high_bits_sse2;
+            default:
+                break;
+        }
+#endif
+        (void) kernel;
+        return high_bits_scalar;
+    }
+
+    struct Dispatch {
+        std::atomic<smf_scan::Kernel> kernel;
+        std::atomic<High_bits_fn> function;
+
+        Dispatch() : kernel{best_kernel()}, function{function_for(kernel.load())} {}
+    };
+
+    // resolved on first use, so it is ready before any parser thread needs it
+    Dispatch &dispatch()
+    {
+        static Dispatch instance;
+        return instance;
+    }
+}
+
+smf_scan::Kernel smf_scan::active_kernel()
+{
+    return dispatch().kernel.load(std::memory_order_relaxed);
+}
+
+void smf_scan::force_kernel(Kernel kernel)
+{
+    if (kernel > best_kernel()) {
+        kernel = Kernel::scalar;
+    }
+    dispatch().kernel.store(kernel, std::memory_order_relaxed);
+    dispatch().function.store(function_for(kernel), std::memory_order_relaxed);
+}
+
+const char *smf_scan::kernel_name(Kernel kernel)
+{
+    switch (kernel) {
+        case Kernel::avx2:
+            return "avx2";
+        case Kernel::sse2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
+
+std::uint64_t smf_scan::high_bits(const std::uint8_t *p)
+{
+    return dispatch().function.load(std::memory_order_relaxed)(p);
+}
+
+std::uint64_t smf_scan::high_bits_tail(const std::uint8_t *p, std::size_t size)
+{
+    // past the end reads as continuation, so a VLQ running off the end is seen as too long
+    auto bits = ~std::uint64_t{0} << size;
+    for (auto i = std::size_t{0}; i < size; ++i) {
+        bits |= static_cast<std::uint64_t>(p[i] >> 7) << i;
+    }
+    return bits;
+}
@@ -0,0 +1,82 @@
+#ifndef CORE_MIDI_GEN2_SMF_SCAN_H
+#define CORE_MIDI_GEN2_SMF_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+// SMF bytes are classified by their high bit alone: it is set on VLQ continuation bytes and on status bytes
+// and clear on VLQ terminators and data bytes, so one mask per block finds both kinds of boundary
+// the mask is built 16 (SSE2) or 32 (AVX2) bytes at a time, the kernel is picked once at runtime
+namespace smf_scan {
+    enum class Kernel {
+        scalar,
+        sse2,
+        avx2
+    };
+
+    const std::size_t block_size = 64;
+
+    // best kernel this CPU supports, unless force_kernel was called
+    Kernel active_kernel();
+
+    // for benchmarks and testing, a kernel the CPU lacks falls back to scalar
+    void force_kernel(Kernel kernel);
+
+    const char *kernel_name(Kernel kernel);
+
+    // bit i set when p[i] >= 0x80, p must have block_size readable bytes
+    std::uint64_t high_bits(const std::uint8_t *p);
+
+    // as above for the last size < block_size bytes, bits past the end are set
+    std::uint64_t high_bits_tail(const std::uint8_t *p, std::size_t size);
+
+    // high-bit mask of the bytes from a moving position, refilled a block at a time
+    class Window {
+    private:
+        const std::uint8_t *_base = nullptr;
+        const std::uint8_t *_end = nullptr;
+        std::uint64_t _bits = 0;
+        // _base is null until the first refill, it can't be compared against before then
+        bool _is_loaded = false;
+
+        // a VLQ is at most 4 bytes and an event header at most 5, so keep 8 bytes of lookahead
+        static const std::size_t _lookahead = 8;
+
+        void _refill(const std::uint8_t *p)
+        {
+            _base = p;
+            _is_loaded = true;
+            auto size = static_cast<std::size_t>(_end - p);
+            _bits = (size >= block_size) ? high_bits(p) : high_bits_tail(p, size);
+        }
+
+    public:
+        explicit Window(const std::uint8_t *end) : _end{end} {}
+
+        // bit 0 is p itself, at least the next 8 bits are valid
+        // bits past the window read as set, so neither a VLQ nor a run of data bytes can extend past it
+        std::uint64_t bits_at(const std::uint8_t *p)
+        {
+            if (!_is_loaded || p < _base || static_cast<std::size_t>(p - _base) > block_size - _lookahead) {
+                _refill(p);
+            }
+            auto shift = static_cast<unsigned>(p - _base);
+            return (_bits >> shift) | (~std::uint64_t{0} << (63 - shift) << 1);
+        }
+    };
+
+    // number of bytes in the VLQ at the start of bits, 5 or more means it is too long
+    // (65 for a whole block of continuation bytes, ctz of 0 is undefined)
+    inline int vlq_length(std::uint64_t bits)
+    {
+        return ~bits ? __builtin_ctzll(~bits) + 1 : 65;
+    }
+
+    // number of bytes below 0x80 at the start of bits, a whole block of data bytes under running status is 64
+    inline int data_run_length(std::uint64_t bits)
+    {
+        return bits ? __builtin_ctzll(bits) : 64;
+    }
+};
+
+#endif //CORE_MIDI_GEN2_SMF_SCAN_H
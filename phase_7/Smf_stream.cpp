@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Smf_stream.h"
+
+using smf::read_u16_be;
+using smf::read_u32_be;
+
+namespace {
+    // short reads only happen at the end of the file
+    std::size_t read_at(int fd, std::uint8_t *buffer, std::size_t size, std::uint64_t offset)
+    {
+        auto total = std::size_t{0};
+        while (total < size) {
+            auto count = pread(fd, buffer + total, size - total, static_cast<off_t>(offset + total));
+            if (count < 0) {
+                if (errno == EINTR) { continue; }
+                throw std::system_error{errno, std::generic_category(), "pread"};
+            }
+            if (count == 0) { break; }
+            total += static_cast<std::size_t>(count);
+        }
+        return total;
+    }
+}
+
+Smf_track_cursor::Smf_track_cursor(
+        int fd,
+        std::uint64_t offset,
+        std::uint64_t length,
+        std::uint16_t track,
+        std::size_t window_size
+)
+        : _fd{fd},
+          _offset{offset},
+          _end{offset + length},
+          _track{track},
+          _window(window_size) {}
+
+std::uint8_t Smf_track_cursor::read_byte(const char *error)
+{
+    if (_pos == _fill) {
+        if (_offset == _end) {
+            throw bad_smf_file{error};
+        }
+        auto wanted = static_cast<std::size_t>(std::min<std::uint64_t>(_window.size(), _end - _offset));
+        _fill = read_at(_fd, _window.data(), wanted, _offset);
+        if (_fill == 0) {
+            throw bad_smf_file{"truncated track"};
+        }
+        _offset += _fill;
+        _pos = 0;
+    }
+    return _window[_pos++];
+}
+
+std::uint32_t Smf_track_cursor::read_vlq()
+{
+    auto value = std::uint32_t{0};
+    for (auto i = 0; i < 4; ++i) {
+        auto byte = read_byte("truncated variable-length quantity");
+        value = (value << 7) | (byte & 0x7F);
+        if (!(byte & 0x80)) { return value; }
+    }
+    throw bad_smf_file{"variable-length quantity longer than 4 bytes"};
+}
+
+const std::uint8_t *Smf_track_cursor::read_payload(std::uint32_t length, const char *error)
+{
+    // the payload buffer only ever grows to the largest sysex/meta event in the track
+    _payload.resize(length);
+    auto copied = std::size_t{0};
+    while (copied < length) {
+        if (_pos == _fill) {
+            _payload[copied++] = read_byte(error);
+            continue;
+        }
+        auto count = std::min(_fill - _pos, length - copied);
+        std::memcpy(_payload.data() + copied, _window.data() + _pos, count);
+        _pos += count;
+        copied += count;
+    }
+    return _payload.data();
+}
+
+bool Smf_track_cursor::next(Stream_event &event)
+{
+    while (!_done) {
+        if (_at_end()) {
+            _done = true;
+            break;
+        }
+
+        // the same walk as Smf_parser, with its leniency about running status
+        auto track_event = smf::Event{};
+        if (!smf::read_event(*this, _state, track_event)) {
+            _done = true;
+            break;
+        }
+
+        event = Stream_event{};
+        event.tick = track_event.tick;
+        event.status = track_event.status;
+        event.data_1 = track_event.data_1;
+        event.data_2 = track_event.data_2;
+        event.payload = track_event.payload;
+        event.payload_length = track_event.payload_length;
+        event.track = _track;
+        return true;
+    }
+    return false;
+}
+
+Smf_stream_reader::Smf_stream_reader(const std::string &path, std::size_t window_size)
+{
+    _fd = open(path.c_str(), O_RDONLY);
+    if (_fd < 0) {
+        throw std::system_error{errno, std::generic_category(), "open: " + path};
+    }
+
+    try {
+        std::uint8_t header[14];
+        if (read_at(_fd, header, sizeof(header), 0) != sizeof(header) || std::memcmp(header, "MThd", 4) != 0) {
+            throw bad_smf_file{"missing MThd header: " + path};
+        }
+
+        auto header_length = read_u32_be(header + 4);
+        _format = read_u16_be(header + 8);
+        auto num_tracks = read_u16_be(header + 10);
+        _division = read_u16_be(header + 12);
+        if (header_length < 6 || _format > 2 || _division == 0) {
+            throw bad_smf_file{"unsupported header: " + path};
+        }
+
+        struct stat info{};
+        if (fstat(_fd, &info) != 0) {
+            throw std::system_error{errno, std::generic_category(), "fstat: " + path};
+        }
+        auto file_size = static_cast<std::uint64_t>(info.st_size);
+
+        // only the 8 byte chunk headers are read here, the track data is left for the cursors
+        _cursors.reserve(num_tracks);
+        auto offset = std::uint64_t{8} + header_length;
+        std::uint8_t chunk_header[8];
+        while (read_at(_fd, chunk_header, sizeof(chunk_header), offset) == sizeof(chunk_header)) {
+            // be lenient about a truncated final chunk, like Smf_parser
+            auto chunk_length = std::min<std::uint64_t>(read_u32_be(chunk_header + 4), file_size - offset - 8);
+            if (std::memcmp(chunk_header, "MTrk", 4) == 0) {
+                auto track = static_cast<std::uint16_t>(_cursors.size());
+                _cursors.emplace_back(_fd, offset + 8, chunk_length, track, window_size);
+            }
+            offset += 8 + chunk_length;
+        }
+    } catch (...) {
+        close(_fd);
+        throw;
+    }
+}
+
+Smf_stream_reader::~Smf_stream_reader()
+{
+    close(_fd);
+}
+
+Smf_stream_merger::Smf_stream_merger(Smf_stream_reader &reader, const std::vector<bool> &enabled)
+        : _reader(reader)
+{
+    for (auto i = std::size_t{0}; i < _reader.track_count(); ++i) {
+        if (i < enabled.size() && !enabled[i]) { continue; }
+        _advance(i);
+    }
+}
+
+void Smf_stream_merger::_advance(std::size_t track)
+{
+    auto event = Stream_event{};
+    if (_reader.cursor(track).next(event)) {
+        _heads.push(event);
+    }
+}
+
+bool Smf_stream_merger::next(Stream_event &event)
+{
+    if (_pending >= 0) {
+        _advance(static_cast<std::size_t>(_pending));
+        _pending = -1;
+    }
+    if (_heads.empty()) { return false; }
+
+    event = _heads.top();
+    _heads.pop();
+    _pending = event.track;
+    return true;
+}
+
+Stream_clock::Stream_clock(std::uint16_t division, double srate)
+        : _srate{srate},
+          _is_smpte{(division & 0x8000) != 0}
+{
+    if (_is_smpte) {
+        // SMPTE time is absolute, tempo events don't change it
+        auto frames_per_sec = -static_cast<std::int8_t>(division >> 8);
+        auto ticks_per_sec = (frames_per_sec == 29 ? 29.97 : frames_per_sec) * (division & 0xFF);
+        _samples_per_tick = _srate / ticks_per_sec;
+        _ticks_per_quarter = ticks_per_sec * midi::default_usec_per_quarter / 1000000.;
+    } else {
+        _ticks_per_quarter = division;
+        _samples_per_tick = midi::default_usec_per_quarter * _srate / (_ticks_per_quarter * 1000000.);
+    }
+}
+
+double Stream_clock::sample_for_tick(std::uint32_t tick)
+{
+    _sample += (tick - _tick) * _samples_per_tick;
+    _tick = tick;
+    return _sample;
+}
+
+void Stream_clock::apply(const Stream_event &event)
+{
+    if (_is_smpte || event.status != midi::meta || event.data_1 != midi::meta_tempo || event.payload_length < 3) {
+        return;
+    }
+
+    auto usec_per_quarter = (event.payload[0] << 16) | (event.payload[1] << 8) | event.payload[2];
+    if (usec_per_quarter == 0) { return; }
+
+    sample_for_tick(event.tick);
+    _samples_per_tick = usec_per_quarter * _srate / (_ticks_per_quarter * 1000000.);
+}
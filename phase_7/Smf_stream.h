@@ -0,0 +1,143 @@
+#ifndef CORE_MIDI_GEN2_SMF_STREAM_H
+#define CORE_MIDI_GEN2_SMF_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "Smf_format.h"
+#include "Smf_parser.h"
+
+// one event pulled from a stream, payload is only valid until the owning cursor advances
+struct Stream_event {
+    std::uint32_t tick = 0;
+    std::uint8_t status = 0;
+    // for meta events data_1 holds the meta type
+    std::uint8_t data_1 = 0;
+    std::uint8_t data_2 = 0;
+    const std::uint8_t *payload = nullptr;
+    std::uint32_t payload_length = 0;
+    // index of the MTrk chunk in the file
+    std::uint16_t track = 0;
+};
+
+// decodes one MTrk chunk lazily through a small read-ahead window filled with pread
+class Smf_track_cursor {
+private:
+    int _fd;
+    std::uint64_t _offset;
+    std::uint64_t _end;
+    std::uint16_t _track;
+    std::vector<std::uint8_t> _window;
+    std::size_t _pos = 0;
+    std::size_t _fill = 0;
+    std::vector<std::uint8_t> _payload;
+    smf::Track_state _state;
+    bool _done = false;
+
+    // the cursor is the byte source of its events
+    template<typename Source>
+    friend bool smf::read_event(Source &source, smf::Track_state &state, smf::Event &event);
+
+public:
+    Smf_track_cursor(int fd, std::uint64_t offset, std::uint64_t length, std::uint16_t track, std::size_t window_size);
+
+    ~Smf_track_cursor() = default;
+
+    // false once the end-of-track event (or the end of the chunk) is reached
+    bool next(Stream_event &event);
+
+    std::uint16_t track() const { return _track; }
+
+private:
+    bool _at_end() const { return _pos == _fill && _offset == _end; }
+
+    // the source read_event walks, reads past the end of the chunk throw the error
+    std::uint8_t read_byte(const char *error);
+
+    std::uint32_t read_vlq();
+
+    // copied out of the window, valid until the next payload
+    const std::uint8_t *read_payload(std::uint32_t length, const char *error);
+};
+
+// bounded-memory reader: only chunk headers are read up front, each track is decoded through its own cursor
+class Smf_stream_reader {
+private:
+    int _fd = -1;
+    std::uint16_t _format = 0;
+    std::uint16_t _division = 0;
+    std::vector<Smf_track_cursor> _cursors;
+
+public:
+    explicit Smf_stream_reader(const std::string &path, std::size_t window_size = 4096);
+
+    ~Smf_stream_reader();
+
+    Smf_stream_reader(const Smf_stream_reader &) = delete;
+
+    Smf_stream_reader &operator=(const Smf_stream_reader &) = delete;
+
+    std::uint16_t format() const { return _format; }
+
+    std::uint16_t division() const { return _division; }
+
+    std::size_t track_count() const { return _cursors.size(); }
+
+    Smf_track_cursor &cursor(std::size_t i) { return _cursors[i]; }
+};
+
+// pulls events from the cursors on demand in time order, ties go to the lower track index
+class Smf_stream_merger {
+private:
+    struct Later {
+        bool operator()(const Stream_event &lhs, const Stream_event &rhs) const
+        {
+            return lhs.tick != rhs.tick ? lhs.tick > rhs.tick : lhs.track > rhs.track;
+        }
+    };
+
+    Smf_stream_reader &_reader;
+    std::priority_queue<Stream_event, std::vector<Stream_event>, Later> _heads;
+    // the cursor whose event was handed out last, only advanced on the next call so its payload stays valid
+    int _pending = -1;
+
+public:
+    // disabled tracks are never read
+    Smf_stream_merger(Smf_stream_reader &reader, const std::vector<bool> &enabled);
+
+    ~Smf_stream_merger() = default;
+
+    bool next(Stream_event &event);
+
+private:
+    void _advance(std::size_t track);
+};
+
+// running tick to sample conversion for events that arrive in time order
+class Stream_clock {
+private:
+    double _srate;
+    double _ticks_per_quarter;
+    bool _is_smpte;
+    double _samples_per_tick;
+    std::uint32_t _tick = 0;
+    double _sample = 0.;
+
+public:
+    Stream_clock(std::uint16_t division, double srate);
+
+    ~Stream_clock() = default;
+
+    double ticks_per_quarter() const { return _ticks_per_quarter; }
+
+    // tick must not go backwards
+    double sample_for_tick(std::uint32_t tick);
+
+    // picks up tempo meta events, must be called in stream order
+    void apply(const Stream_event &event);
+};
+
+#endif //CORE_MIDI_GEN2_SMF_STREAM_H
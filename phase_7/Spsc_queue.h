@@ -0,0 +1,87 @@
+#ifndef CORE_MIDI_GEN2_SPSC_QUEUE_H
+#define CORE_MIDI_GEN2_SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// bounded single-producer/single-consumer ring, wait-free on both sides
+// the slots are inline, so nothing is allocated after construction and no operation can block,
+// which is what lets the audio thread be one of the two sides
+// one thread may push and one other thread may pop, never more
+template<typename T, std::size_t Capacity>
+class Spsc_queue {
+private:
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Spsc_queue capacity must be a power of two");
+
+    // each index sits on its own cache line with the owning side's copy of the other index,
+    // so the two threads only share a line when one of them runs out of room or of items
+    static const std::size_t _cache_line = 64;
+
+    // written by the consumer
+    alignas(_cache_line) std::atomic<std::size_t> _head{0};
+    std::size_t _cached_tail = 0;
+
+    // written by the producer
+    alignas(_cache_line) std::atomic<std::size_t> _tail{0};
+    std::size_t _cached_head = 0;
+
+    alignas(_cache_line) std::array<T, Capacity> _slots;
+
+public:
+    Spsc_queue() = default;
+
+    Spsc_queue(const Spsc_queue &) = delete;
+
+    Spsc_queue &operator=(const Spsc_queue &) = delete;
+
+    // producer side, false when full
+    bool try_push(const T &item)
+    {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _cached_head == Capacity) {
+            _cached_head = _head.load(std::memory_order_acquire);
+            if (tail - _cached_head == Capacity) { return false; }
+        }
+        _slots[tail & (Capacity - 1)] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, the oldest item or nullptr when empty, valid until pop
+    const T *front()
+    {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head == _cached_tail) {
+            _cached_tail = _tail.load(std::memory_order_acquire);
+            if (head == _cached_tail) { return nullptr; }
+        }
+        return &_slots[head & (Capacity - 1)];
+    }
+
+    // consumer side, only after front returned an item
+    void pop()
+    {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // consumer side
+    bool try_pop(T &item)
+    {
+        auto next = front();
+        if (!next) { return false; }
+        item = *next;
+        pop();
+        return true;
+    }
+
+    // either side, only a snapshot
+    bool empty() const
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+    static std::size_t capacity() { return Capacity; }
+};
+
+#endif //CORE_MIDI_GEN2_SPSC_QUEUE_H
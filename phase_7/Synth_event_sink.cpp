@@ -0,0 +1,20 @@
+#include "Synth_event_sink.h"
+#include "util.h"
+
+void Synth_event_sink::channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset)
+{
+    auto result = MusicDeviceMIDIEvent(_synth, status, data_1, data_2, offset);
+    check_error(result, "MusicDeviceMIDIEvent");
+}
+
+void Synth_event_sink::sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t)
+{
+    // the SMF stores an F0 message without its status byte
+    _sysex_buffer.clear();
+    if (status == midi::sysex) {
+        _sysex_buffer.push_back(midi::sysex);
+    }
+    _sysex_buffer.insert(_sysex_buffer.end(), payload, payload + length);
+    auto result = MusicDeviceSysEx(_synth, _sysex_buffer.data(), static_cast<UInt32>(_sysex_buffer.size()));
+    check_error(result, "MusicDeviceSysEx");
+}
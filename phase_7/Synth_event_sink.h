@@ -0,0 +1,30 @@
+#ifndef CORE_MIDI_GEN2_SYNTH_EVENT_SINK_H
+#define CORE_MIDI_GEN2_SYNTH_EVENT_SINK_H
+
+#include <AudioToolbox/AudioToolbox.h>
+
+#include <vector>
+
+#include "Sequencer.h"
+
+// schedules events on a music device for its next render, offsets are passed on as MusicDeviceMIDIEvent's
+class Synth_event_sink : public Event_sink {
+private:
+    AudioUnit _synth = nullptr;
+    // complete sysex message handed to MusicDeviceSysEx
+    std::vector<UInt8> _sysex_buffer;
+
+public:
+    Synth_event_sink() = default;
+
+    explicit Synth_event_sink(AudioUnit synth) : _synth{synth} {}
+
+    ~Synth_event_sink() override = default;
+
+    void channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset) override;
+
+    // MusicDeviceSysEx has no offset, the message applies from the start of the next render
+    void sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset) override;
+};
+
+#endif //CORE_MIDI_GEN2_SYNTH_EVENT_SINK_H
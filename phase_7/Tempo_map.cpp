@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "Tempo_map.h"
+
+Tempo_map::Tempo_map(const Midi_sequence &sequence, double srate)
+        : _srate{static_cast<std::uint32_t>(std::lround(srate))},
+          _ticks_per_quarter{sequence.ticks_per_quarter()}
+{
+    auto changes = tempo_changes(sequence);
+    _init(sequence.division, changes);
+}
+
+Tempo_map::Tempo_map(std::uint16_t division, Array_view<Tempo_change> changes, double srate)
+        : _srate{static_cast<std::uint32_t>(std::lround(srate))},
+          _ticks_per_quarter{midi::ticks_per_quarter(division)}
+{
+    _init(division, changes);
+}
+
+std::vector<Tempo_change> Tempo_map::tempo_changes(const Midi_sequence &sequence)
+{
+    auto changes = std::vector<Tempo_change>{};
+    const auto &track = sequence.tempo_track;
+    for (auto i = std::size_t{0}; i < track.size(); ++i) {
+        if (track.status[i] != midi::meta || track.data_1[i] != midi::meta_tempo || sequence.payload_length(track, i) < 3) {
+            continue;
+        }
+        auto payload = sequence.payload(track, i);
+        auto usec_per_quarter = static_cast<std::uint32_t>((payload[0] << 16) | (payload[1] << 8) | payload[2]);
+        if (usec_per_quarter == 0) { continue; }
+
+        changes.push_back(Tempo_change{track.ticks[i], usec_per_quarter});
+    }
+    return changes;
+}
+
+void Tempo_map::_init(std::uint16_t division, Array_view<Tempo_change> changes)
+{
+    if (division & 0x8000) {
+        // SMPTE time is absolute, tempo events don't change it
+        auto frames_per_sec = static_cast<std::uint64_t>(-static_cast<std::int8_t>(division >> 8));
+        auto ticks_per_frame = std::uint64_t{division & 0xFFu};
+        if (frames_per_sec == 29) {
+            // 29.97 drop frame is 30000 / 1001 frames per second
+            _denominator = 30000 * ticks_per_frame;
+            _add_segment(0, midi::default_usec_per_quarter, std::uint64_t{_srate} * 1001);
+        } else {
+            _denominator = frames_per_sec * ticks_per_frame;
+            _add_segment(0, midi::default_usec_per_quarter, _srate);
+        }
+        return;
+    }
+
+    _denominator = std::uint64_t{division} * 1000000;
+    _add_segment(0, midi::default_usec_per_quarter, std::uint64_t{midi::default_usec_per_quarter} * _srate);
+    for (const auto &change : changes) {
+        _add_segment(change.tick, change.usec_per_quarter, std::uint64_t{change.usec_per_quarter} * _srate);
+    }
+}
+
+void Tempo_map::_add_segment(std::uint32_t tick, std::uint32_t usec_per_quarter, std::uint64_t numerator_per_tick)
+{
+    if (!_segments.empty() && _segments.back().tick == tick) {
+        // of several tempo events on one tick the last one wins
+        _segments.back().usec_per_quarter = usec_per_quarter;
+        _segments.back().numerator_per_tick = numerator_per_tick;
+        return;
+    }
+
+    auto numerator_start = Numerator{0};
+    if (!_segments.empty()) {
+        const auto &last = _segments.back();
+        numerator_start = last.numerator_start + Numerator{tick - last.tick} * last.numerator_per_tick;
+    }
+    _segments.push_back(Segment{tick, usec_per_quarter, numerator_per_tick, numerator_start});
+}
+
+std::size_t Tempo_map::_segment_for_tick(std::uint32_t tick) const
+{
+    auto it = std::upper_bound(
+            _segments.begin(),
+            _segments.end(),
+            tick,
+            [](std::uint32_t value, const Segment &segment) { return value < segment.tick; }
+    );
+    return static_cast<std::size_t>(it - _segments.begin()) - 1;
+}
+
+bool Tempo_map::_starts_after(std::size_t segment, std::int64_t sample) const
+{
+    return sample < 0 || _segments[segment].numerator_start > Numerator(sample) * _denominator;
+}
+
+std::size_t Tempo_map::_segment_for_sample(std::int64_t sample) const
+{
+    // last segment starting at or before the sample, the first one starts at 0
+    auto low = std::size_t{0};
+    auto high = _segments.size();
+    while (high - low > 1) {
+        auto mid = low + (high - low) / 2;
+        if (_starts_after(mid, sample)) {
+            high = mid;
+        } else {
+            low = mid;
+        }
+    }
+    return low;
+}
+
+std::int64_t Tempo_map::_sample_in_segment(std::size_t segment, std::uint32_t tick) const
+{
+    const auto &current = _segments[segment];
+    auto numerator = current.numerator_start + Numerator{tick - current.tick} * current.numerator_per_tick;
+    // round up, an event plays on the first sample at or after its exact time
+    return static_cast<std::int64_t>((numerator + _denominator - 1) / _denominator);
+}
+
+std::uint32_t Tempo_map::_tick_in_segment(std::size_t segment, std::int64_t sample) const
+{
+    const auto &current = _segments[segment];
+    if (_starts_after(segment, sample)) { return current.tick; }
+
+    auto offset = (Numerator(sample) * _denominator - current.numerator_start) / current.numerator_per_tick;
+    auto tick = Numerator{current.tick} + offset;
+    return tick > std::numeric_limits<std::uint32_t>::max() ?
+           std::numeric_limits<std::uint32_t>::max() :
+           static_cast<std::uint32_t>(tick);
+}
+
+std::int64_t Tempo_map::sample_for_tick(std::uint32_t tick) const
+{
+    return _sample_in_segment(_segment_for_tick(tick), tick);
+}
+
+std::uint32_t Tempo_map::tick_for_sample(std::int64_t sample) const
+{
+    return _tick_in_segment(_segment_for_sample(sample), sample);
+}
+
+std::int64_t Tempo_map::Cursor::sample_for_tick(std::uint32_t tick)
+{
+    const auto &segments = _map->_segments;
+    if (tick < segments[_segment].tick) {
+        // went backwards, start over with a search
+        _segment = _map->_segment_for_tick(tick);
+    } else {
+        while (_segment + 1 < segments.size() && segments[_segment + 1].tick <= tick) { ++_segment; }
+    }
+    return _map->_sample_in_segment(_segment, tick);
+}
+
+std::uint32_t Tempo_map::Cursor::tick_for_sample(std::int64_t sample)
+{
+    if (_map->_starts_after(_segment, sample)) {
+        _segment = _map->_segment_for_sample(sample);
+    } else {
+        while (_segment + 1 < _map->_segments.size() && !_map->_starts_after(_segment + 1, sample)) { ++_segment; }
+    }
+    return _map->_tick_in_segment(_segment, sample);
+}
@@ -0,0 +1,101 @@
+#ifndef CORE_MIDI_GEN2_TEMPO_MAP_H
+#define CORE_MIDI_GEN2_TEMPO_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Array_view.h"
+#include "Midi_sequence.h"
+
+// a tempo meta event reduced to what the map needs
+struct Tempo_change {
+    std::uint32_t tick;
+    std::uint32_t usec_per_quarter;
+};
+
+// tick <-> sample conversion built once from the tempo track
+// positions are kept exactly as numerators over a common denominator (division * 1e6 for PPQ files)
+// so converting never accumulates rounding error, however many tempo changes there are
+class Tempo_map {
+public:
+    using Numerator = unsigned __int128;
+
+    struct Segment {
+        std::uint32_t tick;
+        std::uint32_t usec_per_quarter;
+        // samples per tick times the denominator
+        std::uint64_t numerator_per_tick;
+        // start of the segment in samples times the denominator
+        Numerator numerator_start;
+    };
+
+    // amortised O(1) lookups for non-decreasing ticks or samples, as sequential playback produces
+    class Cursor {
+    private:
+        const Tempo_map *_map;
+        std::size_t _segment = 0;
+
+    public:
+        explicit Cursor(const Tempo_map &map) : _map{&map} {}
+
+        std::int64_t sample_for_tick(std::uint32_t tick);
+
+        std::uint32_t tick_for_sample(std::int64_t sample);
+    };
+
+private:
+    std::vector<Segment> _segments;
+    std::uint64_t _denominator = 1;
+    std::uint32_t _srate = 0;
+    double _ticks_per_quarter = 1.;
+
+    void _init(std::uint16_t division, Array_view<Tempo_change> changes);
+
+public:
+    Tempo_map() = default;
+
+    // the sample rate is rounded to whole Hz
+    Tempo_map(const Midi_sequence &sequence, double srate);
+
+    // changes must be in tick order, e.g. as stored in a sequence cache
+    Tempo_map(std::uint16_t division, Array_view<Tempo_change> changes, double srate);
+
+    // the valid tempo events of the tempo track
+    static std::vector<Tempo_change> tempo_changes(const Midi_sequence &sequence);
+
+    ~Tempo_map() = default;
+
+    // first sample at or after the tick, O(log n) in the number of tempo changes
+    std::int64_t sample_for_tick(std::uint32_t tick) const;
+
+    // the last tick at or before the sample, O(log n)
+    std::uint32_t tick_for_sample(std::int64_t sample) const;
+
+    double seconds_for_tick(std::uint32_t tick) const { return static_cast<double>(sample_for_tick(tick)) / _srate; }
+
+    double beats_for_tick(std::uint32_t tick) const { return tick / _ticks_per_quarter; }
+
+    std::uint32_t tick_for_beats(double beats) const { return static_cast<std::uint32_t>(beats * _ticks_per_quarter); }
+
+    std::uint32_t usec_per_quarter_at(std::uint32_t tick) const { return _segments[_segment_for_tick(tick)].usec_per_quarter; }
+
+    std::uint32_t srate() const { return _srate; }
+
+    const std::vector<Segment> &segments() const { return _segments; }
+
+private:
+    std::size_t _segment_for_tick(std::uint32_t tick) const;
+
+    std::size_t _segment_for_sample(std::int64_t sample) const;
+
+    bool _starts_after(std::size_t segment, std::int64_t sample) const;
+
+    std::int64_t _sample_in_segment(std::size_t segment, std::uint32_t tick) const;
+
+    std::uint32_t _tick_in_segment(std::size_t segment, std::int64_t sample) const;
+
+    void _add_segment(std::uint32_t tick, std::uint32_t usec_per_quarter, std::uint64_t numerator_per_tick);
+};
+
+#endif //CORE_MIDI_GEN2_TEMPO_MAP_H
@@ -0,0 +1,235 @@
+#ifndef CORE_MIDI_GEN2_TIMING_WHEEL_H
+#define CORE_MIDI_GEN2_TIMING_WHEEL_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// hierarchical timing wheel, items are released in per-tick batches once the clock passes their deadline
+// times are nanoseconds on whatever monotonic clock the caller advances it with
+// 4 levels of 256 slots, level 0 holds the next 256 ticks, each level above covers 256 times the one below and
+// is cascaded down a slot at a time as level 0 wraps, so insert and expire are O(1) per item
+// a tick is rounded up from the deadline, nothing is ever released early
+// the nodes are pooled up front, nothing allocates after construction apart from growing the caller's batch
+template<typename T>
+class Timing_wheel {
+public:
+    struct Entry {
+        std::int64_t deadline;
+        // insertion order, ties on a deadline are released in it
+        std::uint64_t sequence;
+        T item;
+    };
+
+private:
+    static const int _levels = 4;
+    static const int _slot_bits = 8;
+    static const std::size_t _num_slots = std::size_t{1} << _slot_bits;
+    static const std::uint64_t _slot_mask = _num_slots - 1;
+    // past the top level, an item is parked in it and re-placed each time its slot cascades
+    static const std::uint64_t _max_delta = (std::uint64_t{1} << (_levels * _slot_bits)) - 1;
+    static const std::uint32_t _none = UINT32_MAX;
+
+    struct Node {
+        Entry entry;
+        std::uint32_t next;
+    };
+
+    struct Slot {
+        std::uint32_t head = _none;
+        std::uint32_t tail = _none;
+    };
+
+    std::int64_t _origin;
+    std::int64_t _resolution;
+    // the last tick released
+    std::uint64_t _current = 0;
+    std::uint64_t _next_sequence = 0;
+    std::vector<Node> _nodes;
+    std::uint32_t _free = _none;
+    std::size_t _size = 0;
+    std::array<std::array<Slot, _num_slots>, _levels> _slots;
+    // inserted on or before the last tick released, they go out with the next batch
+    Slot _overdue;
+
+public:
+    // origin is tick 0, resolution the length of a tick, capacity the most items held at once
+    Timing_wheel(std::int64_t origin, std::int64_t resolution, std::size_t capacity)
+            : _origin{origin},
+              _resolution{resolution},
+              _nodes(capacity)
+    {
+        for (auto i = std::size_t{0}; i < capacity; ++i) {
+            _nodes[i].next = (i + 1 < capacity) ? static_cast<std::uint32_t>(i + 1) : _none;
+        }
+        _free = capacity ? 0 : _none;
+    }
+
+    ~Timing_wheel() = default;
+
+    // false when the pool is full, a deadline already released goes out with the next batch
+    bool insert(std::int64_t deadline, const T &item)
+    {
+        if (_free == _none) { return false; }
+
+        auto index = _free;
+        _free = _nodes[index].next;
+        _nodes[index].entry = Entry{deadline, _next_sequence++, item};
+        _place(index);
+        ++_size;
+        return true;
+    }
+
+    // releases every tick up to now, appending the items to due in deadline then insertion order
+    void advance(std::int64_t now, std::vector<Entry> &due)
+    {
+        if (now < _origin) { return; }
+        auto target = static_cast<std::uint64_t>((now - _origin) / _resolution);
+        if (_size == 0) {
+            // nothing to cascade, skip the idle ticks
+            _current = std::max(_current, target);
+            return;
+        }
+
+        auto first = due.size();
+        _expire(_overdue, due);
+        while (_current < target) {
+            ++_current;
+            for (auto level = 1; level < _levels; ++level) {
+                auto shift = level * _slot_bits;
+                if (_current & ((std::uint64_t{1} << shift) - 1)) { break; }
+                _cascade(level, (_current >> shift) & _slot_mask);
+            }
+            _expire(_slots[0][_current & _slot_mask], due);
+            // a cascaded item due on this very tick
+            _expire(_overdue, due);
+            if (_size == 0) {
+                _current = target;
+            }
+        }
+
+        // a cascaded item can land behind a later one inserted straight into level 0
+        std::sort(due.begin() + first, due.end(), [](const Entry &lhs, const Entry &rhs) {
+            return lhs.deadline != rhs.deadline ? lhs.deadline < rhs.deadline : lhs.sequence < rhs.sequence;
+        });
+    }
+
+    // moves every held item to deadline_for(item, old_deadline), e.g. after a tempo change
+    // only future slots hold items, whatever has been released is left alone
+    template<typename F>
+    void reschedule(F &&deadline_for)
+    {
+        auto chain = _none;
+        auto unlink = [this, &chain](Slot &slot) {
+            if (slot.head == _none) { return; }
+            _nodes[slot.tail].next = chain;
+            chain = slot.head;
+            slot = Slot{};
+        };
+        unlink(_overdue);
+        for (auto &level : _slots) {
+            for (auto &slot : level) {
+                unlink(slot);
+            }
+        }
+
+        while (chain != _none) {
+            auto next = _nodes[chain].next;
+            auto &entry = _nodes[chain].entry;
+            entry.deadline = deadline_for(entry.item, entry.deadline);
+            _place(chain);
+            chain = next;
+        }
+    }
+
+    // earliest time advance can release anything, or pull a slot down from above, for sleeping until
+    std::int64_t next_expiry() const
+    {
+        if (_overdue.head != _none) { return _time_for_tick(_current); }
+        for (auto tick = _current + 1; tick <= (_current | _slot_mask); ++tick) {
+            if (_slots[0][tick & _slot_mask].head != _none) { return _time_for_tick(tick); }
+        }
+        return _time_for_tick((_current | _slot_mask) + 1);
+    }
+
+    std::size_t size() const { return _size; }
+
+    bool empty() const { return _size == 0; }
+
+private:
+    std::int64_t _time_for_tick(std::uint64_t tick) const
+    {
+        return _origin + static_cast<std::int64_t>(tick) * _resolution;
+    }
+
+    std::uint64_t _tick_for_deadline(std::int64_t deadline) const
+    {
+        if (deadline <= _origin) { return 0; }
+        return static_cast<std::uint64_t>((deadline - _origin + _resolution - 1) / _resolution);
+    }
+
+    Slot &_slot_for(std::int64_t deadline)
+    {
+        auto tick = _tick_for_deadline(deadline);
+        if (tick <= _current) { return _overdue; }
+        auto delta = std::min(tick - _current, _max_delta);
+        tick = _current + delta;
+
+        auto level = 0;
+        while (level < _levels - 1 && delta >= (std::uint64_t{1} << ((level + 1) * _slot_bits))) {
+            ++level;
+        }
+        return _slots[level][(tick >> (level * _slot_bits)) & _slot_mask];
+    }
+
+    void _place(std::uint32_t index)
+    {
+        auto &slot = _slot_for(_nodes[index].entry.deadline);
+
+        // appended, so a slot keeps insertion order
+        _nodes[index].next = _none;
+        if (slot.tail == _none) {
+            slot.head = index;
+        } else {
+            _nodes[slot.tail].next = index;
+        }
+        slot.tail = index;
+    }
+
+    void _cascade(int level, std::uint64_t slot_index)
+    {
+        auto index = _slots[level][slot_index].head;
+        _slots[level][slot_index] = Slot{};
+        while (index != _none) {
+            auto next = _nodes[index].next;
+            _place(index);
+            index = next;
+        }
+    }
+
+    void _expire(Slot &slot, std::vector<Entry> &due)
+    {
+        auto index = slot.head;
+        slot = Slot{};
+        while (index != _none) {
+            auto next = _nodes[index].next;
+            due.push_back(_nodes[index].entry);
+            _nodes[index].next = _free;
+            _free = index;
+            --_size;
+            index = next;
+        }
+    }
+};
+
+// initialize static variables
+template<typename T> const int Timing_wheel<T>::_levels;
+template<typename T> const int Timing_wheel<T>::_slot_bits;
+template<typename T> const std::size_t Timing_wheel<T>::_num_slots;
+template<typename T> const std::uint64_t Timing_wheel<T>::_slot_mask;
+template<typename T> const std::uint64_t Timing_wheel<T>::_max_delta;
+template<typename T> const std::uint32_t Timing_wheel<T>::_none;
+
+#endif //CORE_MIDI_GEN2_TIMING_WHEEL_H
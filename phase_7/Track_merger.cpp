@@ -0,0 +1,114 @@
+#include <algorithm>
+
+#include "Track_merger.h"
+
+Merged_timeline::Merged_timeline(Midi_track_buffer buffer, std::vector<std::uint16_t> source_buffer)
+        : _buffer{std::move(buffer)},
+          _source_buffer{std::move(source_buffer)}
+{
+    events = _buffer.view();
+    sources = _source_buffer;
+}
+
+void Track_merger::add(const Midi_track &track, std::uint16_t source)
+{
+    _inputs.push_back(Input{&track, source});
+}
+
+void Track_merger::_sift_down(std::size_t i)
+{
+    auto size = _heap.size();
+    auto head = _heap[i];
+    while (true) {
+        auto child = 2 * i + 1;
+        if (child >= size) { break; }
+        if (child + 1 < size && _is_before(_heap[child + 1], _heap[child])) { ++child; }
+        if (!_is_before(_heap[child], head)) { break; }
+        _heap[i] = _heap[child];
+        i = child;
+    }
+    _heap[i] = head;
+}
+
+Midi_track_buffer Track_merger::merge(std::vector<std::uint16_t> *sources)
+{
+    auto merged = Midi_track_buffer{};
+    auto total = std::size_t{0};
+    for (const auto &input : _inputs) {
+        total += input.track->size();
+        merged.end_tick = std::max(merged.end_tick, input.track->end_tick);
+    }
+    // sized up front, the loop below only stores
+    merged.resize(total);
+    if (sources) {
+        sources->resize(total);
+    }
+
+    _positions.assign(_inputs.size(), 0);
+    _heap.clear();
+    for (auto i = std::size_t{0}; i < _inputs.size(); ++i) {
+        const auto &track = *_inputs[i].track;
+        if (!track.empty()) {
+            _heap.push_back(Head{track.ticks[0], _inputs[i].source, static_cast<std::uint32_t>(i)});
+        }
+    }
+    for (auto i = _heap.size() / 2; i-- > 0;) {
+        _sift_down(i);
+    }
+
+    for (auto out = std::size_t{0}; !_heap.empty(); ++out) {
+        auto &top = _heap.front();
+        const auto &input = _inputs[top.input];
+        const auto &track = *input.track;
+        auto position = _positions[top.input]++;
+
+        merged.ticks[out] = track.ticks[position];
+        merged.status[out] = track.status[position];
+        merged.data_1[out] = track.data_1[position];
+        merged.data_2[out] = track.data_2[position];
+        merged.payload_offset[out] = track.payload_offset[position];
+        merged.payload_length[out] = track.payload_length[position];
+        if (sources) {
+            (*sources)[out] = input.source;
+        }
+
+        // replace the top in place rather than pop + push, one sift per event
+        if (position + 1 < track.size()) {
+            top.tick = track.ticks[position + 1];
+        } else {
+            top = _heap.back();
+            _heap.pop_back();
+        }
+        if (!_heap.empty()) {
+            _sift_down(0);
+        }
+    }
+
+    return merged;
+}
+
+Merged_timeline Track_merger::merge_timeline(const Midi_sequence &sequence, const std::vector<bool> &enabled)
+{
+    auto merger = Track_merger{};
+    // tempo first, so a tempo change applies before anything else on its tick
+    merger.add(sequence.tempo_track, Merged_timeline::tempo_source);
+    for (auto i = std::size_t{0}; i < sequence.tracks.size(); ++i) {
+        if (i < enabled.size() && !enabled[i]) { continue; }
+        merger.add(sequence.tracks[i], static_cast<std::uint16_t>(i + 1));
+    }
+
+    auto sources = std::vector<std::uint16_t>{};
+    auto buffer = merger.merge(&sources);
+    return Merged_timeline{std::move(buffer), std::move(sources)};
+}
+
+std::vector<bool> Track_merger::enabled_tracks(std::size_t track_count, const std::set<int> &track_set)
+{
+    auto enabled = std::vector<bool>(track_count, track_set.empty());
+    for (auto track : track_set) {
+        if (track >= 0 && static_cast<std::size_t>(track) < track_count) {
+            enabled[track] = true;
+        }
+    }
+    return enabled;
+}
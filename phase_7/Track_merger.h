@@ -0,0 +1,93 @@
+#ifndef CORE_MIDI_GEN2_TRACK_MERGER_H
+#define CORE_MIDI_GEN2_TRACK_MERGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include "Array_view.h"
+#include "Midi_sequence.h"
+
+// every unmuted track of a sequence interleaved into one time-ordered event stream
+// events are copied, so playback is a single linear pass instead of hopping between tracks
+class Merged_timeline {
+private:
+    Midi_track_buffer _buffer;
+    std::vector<std::uint16_t> _source_buffer;
+
+public:
+    // source of the tempo track, track i of the sequence is source i + 1
+    static const std::uint16_t tempo_source = 0;
+
+    Midi_track events;
+    Array_view<std::uint16_t> sources;
+
+    Merged_timeline() = default;
+
+    Merged_timeline(Midi_track_buffer buffer, std::vector<std::uint16_t> source_buffer);
+
+    // views over storage owned elsewhere, e.g. a mapped cache file
+    Merged_timeline(const Midi_track &events, Array_view<std::uint16_t> sources)
+            : events{events},
+              sources{sources} {}
+
+    Merged_timeline(Merged_timeline &&) = default;
+
+    Merged_timeline &operator=(Merged_timeline &&) = default;
+
+    Merged_timeline(const Merged_timeline &) = delete;
+
+    Merged_timeline &operator=(const Merged_timeline &) = delete;
+
+    std::size_t size() const { return events.size(); }
+
+    bool empty() const { return events.empty(); }
+};
+
+// k-way merge of time-ordered tracks with a binary min-heap of track heads, O(n log k)
+// simultaneous events come out in source order, and in track order within a source
+class Track_merger {
+private:
+    struct Head {
+        std::uint32_t tick;
+        std::uint16_t source;
+        std::uint32_t input;
+    };
+
+    struct Input {
+        const Midi_track *track;
+        std::uint16_t source;
+    };
+
+    std::vector<Input> _inputs;
+    std::vector<std::size_t> _positions;
+    std::vector<Head> _heap;
+
+public:
+    Track_merger() = default;
+
+    ~Track_merger() = default;
+
+    // ties between tracks are broken by the lower source
+    void add(const Midi_track &track, std::uint16_t source);
+
+    // sources is filled in parallel with the result when it isn't null
+    Midi_track_buffer merge(std::vector<std::uint16_t> *sources = nullptr);
+
+    // the tempo track and every enabled track of the sequence, muted tracks never enter the heap
+    static Merged_timeline merge_timeline(const Midi_sequence &sequence, const std::vector<bool> &enabled);
+
+    // -t semantics: an empty set plays everything, otherwise only the listed (zero based) tracks
+    static std::vector<bool> enabled_tracks(std::size_t track_count, const std::set<int> &track_set);
+
+private:
+    static bool _is_before(const Head &lhs, const Head &rhs)
+    {
+        return lhs.tick != rhs.tick ? lhs.tick < rhs.tick : lhs.source < rhs.source;
+    }
+
+    void _sift_down(std::size_t i);
+};
+
+#endif //CORE_MIDI_GEN2_TRACK_MERGER_H
@@ -0,0 +1,59 @@
+#include <algorithm>
+
+#include "Voice_limiter.h"
+
+// initialize static variables
+const std::uint32_t Voice_limiter::min_voices;
+const std::uint32_t Voice_limiter::hold_blocks;
+
+Voice_limiter::Voice_limiter(std::uint32_t max_voices, float high_load, float low_load)
+        : _max_voices{max_voices},
+          _high_load{high_load},
+          _low_load{std::min(low_load, high_load)},
+          _ceiling{max_voices},
+          _lowest_ceiling{max_voices} {}
+
+void Voice_limiter::update(float load, std::uint32_t active_voices)
+{
+    _smoothed_load += (load - _smoothed_load) * 0.125f;
+    if (load > _peak_load.load(std::memory_order_relaxed)) {
+        _peak_load.store(load, std::memory_order_relaxed);
+    }
+
+    auto ceiling = _ceiling.load(std::memory_order_relaxed);
+    auto floor = std::min(min_voices, _max_voices);
+    if (load > _high_load) {
+        _calm_blocks = 0;
+        // a block costs roughly its voices, so that many fewer brings it back between the thresholds
+        auto target = (_high_load + _low_load) / 2.f;
+        auto fitting = static_cast<std::uint32_t>(active_voices * target / load);
+        auto lowered = std::max(std::min(fitting, ceiling - 1), floor);
+        if (lowered < ceiling) {
+            _ceiling.store(lowered, std::memory_order_relaxed);
+            _lowered.fetch_add(1, std::memory_order_relaxed);
+            if (lowered < _lowest_ceiling.load(std::memory_order_relaxed)) {
+                _lowest_ceiling.store(lowered, std::memory_order_relaxed);
+            }
+        }
+        return;
+    }
+
+    // only a ceiling that is holding voices back has anything to learn from a light load
+    if (_smoothed_load >= _low_load || active_voices < ceiling || ceiling >= _max_voices) {
+        _calm_blocks = 0;
+        return;
+    }
+    if (++_calm_blocks < hold_blocks) { return; }
+
+    _calm_blocks = 0;
+    auto raised = std::min(ceiling + std::max(ceiling / 8, 1u), _max_voices);
+    _ceiling.store(raised, std::memory_order_relaxed);
+    _raised.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Voice_limiter::reset()
+{
+    _smoothed_load = 0.f;
+    _calm_blocks = 0;
+    _ceiling.store(_max_voices, std::memory_order_relaxed);
+}
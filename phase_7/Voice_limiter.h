@@ -0,0 +1,70 @@
+#ifndef CORE_MIDI_GEN2_VOICE_LIMITER_H
+#define CORE_MIDI_GEN2_VOICE_LIMITER_H
+
+#include <atomic>
+#include <cstdint>
+
+// the polyphony ceiling of the built-in synth while playing live, from what its blocks cost against their deadline
+// (the block's frames / srate), in place of a fixed CPU load setting on the music device
+// a block over the high load cuts the ceiling at once, in proportion to the overshoot, so the next block fits,
+// and it only rises again, a step at a time, after hold_blocks in a row under the low load with every voice it allows in use,
+// between the two it stays put, so a load near either threshold doesn't make the ceiling hunt
+// the render thread updates it, the counters are atomics the control thread can read while playing
+class Voice_limiter {
+public:
+    // the ceiling never goes below this, a few voices always play
+    static const std::uint32_t min_voices = 4;
+    // blocks under the low load before each step up
+    static const std::uint32_t hold_blocks = 16;
+
+private:
+    std::uint32_t _max_voices;
+    float _high_load;
+    float _low_load;
+    // render thread only
+    float _smoothed_load = 0.f;
+    std::uint32_t _calm_blocks = 0;
+
+    std::atomic<std::uint32_t> _ceiling;
+    std::atomic<std::uint32_t> _lowest_ceiling;
+    std::atomic<std::uint32_t> _lowered{0};
+    std::atomic<std::uint32_t> _raised{0};
+    std::atomic<std::uint64_t> _shed_voices{0};
+    std::atomic<float> _peak_load{0.f};
+
+public:
+    // loads are shares of the block's duration, high_load above low_load
+    Voice_limiter(std::uint32_t max_voices, float high_load, float low_load);
+
+    ~Voice_limiter() = default;
+
+    Voice_limiter(const Voice_limiter &) = delete;
+
+    Voice_limiter &operator=(const Voice_limiter &) = delete;
+
+    // render thread, once per block, with the voices that were sounding while it rendered
+    void update(float load, std::uint32_t active_voices);
+
+    // render thread, voices faded out because they were over the ceiling
+    void count_shed(std::uint32_t voices) { _shed_voices.fetch_add(voices, std::memory_order_relaxed); }
+
+    // render thread, back to every voice
+    void reset();
+
+    std::uint32_t ceiling() const { return _ceiling.load(std::memory_order_relaxed); }
+
+    std::uint32_t max_voices() const { return _max_voices; }
+
+    std::uint32_t lowest_ceiling() const { return _lowest_ceiling.load(std::memory_order_relaxed); }
+
+    // times the ceiling was cut and raised
+    std::uint32_t lowered() const { return _lowered.load(std::memory_order_relaxed); }
+
+    std::uint32_t raised() const { return _raised.load(std::memory_order_relaxed); }
+
+    std::uint64_t shed_voices() const { return _shed_voices.load(std::memory_order_relaxed); }
+
+    float peak_load() const { return _peak_load.load(std::memory_order_relaxed); }
+};
+
+#endif //CORE_MIDI_GEN2_VOICE_LIMITER_H
@@ -0,0 +1,671 @@
+#include <algorithm>
+#include <cmath>
+
+#include "Drift_clock.h"
+#include "Midi_sequence.h"
+#include "Wavetable_synth.h"
+
+// initialize static variables
+const std::size_t Wavetable_synth::queue_capacity;
+const std::uint32_t Wavetable_synth::control_frames;
+const std::uint8_t Wavetable_synth::drum_channel;
+
+namespace {
+    const float pi = 3.14159265f;
+    // the mix of a few dozen full scale voices stays clear of clipping
+    const float output_gain = .25f;
+    // decay and release times are to -60 dB, where the envelope is taken as silent
+    const float silence = .001f;
+    const float exclusive_cut_seconds = .005f;
+    const double vibrato_hz = 5.5;
+    const float vibrato_depth_cents = 50.f;
+
+    // what the sysex queues in place of the message, the synth only understands these two
+    const std::uint8_t system_on = 0;
+    const std::uint8_t master_volume = 1;
+
+    const std::uint8_t cc_bank_select = 0;
+    const std::uint8_t cc_modulation = 1;
+    const std::uint8_t cc_data_entry = 6;
+    const std::uint8_t cc_volume = 7;
+    const std::uint8_t cc_pan = 10;
+    const std::uint8_t cc_expression = 11;
+    const std::uint8_t cc_data_entry_lsb = 38;
+    const std::uint8_t cc_sustain = 64;
+    const std::uint8_t cc_nrpn_lsb = 98;
+    const std::uint8_t cc_nrpn_msb = 99;
+    const std::uint8_t cc_rpn_lsb = 100;
+    const std::uint8_t cc_rpn_msb = 101;
+    const std::uint8_t cc_all_sound_off = 120;
+    const std::uint8_t cc_reset_all_controllers = 121;
+    const std::uint8_t cc_all_notes_off = 123;
+
+    const std::uint16_t rpn_bend_range = 0;
+    const std::uint16_t rpn_fine_tune = 1;
+    const std::uint16_t rpn_coarse_tune = 2;
+    const std::uint16_t rpn_none = 0x3FFF;
+
+    float squared_gain(std::uint8_t value)
+    {
+        auto gain = value / 127.f;
+        return gain * gain;
+    }
+
+    // per frame multiplier that falls to silence over frames
+    float decay_coefficient(std::uint32_t frames)
+    {
+        return std::exp(std::log(silence) / static_cast<float>(std::max(frames, 1u)));
+    }
+}
+
+Wavetable_synth::Wavetable_synth(const Sample_bank &bank, std::uint32_t max_voices, double srate, Disk_streamer *streamer)
+        : _bank(bank),
+          _streamer{streamer},
+          _srate{srate},
+          _voices(std::max(max_voices, 1u))
+{
+    _system_reset();
+}
+
+void Wavetable_synth::channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset)
+{
+    _queue_event(Queued_event{offset, status, data_1, data_2});
+}
+
+bool Wavetable_synth::is_system_on(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length)
+{
+    // F0 7E <device> 09 01 F7
+    return status == midi::sysex && length >= 4 && payload[0] == 0x7E && payload[2] == 0x09 && payload[3] == 0x01;
+}
+
+void Wavetable_synth::sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset)
+{
+    // an F7 escape carries anything at all, only a complete F0 message can be a universal one
+    if (status != midi::sysex || length < 4) { return; }
+
+    if (is_system_on(status, payload, length)) {
+        _queue_event(Queued_event{offset, midi::sysex, system_on, 0});
+    }
+    // F0 7F <device> 04 01 <lsb> <msb> F7, the coarse half is plenty for a gain
+    if (payload[0] == 0x7F && payload[2] == 0x04 && payload[3] == 0x01 && length >= 6) {
+        _queue_event(Queued_event{offset, midi::sysex, master_volume, payload[5]});
+    }
+}
+
+void Wavetable_synth::_queue_event(const Queued_event &event)
+{
+    if (_queued == _queue.size()) {
+        // late is better than lost, a dropped note off would hang
+        _apply(event);
+        return;
+    }
+
+    // events nearly always arrive in offset order, so this is an append
+    auto position = _queued;
+    while (position > 0 && _queue[position - 1].offset > event.offset) {
+        _queue[position] = _queue[position - 1];
+        --position;
+    }
+    _queue[position] = event;
+    ++_queued;
+}
+
+void Wavetable_synth::render(std::uint32_t frames, float *left, float *right)
+{
+    auto start_ns = _limiter ? Drift_clock::now_ns() : std::int64_t{0};
+    std::fill(left, left + frames, 0.f);
+    std::fill(right, right + frames, 0.f);
+    if (_streamer) {
+        _streamer->service();
+    }
+
+    auto next = std::size_t{0};
+    auto done = std::uint32_t{0};
+    while (done < frames) {
+        for (; next < _queued && _queue[next].offset <= done; ++next) {
+            _apply(_queue[next]);
+        }
+
+        auto until = std::min(frames, done + control_frames);
+        if (next < _queued) {
+            until = std::min(until, _queue[next].offset);
+        }
+
+        _update_channels();
+        _render_voices(until - done, left + done, right + done);
+        _frame += until - done;
+        done = until;
+    }
+
+    // what is left is due in a later render
+    std::copy(_queue.begin() + next, _queue.begin() + _queued, _queue.begin());
+    _queued -= next;
+    for (auto i = std::size_t{0}; i < _queued; ++i) {
+        _queue[i].offset -= frames;
+    }
+
+    if (_limiter && frames) {
+        auto load = (Drift_clock::now_ns() - start_ns) / (frames / _srate * 1e9);
+        _limiter->update(static_cast<float>(load), _sounding_voices());
+        _shed_voices(_limiter->ceiling());
+    }
+}
+
+void Wavetable_synth::reset()
+{
+    _queued = 0;
+    _frame = 0;
+    _system_reset();
+    if (_limiter) {
+        _limiter->reset();
+    }
+}
+
+void Wavetable_synth::limit_voices(float high_load, float low_load)
+{
+    _limiter = std::make_unique<Voice_limiter>(max_voices(), high_load, low_load);
+}
+
+std::uint32_t Wavetable_synth::active_voices() const
+{
+    return static_cast<std::uint32_t>(std::count_if(_voices.begin(), _voices.end(), [](const Voice &voice) {
+        return voice.is_active();
+    }));
+}
+
+void Wavetable_synth::_apply(const Queued_event &event)
+{
+    if (event.status == midi::sysex) {
+        if (event.data_1 == system_on) {
+            _system_reset();
+        } else if (event.data_1 == master_volume) {
+            _master_gain = squared_gain(event.data_2);
+        }
+        return;
+    }
+
+    auto channel = static_cast<std::uint8_t>(event.status & 0x0F);
+    switch (event.status & 0xF0) {
+        case 0x80:
+            _note_off(channel, event.data_1);
+            break;
+        case 0x90:
+            if (event.data_2) {
+                _note_on(channel, event.data_1, event.data_2);
+            } else {
+                _note_off(channel, event.data_1);
+            }
+            break;
+        case 0xB0:
+            _control_change(channel, event.data_1, event.data_2);
+            break;
+        case 0xC0:
+            _program_change(channel, event.data_1);
+            break;
+        case 0xE0:
+            _channels[channel].pitch_bend = static_cast<std::uint16_t>((event.data_2 << 7) | event.data_1);
+            break;
+        default:
+            // aftertouch isn't mapped to anything
+            break;
+    }
+}
+
+void Wavetable_synth::_control_change(std::uint8_t channel, std::uint8_t controller, std::uint8_t value)
+{
+    auto &state = _channels[channel];
+    switch (controller) {
+        case cc_bank_select:
+            // takes effect at the next program change, as GM has it
+            state.bank_msb = value;
+            break;
+        case cc_modulation:
+            state.modulation = value;
+            break;
+        case cc_data_entry:
+            _data_entry(state, value, true);
+            break;
+        case cc_data_entry_lsb:
+            _data_entry(state, value, false);
+            break;
+        case cc_volume:
+            state.volume = value;
+            break;
+        case cc_pan:
+            state.pan = value;
+            break;
+        case cc_expression:
+            state.expression = value;
+            break;
+        case cc_sustain:
+            state.sustain = value >= 64;
+            if (!state.sustain) {
+                for (auto &voice : _voices) {
+                    if (voice.is_active() && voice.channel == channel && voice.sustained) { _release(voice); }
+                }
+            }
+            break;
+        case cc_nrpn_lsb:
+        case cc_nrpn_msb:
+            state.rpn = rpn_none;
+            break;
+        case cc_rpn_lsb:
+            state.rpn = static_cast<std::uint16_t>((state.rpn & 0x3F80) | value);
+            break;
+        case cc_rpn_msb:
+            state.rpn = static_cast<std::uint16_t>((value << 7) | (state.rpn & 0x7F));
+            break;
+        case cc_all_sound_off:
+            for (auto &voice : _voices) {
+                if (voice.channel == channel) { voice.stage = Stage::off; }
+            }
+            break;
+        case cc_reset_all_controllers:
+            _reset_controllers(state);
+            for (auto &voice : _voices) {
+                if (voice.is_active() && voice.channel == channel && voice.sustained) { _release(voice); }
+            }
+            break;
+        default:
+            // omni and mono/poly mode messages turn the notes off too
+            if (controller >= cc_all_notes_off) {
+                for (auto &voice : _voices) {
+                    if (voice.is_active() && voice.channel == channel) { _note_off(channel, voice.key); }
+                }
+            }
+            break;
+    }
+}
+
+void Wavetable_synth::_data_entry(Channel &channel, std::uint8_t value, bool is_msb)
+{
+    switch (channel.rpn) {
+        case rpn_bend_range: {
+            // semitones in the MSB, cents in the LSB
+            auto semitones = std::floor(channel.bend_range_cents / 100.f);
+            auto cents = channel.bend_range_cents - semitones * 100.f;
+            channel.bend_range_cents = is_msb ? value * 100.f + cents : semitones * 100.f + std::min(value, std::uint8_t{99});
+            break;
+        }
+        case rpn_fine_tune:
+            channel.fine_tune = static_cast<std::uint16_t>(is_msb ? (value << 7) | (channel.fine_tune & 0x7F) : (channel.fine_tune & 0x3F80) | value);
+            break;
+        case rpn_coarse_tune:
+            if (is_msb) { channel.coarse_tune = value; }
+            break;
+        default:
+            return;
+    }
+    channel.tune_cents = (channel.fine_tune - 8192) / 8192.f * 100.f + (channel.coarse_tune - 64) * 100.f;
+}
+
+void Wavetable_synth::_reset_controllers(Channel &channel)
+{
+    // the controllers RP-015 resets, volume, pan, bank and program are left alone
+    channel.modulation = 0;
+    channel.expression = 127;
+    channel.sustain = false;
+    channel.pitch_bend = 8192;
+    channel.rpn = rpn_none;
+}
+
+void Wavetable_synth::_system_reset()
+{
+    for (auto &voice : _voices) {
+        voice.stage = Stage::off;
+    }
+    _master_gain = 1.f;
+    for (auto c = std::size_t{0}; c < _channels.size(); ++c) {
+        _channels[c] = Channel{};
+        _program_change(static_cast<std::uint8_t>(c), 0);
+    }
+}
+
+void Wavetable_synth::_program_change(std::uint8_t channel, std::uint8_t program)
+{
+    auto &state = _channels[channel];
+    state.program = program;
+    auto bank = std::uint16_t{state.bank_msb};
+    if (channel == drum_channel) {
+        bank = Sample_bank::percussion_bank;
+    }
+    // resolved once here, a note on only walks the preset's regions
+    state.preset = _bank.find_preset(bank, program);
+}
+
+void Wavetable_synth::_note_on(std::uint8_t channel, std::uint8_t key, std::uint8_t velocity)
+{
+    const auto *preset = _channels[channel].preset;
+    if (!preset) { return; }
+
+    ++_note_ons;
+    for (const auto &region : preset->regions) {
+        if (!region.matches(key, velocity) || !region.samples || !region.length) { continue; }
+
+        if (region.exclusive_class) {
+            for (auto &voice : _voices) {
+                if (voice.is_active() && voice.channel == channel && voice.region->exclusive_class == region.exclusive_class) {
+                    _cut(voice);
+                }
+            }
+        }
+        _start_voice(_free_voice(), region, channel, key, velocity);
+    }
+}
+
+void Wavetable_synth::_note_off(std::uint8_t channel, std::uint8_t key)
+{
+    auto sustain = _channels[channel].sustain;
+    for (auto &voice : _voices) {
+        if (!voice.is_active() || voice.channel != channel || voice.key != key) { continue; }
+        if (voice.stage == Stage::release || voice.sustained || voice.region->one_shot) { continue; }
+
+        if (sustain) {
+            voice.sustained = true;
+        } else {
+            _release(voice);
+        }
+    }
+}
+
+void Wavetable_synth::_start_voice(Voice &voice, const Sample_region &region, std::uint8_t channel, std::uint8_t key, std::uint8_t velocity)
+{
+    voice.region = &region;
+    voice.samples = region.samples;
+    if (voice.stream) {
+        // a stolen voice's reads are for the note it played
+        _streamer->stop(static_cast<std::uint32_t>(&voice - _voices.data()));
+        voice.stream = nullptr;
+    }
+    if (_streamer) {
+        if (const auto *source = _streamer->find(region)) {
+            auto index = static_cast<std::uint32_t>(&voice - _voices.data());
+            if (!source->is_streamed) {
+                voice.samples = source->attack.data();
+            } else if (index < _streamer->stream_count()) {
+                voice.stream = &_streamer->start(index, *source);
+            }
+        }
+    }
+    voice.position = 0.;
+    auto cents = (key - region.root_key) * region.key_cents + region.tune_cents;
+    voice.base_step = region.sample_rate / _srate * std::exp2(cents / 1200.);
+    voice.started = _note_ons;
+    voice.loops = region.loops && region.loop_start < region.loop_end && region.loop_end <= region.length;
+    voice.velocity_gain = squared_gain(velocity) * std::pow(10.f, -region.attenuation_db / 20.f);
+    voice.channel = channel;
+    voice.key = key;
+    voice.sustained = false;
+    voice.is_fading = false;
+    _enter_stage(voice, Stage::delay);
+    _target_gains(voice, voice.gain_left, voice.gain_right);
+}
+
+Wavetable_synth::Voice &Wavetable_synth::_free_voice()
+{
+    auto ceiling = _limiter ? _limiter->ceiling() : max_voices();
+    if (_sounding_voices() < ceiling) {
+        auto free = std::find_if(_voices.begin(), _voices.end(), [](const Voice &voice) { return !voice.is_active(); });
+        if (free != _voices.end()) { return *free; }
+    }
+
+    ++_stolen;
+    return *_victim(false);
+}
+
+Wavetable_synth::Voice *Wavetable_synth::_victim(bool skips_fading)
+{
+    auto victim = static_cast<Voice *>(nullptr);
+    for (auto &voice : _voices) {
+        if (!voice.is_active() || (skips_fading && voice.is_fading)) { continue; }
+        if (!victim || _is_victim_before(voice, *victim)) {
+            victim = &voice;
+        }
+    }
+    // every voice is free or fading, the first free one will do
+    return victim ? victim : &_voices.front();
+}
+
+bool Wavetable_synth::_is_victim_before(const Voice &voice, const Voice &other) const
+{
+    // a voice already on its way out, then the quietest, then the oldest
+    auto is_releasing = voice.stage == Stage::release;
+    if (is_releasing != (other.stage == Stage::release)) { return is_releasing; }
+
+    auto loudness = voice.level * std::max(voice.gain_left, voice.gain_right);
+    auto other_loudness = other.level * std::max(other.gain_left, other.gain_right);
+    if (loudness != other_loudness) { return loudness < other_loudness; }
+    return voice.started < other.started;
+}
+
+void Wavetable_synth::_shed_voices(std::uint32_t ceiling)
+{
+    auto sounding = _sounding_voices();
+    if (sounding <= ceiling) { return; }
+
+    auto shed = sounding - ceiling;
+    for (auto i = std::uint32_t{0}; i < shed; ++i) {
+        _cut(*_victim(true));
+    }
+    _limiter->count_shed(shed);
+}
+
+std::uint32_t Wavetable_synth::_sounding_voices() const
+{
+    // a fading voice is as good as gone
+    return static_cast<std::uint32_t>(std::count_if(_voices.begin(), _voices.end(), [](const Voice &voice) {
+        return voice.is_active() && !voice.is_fading;
+    }));
+}
+
+void Wavetable_synth::_release(Voice &voice)
+{
+    voice.sustained = false;
+    _enter_stage(voice, Stage::release);
+}
+
+void Wavetable_synth::_cut(Voice &voice)
+{
+    voice.sustained = false;
+    voice.is_fading = true;
+    voice.stage = Stage::release;
+    voice.stage_frames = _frames_for(exclusive_cut_seconds);
+    voice.envelope_mul = decay_coefficient(voice.stage_frames);
+    voice.envelope_add = 0.f;
+}
+
+std::uint32_t Wavetable_synth::_frames_for(float seconds) const
+{
+    return static_cast<std::uint32_t>(std::max(seconds, 0.f) * _srate + .5);
+}
+
+void Wavetable_synth::_enter_stage(Voice &voice, Stage stage)
+{
+    const auto &envelope = voice.region->envelope;
+    // a stage with no length passes straight on to the next
+    while (true) {
+        voice.stage = stage;
+        voice.envelope_mul = 1.f;
+        voice.envelope_add = 0.f;
+        voice.stage_frames = 0;
+
+        switch (stage) {
+            case Stage::delay:
+                voice.level = 0.f;
+                voice.stage_frames = _frames_for(envelope.delay);
+                if (voice.stage_frames) { return; }
+                stage = Stage::attack;
+                break;
+            case Stage::attack:
+                voice.stage_frames = std::max(_frames_for(envelope.attack), 1u);
+                voice.envelope_add = (1.f - voice.level) / voice.stage_frames;
+                return;
+            case Stage::hold:
+                voice.level = 1.f;
+                voice.stage_frames = _frames_for(envelope.hold);
+                if (voice.stage_frames) { return; }
+                stage = Stage::decay;
+                break;
+            case Stage::decay:
+                voice.stage_frames = _frames_for(envelope.decay);
+                if (!voice.stage_frames) {
+                    stage = Stage::sustain;
+                    break;
+                }
+                voice.envelope_mul = decay_coefficient(voice.stage_frames);
+                voice.envelope_add = envelope.sustain * (1.f - voice.envelope_mul);
+                return;
+            case Stage::sustain:
+                voice.level = envelope.sustain;
+                if (voice.level > silence) { return; }
+                stage = Stage::off;
+                break;
+            case Stage::release:
+                voice.stage_frames = std::max(_frames_for(envelope.release), 1u);
+                voice.envelope_mul = decay_coefficient(voice.stage_frames);
+                return;
+            case Stage::off:
+                voice.level = 0.f;
+                return;
+        }
+    }
+}
+
+void Wavetable_synth::_update_channels()
+{
+    auto vibrato = static_cast<float>(std::sin(2. * pi * vibrato_hz * _frame / _srate));
+    for (auto &channel : _channels) {
+        auto cents = (channel.pitch_bend - 8192) / 8192.f * channel.bend_range_cents + channel.tune_cents;
+        cents += channel.modulation / 127.f * vibrato_depth_cents * vibrato;
+        channel.pitch_ratio = std::exp2(cents / 1200.f);
+        channel.gain = output_gain * _master_gain * squared_gain(channel.volume) * squared_gain(channel.expression);
+        channel.pan_position = std::max(-1.f, (channel.pan - 64) / 63.f);
+    }
+}
+
+void Wavetable_synth::_target_gains(const Voice &voice, float &left, float &right) const
+{
+    const auto &channel = _channels[voice.channel];
+    auto gain = channel.gain * voice.velocity_gain;
+    auto pan = std::min(std::max(voice.region->pan + channel.pan_position, -1.f), 1.f);
+    // constant power, so a sound keeps its loudness as it moves across
+    auto angle = (pan + 1.f) * pi / 4.f;
+    left = gain * std::cos(angle);
+    right = gain * std::sin(angle);
+}
+
+void Wavetable_synth::_render_voices(std::uint32_t frames, float *left, float *right)
+{
+    for (auto &voice : _voices) {
+        if (voice.is_active()) {
+            _render_voice(voice, frames, left, right);
+        }
+        // however the voice ended, its reads stop here
+        if (voice.stream && !voice.is_active()) {
+            _streamer->stop(static_cast<std::uint32_t>(&voice - _voices.data()));
+            voice.stream = nullptr;
+        }
+    }
+}
+
+void Wavetable_synth::_render_voice(Voice &voice, std::uint32_t frames, float *left, float *right)
+{
+    const auto &region = *voice.region;
+    const auto *samples = voice.samples;
+    auto step = voice.base_step * _channels[voice.channel].pitch_ratio;
+
+    auto target_left = 0.f;
+    auto target_right = 0.f;
+    _target_gains(voice, target_left, target_right);
+    auto ramp_left = (target_left - voice.gain_left) / frames;
+    auto ramp_right = (target_right - voice.gain_right) / frames;
+    // what the streamer had read as the block started
+    auto available = voice.stream ? voice.stream->available() : 0u;
+    auto underrun = false;
+
+    auto done = std::uint32_t{0};
+    while (done < frames && voice.is_active()) {
+        // the frames until the envelope changes stage, the sustain stage runs to the end of the block
+        auto count = frames - done;
+        if (voice.stage != Stage::sustain) {
+            count = std::min(count, voice.stage_frames);
+        }
+
+        auto i = done;
+        if (voice.stage == Stage::delay) {
+            // nothing sounds yet and the sample doesn't move
+            voice.gain_left += ramp_left * count;
+            voice.gain_right += ramp_right * count;
+            i += count;
+        }
+        for (auto end = done + count; i < end; ++i) {
+            auto index = static_cast<std::uint32_t>(voice.position);
+            auto fraction = static_cast<float>(voice.position - index);
+            auto sample = 0.f;
+            auto next_sample = 0.f;
+            if (voice.stream) {
+                sample = voice.stream->frame(index, available, underrun);
+                next_sample = voice.stream->frame(index + 1, available, underrun);
+            } else {
+                sample = samples[index];
+                auto next = index + 1;
+                if (voice.loops && next >= region.loop_end) {
+                    next_sample = samples[region.loop_start];
+                } else if (next < region.length) {
+                    next_sample = samples[next];
+                }
+            }
+            auto value = (sample + (next_sample - sample) * fraction) * (voice.level / 32768.f);
+
+            left[i] += value * voice.gain_left;
+            right[i] += value * voice.gain_right;
+            voice.gain_left += ramp_left;
+            voice.gain_right += ramp_right;
+            voice.level = voice.level * voice.envelope_mul + voice.envelope_add;
+
+            voice.position += step;
+            if (voice.loops && !voice.stream && voice.position >= region.loop_end) {
+                voice.position -= region.loop_end - region.loop_start;
+            } else if (!voice.loops && voice.position >= region.length) {
+                // played out
+                voice.stage = Stage::off;
+                ++i;
+                break;
+            }
+        }
+        done = i;
+        if (!voice.is_active()) { break; }
+
+        if (voice.stage != Stage::sustain) {
+            voice.stage_frames -= count;
+            if (!voice.stage_frames) {
+                switch (voice.stage) {
+                    case Stage::delay:
+                        _enter_stage(voice, Stage::attack);
+                        break;
+                    case Stage::attack:
+                        _enter_stage(voice, Stage::hold);
+                        break;
+                    case Stage::hold:
+                        _enter_stage(voice, Stage::decay);
+                        break;
+                    case Stage::decay:
+                        _enter_stage(voice, Stage::sustain);
+                        break;
+                    default:
+                        _enter_stage(voice, Stage::off);
+                        break;
+                }
+            }
+        }
+    }
+
+    if (voice.stream) {
+        voice.stream->consume(static_cast<std::uint32_t>(voice.position));
+        if (underrun) { ++_underruns; }
+    }
+
+    // exactly on target, however the ramp rounded
+    voice.gain_left = target_left;
+    voice.gain_right = target_right;
+}
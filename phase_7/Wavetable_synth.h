@@ -0,0 +1,223 @@
+#ifndef CORE_MIDI_GEN2_WAVETABLE_SYNTH_H
+#define CORE_MIDI_GEN2_WAVETABLE_SYNTH_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Disk_streamer.h"
+#include "Sample_bank.h"
+#include "Sequencer.h"
+#include "Voice_limiter.h"
+
+// a General MIDI sample playback synth that renders a block at a time, in place of the graph's music device
+// events are queued at their sample offsets and render() splits the block at them, so timing is sample accurate
+// a fixed voice pool plays the bank's regions with linear interpolation and a DAHDSR volume envelope,
+// following program and bank select, volume, expression, pan, modulation, sustain, pitch bend and its range (RPN 0),
+// fine and coarse tuning (RPN 1 and 2), the channel mode messages and the GM reset and master volume sysex
+// channel 10 plays the percussion bank
+// with a Disk_streamer, the regions it preloaded play from its attacks and rings instead of the bank's samples
+// with limit_voices(), each render is timed against its deadline and a Voice_limiter sets how many voices may sound,
+// those over it fade out quietest first
+// everything is allocated at construction, nothing in the event or render path allocates, locks or waits,
+// so it runs on the audio thread as it is, but it isn't thread safe, events and render() come from one thread
+class Wavetable_synth : public Event_sink {
+public:
+    // events queued ahead of a render, any further ones are applied at once
+    static const std::size_t queue_capacity = 1024;
+    // channel state (pitch, vibrato, gain) is updated at least this often within a block
+    static const std::uint32_t control_frames = 64;
+    // plays the percussion bank whatever its bank select says
+    static const std::uint8_t drum_channel = 9;
+
+private:
+    struct Queued_event {
+        std::uint32_t offset;
+        std::uint8_t status;
+        std::uint8_t data_1;
+        std::uint8_t data_2;
+    };
+
+    struct Channel {
+        const Bank_preset *preset = nullptr;
+        std::uint8_t program = 0;
+        std::uint8_t bank_msb = 0;
+        std::uint8_t volume = 100;
+        std::uint8_t expression = 127;
+        std::uint8_t pan = 64;
+        std::uint8_t modulation = 0;
+        bool sustain = false;
+        std::uint16_t pitch_bend = 8192;
+        // RPN 0 in cents, RPN 1 and 2 together in cents
+        float bend_range_cents = 200.f;
+        float tune_cents = 0.f;
+        std::uint16_t fine_tune = 8192;
+        std::uint8_t coarse_tune = 64;
+        // the selected RPN, 0x3FFF for none (or an NRPN, which nothing here handles)
+        std::uint16_t rpn = 0x3FFF;
+
+        // updated once per control block
+        float pitch_ratio = 1.f;
+        float gain = 1.f;
+        // -1 left, 1 right
+        float pan_position = 0.f;
+    };
+
+    enum class Stage : std::uint8_t {
+        delay,
+        attack,
+        hold,
+        decay,
+        sustain,
+        release,
+        off
+    };
+
+    struct Voice {
+        const Sample_region *region = nullptr;
+        // the region's, or the streamer's copy of them
+        const std::int16_t *samples = nullptr;
+        // while the sample comes from the disk, its position then runs on through the loop rather than wrapping
+        Disk_streamer::Stream *stream = nullptr;
+        double position = 0.;
+        // samples per output frame at the channel's current pitch
+        double base_step = 0.;
+        std::uint64_t started = 0;
+        Stage stage = Stage::off;
+        bool loops = false;
+        float level = 0.f;
+        // each frame the level becomes level * envelope_mul + envelope_add, a ramp in the attack
+        // and an exponential approach to the sustain level or silence in the decay and release
+        float envelope_mul = 1.f;
+        float envelope_add = 0.f;
+        // left in a timed stage, the sustain stage lasts until the note is released
+        std::uint32_t stage_frames = 0;
+        float velocity_gain = 0.f;
+        // ramped to the target over each control block so controller moves don't click
+        float gain_left = 0.f;
+        float gain_right = 0.f;
+        std::uint8_t channel = 0;
+        std::uint8_t key = 0;
+        // note off arrived while the pedal was down
+        bool sustained = false;
+        // cut off, gone in a few milliseconds
+        bool is_fading = false;
+
+        bool is_active() const { return stage != Stage::off; }
+    };
+
+    const Sample_bank &_bank;
+    Disk_streamer *_streamer;
+    double _srate;
+    std::vector<Voice> _voices;
+    std::array<Channel, 16> _channels;
+    std::array<Queued_event, queue_capacity> _queue;
+    std::size_t _queued = 0;
+    float _master_gain = 1.f;
+    // time in frames since the last reset, for vibrato and voice age
+    std::uint64_t _frame = 0;
+    std::uint64_t _note_ons = 0;
+    std::uint64_t _stolen = 0;
+    std::uint64_t _underruns = 0;
+    // live only, offline renders keep every voice so they come out the same each time
+    std::unique_ptr<Voice_limiter> _limiter;
+
+public:
+    // the bank and the streamer must outlive the synth, the streamer needs a stream for each voice
+    Wavetable_synth(const Sample_bank &bank, std::uint32_t max_voices, double srate, Disk_streamer *streamer = nullptr);
+
+    ~Wavetable_synth() override = default;
+
+    Wavetable_synth(const Wavetable_synth &) = delete;
+
+    Wavetable_synth &operator=(const Wavetable_synth &) = delete;
+
+    // offset is in frames from the start of the next render, an offset past it carries over to the following one
+    void channel_event(std::uint8_t status, std::uint8_t data_1, std::uint8_t data_2, std::uint32_t offset) override;
+
+    // the GM system on and master volume universal messages, anything else is ignored
+    void sysex(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length, std::uint32_t offset) override;
+
+    // the message sysex() takes as GM system on, which resets every channel's bank select and program
+    static bool is_system_on(std::uint8_t status, const std::uint8_t *payload, std::uint32_t length);
+
+    // writes frames of the mix into left and right, overwriting them
+    void render(std::uint32_t frames, float *left, float *right);
+
+    // silence, every controller back to its default and any queued events dropped, as a GM reset
+    void reset();
+
+    double srate() const { return _srate; }
+
+    std::uint32_t max_voices() const { return static_cast<std::uint32_t>(_voices.size()); }
+
+    std::uint32_t active_voices() const;
+
+    // note ons that had to cut off a sounding voice because none was free
+    std::uint64_t stolen_voices() const { return _stolen; }
+
+    // voice blocks that reached frames the streamer hadn't read yet and played silence in their place
+    std::uint64_t stream_underruns() const { return _underruns; }
+
+    // before rendering starts, loads as shares of a block's duration, see Voice_limiter
+    void limit_voices(float high_load, float low_load);
+
+    // nullptr unless limit_voices() was called, its counters may be read from any thread
+    const Voice_limiter *voice_limiter() const { return _limiter.get(); }
+
+private:
+    void _queue_event(const Queued_event &event);
+
+    void _apply(const Queued_event &event);
+
+    void _control_change(std::uint8_t channel, std::uint8_t controller, std::uint8_t value);
+
+    void _data_entry(Channel &channel, std::uint8_t value, bool is_msb);
+
+    void _reset_controllers(Channel &channel);
+
+    // what a GM system on does, without touching the queue
+    void _system_reset();
+
+    void _program_change(std::uint8_t channel, std::uint8_t program);
+
+    void _note_on(std::uint8_t channel, std::uint8_t key, std::uint8_t velocity);
+
+    void _note_off(std::uint8_t channel, std::uint8_t key);
+
+    void _start_voice(Voice &voice, const Sample_region &region, std::uint8_t channel, std::uint8_t key, std::uint8_t velocity);
+
+    // a free voice while fewer than the ceiling sound, otherwise a stolen one
+    Voice &_free_voice();
+
+    // the voice to give up first, see _is_victim_before
+    Voice *_victim(bool skips_fading);
+
+    bool _is_victim_before(const Voice &voice, const Voice &other) const;
+
+    // fades out the voices over the limiter's ceiling
+    void _shed_voices(std::uint32_t ceiling);
+
+    std::uint32_t _sounding_voices() const;
+
+    void _release(Voice &voice);
+
+    // a fast fade for an exclusive class, whatever the region's release
+    void _cut(Voice &voice);
+
+    std::uint32_t _frames_for(float seconds) const;
+
+    void _enter_stage(Voice &voice, Stage stage);
+
+    void _update_channels();
+
+    void _target_gains(const Voice &voice, float &left, float &right) const;
+
+    void _render_voices(std::uint32_t frames, float *left, float *right);
+
+    void _render_voice(Voice &voice, std::uint32_t frames, float *left, float *right);
+};
+
+#endif //CORE_MIDI_GEN2_WAVETABLE_SYNTH_H
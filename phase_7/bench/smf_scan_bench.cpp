@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Mapped_file.h"
+#include "Smf_format.h"
+#include "Smf_parser.h"
+#include "Smf_scan.h"
+
+// bytes/second of the high-bit kernels alone and of a single threaded track decode through each of them
+// the scalar kernel is itself word-at-a-time (SWAR), the bytewise row is the reference without any mask:
+// the high bits tested one byte at a time and the tracks decoded one byte at a time
+// usage: smf_scan_bench /Path/To/File.mid [iterations]
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double seconds_since(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    double scan_bytes_per_sec(const Mapped_file &file, int iterations)
+    {
+        auto blocks = file.size() / smf_scan::block_size;
+        auto sink = std::uint64_t{0};
+        auto start = Clock::now();
+        for (auto i = 0; i < iterations; ++i) {
+            for (auto block = std::size_t{0}; block < blocks; ++block) {
+                sink += smf_scan::high_bits(file.data() + block * smf_scan::block_size);
+            }
+        }
+        auto elapsed = seconds_since(start);
+        // keep the loop from being optimised away
+        if (sink == 42) { printf(" "); }
+        return static_cast<double>(blocks * smf_scan::block_size) * iterations / elapsed;
+    }
+
+    double scan_bytewise_bytes_per_sec(const Mapped_file &file, int iterations)
+    {
+        auto blocks = file.size() / smf_scan::block_size;
+        auto sink = std::uint64_t{0};
+        auto start = Clock::now();
+        for (auto i = 0; i < iterations; ++i) {
+            for (auto block = std::size_t{0}; block < blocks; ++block) {
+                auto p = file.data() + block * smf_scan::block_size;
+                auto bits = std::uint64_t{0};
+                for (auto b = std::size_t{0}; b < smf_scan::block_size; ++b) {
+                    bits |= std::uint64_t{p[b] >= 0x80} << b;
+                }
+                sink += bits;
+            }
+        }
+        auto elapsed = seconds_since(start);
+        if (sink == 42) { printf(" "); }
+        return static_cast<double>(blocks * smf_scan::block_size) * iterations / elapsed;
+    }
+
+    // the same tracks and events as Smf_parser's decode, through the byte at a time walk with no high-bit mask
+    // only the decode, the parser rows also include moving the tempo events to the tempo track
+    double decode_bytewise_bytes_per_sec(const std::shared_ptr<const Mapped_file> &file, int iterations)
+    {
+        auto best = 1e30;
+        for (auto i = 0; i < iterations; ++i) {
+            auto start = Clock::now();
+            auto tracks = std::vector<Midi_track_buffer>{};
+            auto header = smf::read_header(file->data(), file->size(), file->path());
+            smf::for_each_track(file->begin() + header.size, file->end(), [&](const std::uint8_t *begin, const std::uint8_t *end) {
+                tracks.emplace_back();
+                auto &track = tracks.back();
+                track.reserve(static_cast<std::size_t>(end - begin) / 3);
+                auto source = smf::Memory_source{begin, end};
+                auto state = smf::Track_state{};
+                auto event = smf::Event{};
+                while (!source.at_end() && smf::read_event(source, state, event)) {
+                    auto offset = event.payload ? static_cast<std::uint32_t>(event.payload - file->data()) : std::uint32_t{0};
+                    track.push_back(event.tick, event.status, event.data_1, event.data_2, offset, event.payload_length);
+                }
+            });
+            best = std::min(best, seconds_since(start));
+        }
+        return file->size() / best;
+    }
+
+    double decode_bytes_per_sec(const std::shared_ptr<const Mapped_file> &file, int iterations)
+    {
+        // best of the iterations, the first one also pays for page faults
+        auto best = 1e30;
+        for (auto i = 0; i < iterations; ++i) {
+            auto start = Clock::now();
+            auto sequence = Smf_parser{Smf_track_mode::preserve_tracks, 1}.parse(file);
+            best = std::min(best, seconds_since(start));
+        }
+        return file->size() / best;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: smf_scan_bench /Path/To/File.mid [iterations]\n");
+        exit(1);
+    }
+    auto iterations = (argc > 2) ? std::max(std::atoi(argv[2]), 1) : 5;
+
+    auto file = std::shared_ptr<const Mapped_file>{};
+    try {
+        file = std::make_shared<const Mapped_file>(argv[1]);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: Mapped_file (%s)\n", e.what());
+        exit(1);
+    }
+
+    printf("%s, %lu bytes, best kernel %s\n", argv[1], static_cast<unsigned long>(file->size()),
+           smf_scan::kernel_name(smf_scan::active_kernel()));
+    printf("%-8s %14s %14s\n", "kernel", "scan MB/s", "decode MB/s");
+
+    try {
+        auto scan = scan_bytewise_bytes_per_sec(*file, iterations * 10);
+        auto decode = decode_bytewise_bytes_per_sec(file, iterations);
+        printf("%-8s %14.1f %14.1f\n", "bytewise", scan / 1e6, decode / 1e6);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "Error: bytewise decode (%s)\n", e.what());
+        exit(1);
+    }
+
+    for (auto kernel : {smf_scan::Kernel::scalar, smf_scan::Kernel::sse2, smf_scan::Kernel::avx2}) {
+        smf_scan::force_kernel(kernel);
+        if (smf_scan::active_kernel() != kernel) { continue; }
+
+        try {
+            auto scan = scan_bytes_per_sec(*file, iterations * 10);
+            auto decode = decode_bytes_per_sec(file, iterations);
+            printf("%-8s %14.1f %14.1f\n", smf_scan::kernel_name(kernel), scan / 1e6, decode / 1e6);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "Error: Smf_parser::parse (%s)\n", e.what());
+            exit(1);
+        }
+    }
+    return 0;
+}
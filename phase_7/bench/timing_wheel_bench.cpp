@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Timing_wheel.h"
+
+// dispatch error of a Timing_wheel fed a synthetic live stream, the way Endpoint_dispatcher drives it
+// events come in chords of 1-8 at random gaps averaging events_per_sec, half a second ahead of the clock,
+// and halfway through the tempo goes up by a quarter so every future event is rescheduled
+// spin_us wakes that much early and yields up to the tick, to see how much of the error is sleep overshoot
+// usage: timing_wheel_bench [events_per_sec] [seconds] [resolution_us] [spin_us]
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    std::int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    double percentile_us(const std::vector<std::int64_t> &sorted, double fraction)
+    {
+        if (sorted.empty()) { return 0.; }
+        auto index = std::min(sorted.size() - 1, static_cast<std::size_t>(fraction * sorted.size()));
+        return sorted[index] / 1000.;
+    }
+
+    // ns per insert and per expired item with no sleeping, the wheel's own cost
+    void time_operations(std::int64_t resolution, std::size_t count)
+    {
+        auto wheel = Timing_wheel<std::uint32_t>{0, resolution, count};
+        auto random = std::mt19937_64{1};
+        auto deadlines = std::vector<std::int64_t>(count);
+        for (auto &deadline : deadlines) {
+            deadline = static_cast<std::int64_t>(random() % 1000000000);
+        }
+
+        auto start = Clock::now();
+        for (auto i = std::size_t{0}; i < count; ++i) {
+            wheel.insert(deadlines[i], static_cast<std::uint32_t>(i));
+        }
+        auto inserted = Clock::now();
+        auto due = std::vector<Timing_wheel<std::uint32_t>::Entry>{};
+        due.reserve(count);
+        for (auto now = std::int64_t{0}; !wheel.empty(); now += 1000000) {
+            wheel.advance(now, due);
+        }
+        auto expired = Clock::now();
+
+        printf("%lu items: insert %.1f ns, expire %.1f ns per item\n", static_cast<unsigned long>(count),
+               std::chrono::duration<double, std::nano>(inserted - start).count() / count,
+               std::chrono::duration<double, std::nano>(expired - inserted).count() / count);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    auto events_per_sec = (argc > 1) ? std::max(std::atoi(argv[1]), 1) : 10000;
+    auto seconds = (argc > 2) ? std::max(std::atoi(argv[2]), 1) : 10;
+    auto resolution = std::int64_t{(argc > 3) ? std::max(std::atoi(argv[3]), 1) : 250} * 1000;
+    auto spin = std::int64_t{(argc > 4) ? std::max(std::atoi(argv[4]), 0) : 0} * 1000;
+
+    time_operations(resolution, 100000);
+
+    const auto lookahead = std::int64_t{500000000};
+    const auto mean_chord = 4.5;
+    auto mean_gap = 1000000000. * mean_chord / events_per_sec;
+    auto random = std::mt19937_64{2};
+    auto gap = std::exponential_distribution<double>{1. / mean_gap};
+    auto chord = std::uniform_int_distribution<int>{1, 8};
+
+    auto start = now_ns();
+    auto end = start + seconds * std::int64_t{1000000000};
+    auto tempo_change = start + (end - start) / 2;
+    auto wheel = Timing_wheel<std::uint32_t>{start, resolution, 1 << 16};
+    auto due = std::vector<Timing_wheel<std::uint32_t>::Entry>{};
+    auto errors = std::vector<std::int64_t>{};
+    errors.reserve(static_cast<std::size_t>(events_per_sec) * seconds * 2);
+
+    auto next_event = static_cast<double>(start);
+    auto did_change = false;
+    auto id = std::uint32_t{0};
+    while (true) {
+        auto now = now_ns();
+        for (; next_event < now + lookahead && next_event < end; next_event += gap(random)) {
+            for (auto i = chord(random); i > 0; --i) {
+                wheel.insert(static_cast<std::int64_t>(next_event), id++);
+            }
+        }
+
+        if (!did_change && now >= tempo_change) {
+            // a quarter faster from here on, only what is still on the wheel moves
+            wheel.reschedule([now](std::uint32_t, std::int64_t deadline) {
+                return now + (deadline - now) * 4 / 5;
+            });
+            next_event = now + (next_event - now) * 0.8;
+            mean_gap *= 0.8;
+            gap = std::exponential_distribution<double>{1. / mean_gap};
+            did_change = true;
+        }
+
+        due.clear();
+        wheel.advance(now, due);
+        auto sent = now_ns();
+        for (const auto &entry : due) {
+            errors.push_back(sent - entry.deadline);
+        }
+
+        if (now >= end && wheel.empty()) { break; }
+        auto wake = std::min(wheel.next_expiry(), now + lookahead / 2);
+        std::this_thread::sleep_for(std::chrono::nanoseconds{std::max(wake - spin - now_ns(), std::int64_t{0})});
+        while (now_ns() < wake) { std::this_thread::yield(); }
+    }
+
+    std::sort(errors.begin(), errors.end());
+    printf("%lu events over %d s, %.0f us ticks\n", static_cast<unsigned long>(errors.size()), seconds,
+           resolution / 1000.);
+    printf("dispatch error us: p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+           percentile_us(errors, .5), percentile_us(errors, .99), percentile_us(errors, .999),
+           percentile_us(errors, 1.));
+    return 0;
+}
@@ -5,16 +5,27 @@
 
 namespace globals {
     const std::map<const std::string, const std::string> cmd_strings{
-            {"bank_cmd",       "[-b /Path/To/Sound/Bank.dls]\n\t"},
+            {"synth_cmd",      "[-a] Render with the built-in wavetable synth instead of the system's music device\n\t"},
+            {"bank_cmd",       "[-b /Path/To/Sound/Bank.dls] With -a, a SoundFont (.sf2) or DLS bank mapped in place\n\t"},
             {"smf_chan_cmd",   "[-c] Will Parse MIDI file into channels\n\t"},
-            {"disk_stream",    "[-d] Turns disk streaming on\n\t"},
+            {"disk_stream",    "[-d] Turns disk streaming on, with -a and -b only the start of each sample stays in memory\n\t"},
+            {"cache_cmd",      "[-k] Write a sequence cache next to the MIDI file, a fresh one is always used\n\t"},
+            {"probe_cmd",      "[-m] Print a one line JSON summary of each MIDI file without loading it, takes several files\n\t"},
             {"midi_cmd",       "[-e] Use a MIDI Endpoint\n\t"},
             {"file_cmd",       "[-f /Path/To/File.<EXT FOR FORMAT> 'data' srate] Create a stereo file where\n\t"},
             {"file_cmd_1",     "\t\t 'data' is the data format (lpcm or a compressed type, like 'aac ')\n\t"},
             {"file_cmd_2",     "\t\t srate is the sample rate\n\t"},
+            {"record_cmd",     "[-g /Path/To/Log.cmgr] Record every event sent to the synth while rendering offline\n\t"},
+            {"replay_cmd",     "[-y /Path/To/Log.cmgr] Render a recorded log instead of a MIDI file (needs -f or -x)\n\t"},
+            {"render_cmd",     "[-x srate] Render offline as fast as possible without writing a file, then report the throughput\n\t"},
+            {"loop_cmd",       "[-l loopStart-Beats loopEnd-Beats repeats] Render the region that many times as a seamless loop,\n\t"},
+            {"loop_cmd_1",     "\t\t notes still down at either end of it are released there (needs -f or -x)\n\t"},
             {"num_frames_cmd", "[-i io Sample Size] default is 512\n\t"},
+            {"voice_cmd",      "[-v voices] Voice budget the polyphony is checked against before rendering and the most voices the built-in synth gets, default is 64\n\t"},
             {"no_print_cmd",   "[-n] Don't print\n\t"},
             {"play_cmd",       "[-p] Play the Sequence\n\t"},
+            {"stream_cmd",     "[-r] Stream the MIDI file while rendering instead of loading it first (needs -f or -x, not -c)\n\t"},
+            {"query_cmd",      "[-q startBeat endBeat] List the notes sounding between the two beats (track, channel, key, velocity)\n\t"},
             {"start_time_cmd", "[-s startTime-Beats]\n\t"},
             {"track_cmd",      "[-t trackIndex] Play specified track(s), e.g. -t 1 -t 2...(this is a one based index)\n\t"},
             {"wait_cmd",       "[-w] Play for 10 seconds, then dispose all objects and wait at end\n\t"},
@@ -23,25 +34,40 @@ namespace globals {
     };
 
     const auto usage_string = cmd_strings.at("usage_str") +
+                              cmd_strings.at("synth_cmd") +
                               cmd_strings.at("bank_cmd") +
                               cmd_strings.at("smf_chan_cmd") +
                               cmd_strings.at("disk_stream") +
+                              cmd_strings.at("cache_cmd") +
+                              cmd_strings.at("probe_cmd") +
                               cmd_strings.at("midi_cmd") +
                               cmd_strings.at("file_cmd") +
                               cmd_strings.at("file_cmd_1") +
                               cmd_strings.at("file_cmd_2") +
+                              cmd_strings.at("render_cmd") +
+                              cmd_strings.at("record_cmd") +
+                              cmd_strings.at("replay_cmd") +
+                              cmd_strings.at("loop_cmd") +
+                              cmd_strings.at("loop_cmd_1") +
                               cmd_strings.at("num_frames_cmd") +
+                              cmd_strings.at("voice_cmd") +
                               cmd_strings.at("no_print_cmd") +
                               cmd_strings.at("play_cmd") +
+                              cmd_strings.at("stream_cmd") +
+                              cmd_strings.at("query_cmd") +
                               cmd_strings.at("start_time_cmd") +
                               cmd_strings.at("track_cmd") +
                               cmd_strings.at("wait_cmd") +
                               cmd_strings.at("src_file_cmd");
 
-    static auto did_overload = UInt32{0};
-    static auto overload_time = UInt64{0};
+    // Drift_clock::now_ns when playback started
     static auto start_running_time = UInt64{};
     static auto max_cpu_load = Float32{.8};
+    // the built-in synth cuts its voices when a block costs more than max_cpu_load of its duration
+    // and lets them back once blocks cost less than this
+    static auto min_cpu_load = Float32{.6};
+    // release tails aren't in the polyphony profile, the built-in synth keeps this many voices for them at least
+    static auto min_native_voices = UInt32{16};
 };
 
 #endif //CORE_MIDI_GEN2_GLOBALS_H